@@ -0,0 +1,32 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+/// @brief 通信形式の数値をバイト列に読み書きする
+/// @remark ネイティブのバイト順 (リトルエンディアン) でそのままコピーします
+namespace BinaryIO
+{
+	/// @brief 値を末尾に追加します
+	template<class Type>
+	inline void Append(Array<Byte>& bytes, const Type& value)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>);
+		const size_t offset = bytes.size();
+		bytes.resize(offset + sizeof(Type));
+		std::memcpy(bytes.data() + offset, &value, sizeof(Type));
+	}
+
+	/// @brief offset から値を読み取り, offset を進めます
+	/// @return 足りない場合false (offsetは変更しません)
+	template<class Type>
+	inline bool Extract(const Array<Byte>& bytes, size_t& offset, Type& value)
+	{
+		static_assert(std::is_trivially_copyable_v<Type>);
+		if (bytes.size() < offset + sizeof(Type))
+		{
+			return false;
+		}
+		std::memcpy(&value, bytes.data() + offset, sizeof(Type));
+		offset += sizeof(Type);
+		return true;
+	}
+}
@@ -0,0 +1,198 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+
+namespace SuperSnake
+{
+	/// @brief フィールドの各マスを1bitで表したビットボード (行優先, y * width + x)
+	/// @remark 集合演算とシフトは64マス単位でまとめて行います
+	class Bitboard
+	{
+	public:
+
+		Bitboard() = default;
+
+		explicit Bitboard(Size size)
+			: m_size(size)
+			, m_words((size.x * size.y + 63) / 64, 0)
+		{ }
+
+		/// @brief 確保済みのマスを1としたビットボードを作成します
+		static Bitboard FromField(const Grid<CellState>& field)
+		{
+			Bitboard board(field.size());
+			for (const Point pos : Iota2D(field.size()))
+			{
+				if (field[pos] != CellState::Unallocated)
+				{
+					board.set(pos);
+				}
+			}
+			return board;
+		}
+
+		Size size() const { return m_size; }
+
+		int32 cellCount() const { return m_size.x * m_size.y; }
+
+		int32 index(Point pos) const { return pos.y * m_size.x + pos.x; }
+
+		bool inBounds(Point pos) const
+		{
+			return 0 <= pos.x && 0 <= pos.y && pos.x < m_size.x && pos.y < m_size.y;
+		}
+
+		bool test(int32 idx) const { return (m_words[idx >> 6] >> (idx & 63)) & 1; }
+
+		bool test(Point pos) const { return test(index(pos)); }
+
+		void set(int32 idx) { m_words[idx >> 6] |= uint64(1) << (idx & 63); }
+
+		void set(Point pos) { set(index(pos)); }
+
+		void reset(int32 idx) { m_words[idx >> 6] &= ~(uint64(1) << (idx & 63)); }
+
+		void reset(Point pos) { reset(index(pos)); }
+
+		/// @brief 指定した列のマスを1としたビットボードを作成します
+		static Bitboard Column(Size size, int32 x)
+		{
+			Bitboard board(size);
+			for (const int32 y : Iota(size.y))
+			{
+				board.set(Point{ x, y });
+			}
+			return board;
+		}
+
+		bool isEmpty() const
+		{
+			return std::all_of(m_words.begin(), m_words.end(), [](uint64 word) { return word == 0; });
+		}
+
+		/// @brief 1のマスのうち添字が最小のもの
+		Optional<int32> lowest() const
+		{
+			for (const auto [i, word] : Indexed(m_words))
+			{
+				if (word)
+				{
+					return static_cast<int32>(i * 64 + std::countr_zero(word));
+				}
+			}
+			return none;
+		}
+
+		/// @brief 1のマスの添字を昇順に列挙します
+		template<class Func>
+		void forEach(Func func) const
+		{
+			for (const auto [i, word] : Indexed(m_words))
+			{
+				for (uint64 rest = word; rest; rest &= rest - 1)
+				{
+					func(static_cast<int32>(i * 64 + std::countr_zero(rest)));
+				}
+			}
+		}
+
+		/// @brief 全てのマスを添字の方向にnマスずらしたビットボード (負の場合は逆方向, はみ出したマスは捨てます)
+		/// @remark 行の端を越えたマスは隣の行に移るため, 必要に応じて列のマスクと組み合わせてください
+		Bitboard shifted(int32 n) const
+		{
+			Bitboard result(m_size);
+			const int32 wordCount = static_cast<int32>(m_words.size());
+			const int32 wordShift = Abs(n) / 64;
+			const int32 bitShift = Abs(n) % 64;
+			for (const int32 i : Iota(wordCount))
+			{
+				const int32 src = n >= 0 ? i - wordShift : i + wordShift;
+				if (src < 0 || wordCount <= src)
+				{
+					continue;
+				}
+
+				if (n >= 0)
+				{
+					uint64 word = m_words[src] << bitShift;
+					if (bitShift && src >= 1)
+					{
+						word |= m_words[src - 1] >> (64 - bitShift);
+					}
+					result.m_words[i] = word;
+				}
+				else
+				{
+					uint64 word = m_words[src] >> bitShift;
+					if (bitShift && src + 1 < wordCount)
+					{
+						word |= m_words[src + 1] << (64 - bitShift);
+					}
+					result.m_words[i] = word;
+				}
+			}
+			result.clearPadding();
+			return result;
+		}
+
+		Bitboard& operator|=(const Bitboard& other)
+		{
+			for (const size_t i : Iota(m_words.size()))
+			{
+				m_words[i] |= other.m_words[i];
+			}
+			return *this;
+		}
+
+		Bitboard& operator&=(const Bitboard& other)
+		{
+			for (const size_t i : Iota(m_words.size()))
+			{
+				m_words[i] &= other.m_words[i];
+			}
+			return *this;
+		}
+
+		/// @brief otherで1のマスを0にします
+		Bitboard& andNot(const Bitboard& other)
+		{
+			for (const size_t i : Iota(m_words.size()))
+			{
+				m_words[i] &= ~other.m_words[i];
+			}
+			return *this;
+		}
+
+		friend Bitboard operator|(Bitboard a, const Bitboard& b) { return a |= b; }
+
+		friend Bitboard operator&(Bitboard a, const Bitboard& b) { return a &= b; }
+
+		/// @brief 1のマスの数
+		int32 count() const
+		{
+			int32 result = 0;
+			for (const uint64 word : m_words)
+			{
+				result += std::popcount(word);
+			}
+			return result;
+		}
+
+		const Array<uint64>& words() const { return m_words; }
+
+	private:
+
+		Size m_size{ 0, 0 };
+
+		Array<uint64> m_words;
+
+		// フィールド外のビットを0にする
+		void clearPadding()
+		{
+			const int32 rest = cellCount() % 64;
+			if (rest && not m_words.isEmpty())
+			{
+				m_words.back() &= (uint64(1) << rest) - 1;
+			}
+		}
+	};
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+/// @brief 複数のスレッドから値を追加し, 1つのスレッドがまとめて取り出すロックフリーのキュー
+/// @remark 追加はCASによるスタックへの積み上げ, 取り出しはスタック全体の交換で行います
+template<class Type>
+class CompletionQueue
+{
+public:
+
+	CompletionQueue() = default;
+
+	CompletionQueue(const CompletionQueue&) = delete;
+
+	CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+	~CompletionQueue()
+	{
+		popAll();
+	}
+
+	/// @brief 値を追加します (任意のスレッドから呼び出せます)
+	void push(Type value)
+	{
+		Node* node = new Node{ std::move(value), m_head.load(std::memory_order_relaxed) };
+		while (not m_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/// @brief 追加された値を追加順に全て取り出します (取り出すスレッドは1つにしてください)
+	Array<Type> popAll()
+	{
+		Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+		Array<Type> values;
+		while (node)
+		{
+			values.push_back(std::move(node->value));
+			Node* next = node->next;
+			delete node;
+			node = next;
+		}
+		std::reverse(values.begin(), values.end());
+		return values;
+	}
+
+	bool isEmpty() const
+	{
+		return m_head.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+
+	struct Node
+	{
+		Type value;
+
+		Node* next;
+	};
+
+	std::atomic<Node*> m_head = nullptr;
+};
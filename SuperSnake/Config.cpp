@@ -4,6 +4,13 @@
 static std::map<uint64, KeyConfig> keyConfig;
 static HashTable<String, GameSettings> gamePresets;
 
+// 設定ファイルの先頭に書き込む識別子 ("SSCF")
+static constexpr uint32 ConfigMagic = 0x46435353;
+
+// 設定ファイルの形式のバージョン (読み込めない形式に変更したら上げる)
+// 1: 識別子とバージョンを追加
+static constexpr uint32 ConfigVersion = 1;
+
 KeyConfig GetKeyConfig(const GamepadInfo& info)
 {
 	return keyConfig[GameController::FromGamepadInfo(info).gamepadUid];
@@ -24,18 +31,59 @@ void SetGamePresets(const HashTable<String, GameSettings>& presets)
 	gamePresets = presets;
 }
 
-void LoadConfig()
+// 識別子の無い古い形式 (keyConfig, gamePresets) からキー設定だけを読み込む
+// キー設定の形式は変わっていないが, プリセットは GameSettings のバージョンが無いため読み込めない
+static void LoadLegacyKeyConfig()
 {
 	Deserializer<BinaryReader> archive(ConfigPath);
 	if (archive->isOpen())
 	{
 		try
 		{
-			archive(CEREAL_NVP(keyConfig), CEREAL_NVP(gamePresets));
+			archive(CEREAL_NVP(keyConfig));
+		}
+		catch (const std::exception&)
+		{
+			keyConfig.clear();
+		}
+	}
+}
+
+void LoadConfig()
+{
+	{
+		Deserializer<BinaryReader> archive(ConfigPath);
+		if (not archive->isOpen())
+		{
+			return;
+		}
+
+		try
+		{
+			uint32 magic = 0;
+			uint32 version = 0;
+			archive(CEREAL_NVP(magic), CEREAL_NVP(version));
+
+			if (magic == ConfigMagic)
+			{
+				// 読み込めない新しい形式は既定の設定にする
+				if (version == ConfigVersion)
+				{
+					archive(CEREAL_NVP(keyConfig), CEREAL_NVP(gamePresets));
+				}
+				return;
+			}
+		}
+		catch (const std::exception&)
+		{
+			// 途中まで読み込んだ値は壊れているため捨てる
+			keyConfig.clear();
+			gamePresets.clear();
+			return;
 		}
-		catch (cereal::Exception)
-		{ }
 	}
+
+	LoadLegacyKeyConfig();
 }
 
 void SaveConfig()
@@ -45,9 +93,11 @@ void SaveConfig()
 	{
 		try
 		{
-			archive(CEREAL_NVP(keyConfig), CEREAL_NVP(gamePresets));
+			uint32 magic = ConfigMagic;
+			uint32 version = ConfigVersion;
+			archive(CEREAL_NVP(magic), CEREAL_NVP(version), CEREAL_NVP(keyConfig), CEREAL_NVP(gamePresets));
 		}
-		catch (cereal::Exception)
+		catch (const std::exception&)
 		{ }
 	}
 }
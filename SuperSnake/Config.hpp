@@ -1,12 +1,32 @@
 ﻿#pragma once
 #include "Solver.hpp"
 #include "SolverV1.hpp"
+#include "SolverNN.hpp"
+#include "SolverAlphaBeta.hpp"
+#include "SolverProcess.hpp"
 #include "GameController.hpp"
 #include "KeyConfig.hpp"
 #include "GameSettings.hpp"
+#include "NetworkProtocol.hpp"
 
 constexpr StringView ConfigPath = U"./config.bin";
 
+constexpr StringView OpeningBookDirectory = U"./book/";
+
+constexpr StringView TablebaseDirectory = U"./tablebase/";
+
+constexpr StringView EvalWeightsPath = U"./eval/weights.nnue";
+
+constexpr StringView SolverStatsLogPath = U"./log/solver_stats.csv";
+
+// 子プロセスで動かすエンジン (SuperSnakeTool engine)
+// Debug ビルドの実行ファイル名には (debug) が付く
+#if SIV3D_BUILD(DEBUG)
+constexpr StringView EngineExecutablePath = U"./SuperSnakeTool(debug).exe";
+#else
+constexpr StringView EngineExecutablePath = U"./SuperSnakeTool.exe";
+#endif
+
 constexpr ColorF DefaultCellColor = Palette::White;
 constexpr ColorF ConflictCellColor = ColorF{ 0.7 };
 constexpr double FrameThickness = 4;
@@ -19,12 +39,35 @@ constexpr std::array<ColorF, 4> SnakeColors{
 };
 constexpr ColorF DeadSnakeColor = ColorF{ 0.5 };
 constexpr ColorF ActionConfirmedColor = Color{ 0x60, 0xD6, 0x66 }; // #60D666
+// 解析結果をセルの色に混ぜる割合
+constexpr double AnalysisOverlayStrength = 0.35;
 constexpr SizeF PlayerStateBoxSize = { 220, 160 };
 constexpr double PlayerStateBoxRound = 6;
 constexpr double PlayerStateBoxThickness = 4;
 
-constexpr std::array<std::pair<const char32_t*, SolverGenerator>, 1> Solvers{
-	std::pair<const char32_t*, SolverGenerator>{U"SolverV1", CreateSolverV1}
+// 対戦のスレッドがネットワークのクライアント, 観戦しているホストからの受信を確認する間隔
+constexpr Duration SimulationPollInterval = 0.001s;
+
+// 対戦中に新しい観戦者の接続を確認する間隔
+constexpr Duration SpectatorPollInterval = 0.05s;
+
+// 先読みさせる次の局面候補の最大数
+constexpr size_t PonderCandidateCount = 9;
+
+// ネットワークのクライアントを待ち受けるポート
+constexpr uint16 NetworkPort = NetworkProtocol::DefaultPort;
+
+// ネットワークのクライアントの制限時間に加えて通信の遅れを待つ時間
+constexpr Duration NetworkDeadlineGrace = 0.1s;
+
+// 観戦者を待ち受けるポート
+constexpr uint16 SpectatorPort = NetworkProtocol::DefaultSpectatorPort;
+
+constexpr std::array<std::pair<const char32_t*, SolverGenerator>, 4> Solvers{
+	std::pair<const char32_t*, SolverGenerator>{U"SolverV1", CreateSolverV1},
+	std::pair<const char32_t*, SolverGenerator>{U"SolverNN", CreateSolverNN},
+	std::pair<const char32_t*, SolverGenerator>{U"SolverAlphaBeta", CreateSolverAlphaBeta},
+	std::pair<const char32_t*, SolverGenerator>{U"SolverV1 (Process)", CreateSolverProcess}
 };
 
 KeyConfig GetKeyConfig(const GamepadInfo& info);
@@ -0,0 +1,174 @@
+﻿#include "EngineProtocol.hpp"
+#include "BinaryIO.hpp"
+
+using namespace SuperSnake;
+
+namespace EngineProtocol
+{
+	using BinaryIO::Append;
+	using BinaryIO::Extract;
+
+	Array<Byte> EncodeMessage(MessageType type, const Array<Byte>& payload)
+	{
+		Array<Byte> bytes;
+		bytes.reserve(sizeof(MessageHeader) + payload.size());
+		Append(bytes, MessageHeader{
+			.magic = Magic,
+			.version = Version,
+			.type = type,
+			.size = static_cast<uint32>(payload.size())
+			});
+		bytes.append(payload);
+		return bytes;
+	}
+
+	Optional<MessageHeader> DecodeHeader(const Byte* data)
+	{
+		MessageHeader header;
+		std::memcpy(&header, data, sizeof(MessageHeader));
+		if (header.magic != Magic ||
+			header.version != Version ||
+			header.size > MaxPayloadSize)
+		{
+			return none;
+		}
+		return header;
+	}
+
+	// requestId, timeLimitMs, idCount, id毎: id
+	// GameFormat::Alignment の倍数の位置から局面 (GameFormat)
+	Array<Byte> EncodeSolveRequest(uint32 requestId, uint32 timeLimitMs, const Game& game, const Array<SnakeID>& ids)
+	{
+		Array<Byte> bytes;
+		Append(bytes, requestId);
+		Append(bytes, timeLimitMs);
+		Append(bytes, static_cast<uint8>(ids.size()));
+		for (const SnakeID id : ids)
+		{
+			Append(bytes, static_cast<uint8>(id));
+		}
+		GameFormat::Append(game, bytes);
+		return bytes;
+	}
+
+	Optional<SolveRequest> DecodeSolveRequest(const Array<Byte>& payload)
+	{
+		size_t offset = 0;
+		uint32 requestId, timeLimitMs;
+		uint8 idCount;
+		if (not Extract(payload, offset, requestId) ||
+			not Extract(payload, offset, timeLimitMs) ||
+			not Extract(payload, offset, idCount))
+		{
+			return none;
+		}
+
+		Array<SnakeID> ids;
+		for (size_t i = 0; i < idCount; i++)
+		{
+			uint8 id;
+			if (not Extract(payload, offset, id))
+			{
+				return none;
+			}
+			ids.push_back(id);
+		}
+
+		// 局面は受信したバッファのまま読み取る
+		const size_t gameOffset = (offset + GameFormat::Alignment - 1) / GameFormat::Alignment * GameFormat::Alignment;
+		if (gameOffset > payload.size())
+		{
+			return none;
+		}
+		const auto view = GameFormat::GameView::Open(payload.data() + gameOffset, payload.size() - gameOffset);
+		if (not view || ids.any([&](SnakeID id) { return static_cast<size_t>(id) >= view->snakeCount(); }))
+		{
+			return none;
+		}
+
+		return SolveRequest{
+			.requestId = requestId,
+			.timeLimitMs = timeLimitMs,
+			.game = *view,
+			.ids = std::move(ids)
+		};
+	}
+
+	// requestId, actionCount, actions, nodes, ttProbes, ttHits, depth, pvCount, pv
+	Array<Byte> EncodeSolveResponse(const SolveResponse& response)
+	{
+		Array<Byte> bytes;
+		Append(bytes, response.requestId);
+		Append(bytes, static_cast<uint8>(response.actions.size()));
+		for (const SnakeAction action : response.actions)
+		{
+			Append(bytes, static_cast<int8>(action));
+		}
+		Append(bytes, response.stats.nodes);
+		Append(bytes, response.stats.ttProbes);
+		Append(bytes, response.stats.ttHits);
+		Append(bytes, response.stats.depth);
+
+		const size_t pvCount = Min<size_t>(response.stats.pv.size(), 255);
+		Append(bytes, static_cast<uint8>(pvCount));
+		for (size_t i = 0; i < pvCount; i++)
+		{
+			Append(bytes, static_cast<int8>(response.stats.pv[i]));
+		}
+		return bytes;
+	}
+
+	Optional<SolveResponse> DecodeSolveResponse(const Array<Byte>& payload)
+	{
+		const auto extractAction = [&](size_t& offset, SnakeAction& action) {
+			int8 value;
+			if (not Extract(payload, offset, value) ||
+				value < static_cast<int8>(SnakeAction::MoveLeft) ||
+				value > static_cast<int8>(SnakeAction::Stay))
+			{
+				return false;
+			}
+			action = static_cast<SnakeAction>(value);
+			return true;
+		};
+
+		size_t offset = 0;
+		SolveResponse response;
+		uint8 actionCount;
+		if (not Extract(payload, offset, response.requestId) ||
+			not Extract(payload, offset, actionCount))
+		{
+			return none;
+		}
+
+		response.actions.resize(actionCount);
+		for (auto& action : response.actions)
+		{
+			if (not extractAction(offset, action))
+			{
+				return none;
+			}
+		}
+
+		uint8 pvCount;
+		if (not Extract(payload, offset, response.stats.nodes) ||
+			not Extract(payload, offset, response.stats.ttProbes) ||
+			not Extract(payload, offset, response.stats.ttHits) ||
+			not Extract(payload, offset, response.stats.depth) ||
+			not Extract(payload, offset, pvCount))
+		{
+			return none;
+		}
+
+		response.stats.pv.resize(pvCount);
+		for (auto& action : response.stats.pv)
+		{
+			if (not extractAction(offset, action))
+			{
+				return none;
+			}
+		}
+
+		return response;
+	}
+}
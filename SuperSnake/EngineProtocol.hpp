@@ -0,0 +1,80 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+#include "Solver.hpp"
+#include "GameFormat.hpp"
+
+/// @brief 子プロセスのエンジンとの通信形式
+/// @remark 全てのメッセージは MessageHeader + ペイロード で, 数値はリトルエンディアンです
+/// ホスト -> エンジン: Solve, エンジン -> ホスト: Result の順に1往復します
+namespace EngineProtocol
+{
+	// "SSEP"
+	constexpr uint32 Magic = 0x50455353;
+
+	constexpr uint32 Version = 2;
+
+	enum class MessageType : uint32
+	{
+		/// @brief 探索要求 (SolveRequest)
+		Solve = 1,
+
+		/// @brief 探索結果 (SolveResponse)
+		Result = 2,
+	};
+
+	struct MessageHeader
+	{
+		uint32 magic;
+
+		uint32 version;
+
+		MessageType type;
+
+		/// @brief ペイロードのバイト数
+		uint32 size;
+	};
+
+	/// @brief ペイロードの最大サイズ
+	constexpr uint32 MaxPayloadSize = 1 << 24;
+
+	struct SolveRequest
+	{
+		uint32 requestId;
+
+		/// @brief 制限時間 [ms], 0の場合は無制限
+		uint32 timeLimitMs;
+
+		/// @brief 局面 (GameFormat で送ります)
+		/// @remark 受信したペイロードを参照するため, ペイロードより長く使わないでください
+		GameFormat::GameView game;
+
+		/// @brief 行動を決定するスネーク
+		Array<SuperSnake::SnakeID> ids;
+	};
+
+	struct SolveResponse
+	{
+		uint32 requestId;
+
+		/// @brief idsと同じ順の行動
+		Array<SuperSnake::SnakeAction> actions;
+
+		SolverStats stats;
+	};
+
+	/// @brief ヘッダーを付けたメッセージを作成します
+	Array<Byte> EncodeMessage(MessageType type, const Array<Byte>& payload);
+
+	/// @brief ヘッダーを読み取ります
+	/// @return マジックナンバー, バージョン, サイズが不正な場合none
+	Optional<MessageHeader> DecodeHeader(const Byte* data);
+
+	Array<Byte> EncodeSolveRequest(uint32 requestId, uint32 timeLimitMs, const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids);
+
+	/// @remark 局面は変換せずにペイロードの中を検証するだけで, 必要になった時点で GameView::toGame してください
+	Optional<SolveRequest> DecodeSolveRequest(const Array<Byte>& payload);
+
+	Array<Byte> EncodeSolveResponse(const SolveResponse& response);
+
+	Optional<SolveResponse> DecodeSolveResponse(const Array<Byte>& payload);
+}
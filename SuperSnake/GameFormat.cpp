@@ -0,0 +1,259 @@
+﻿#include "GameFormat.hpp"
+
+using namespace SuperSnake;
+
+namespace GameFormat
+{
+	static constexpr size_t AlignUp(size_t size)
+	{
+		return (size + Alignment - 1) / Alignment * Alignment;
+	}
+
+	// 各区画の先頭からのバイト数と全体のバイト数
+	struct Layout
+	{
+		size_t snakesOffset;
+
+		size_t trailsOffset;
+
+		size_t fieldOffset;
+
+		size_t namesOffset;
+
+		size_t totalSize;
+	};
+
+	static Layout MakeLayout(size_t snakeCount, size_t trailLength, size_t cellCount, size_t namesLength)
+	{
+		Layout layout;
+		layout.snakesOffset = AlignUp(sizeof(Header));
+		layout.trailsOffset = AlignUp(layout.snakesOffset + snakeCount * sizeof(SnakeRecord));
+		layout.fieldOffset = AlignUp(layout.trailsOffset + trailLength * sizeof(TrailPoint));
+		layout.namesOffset = AlignUp(layout.fieldOffset + cellCount);
+		layout.totalSize = AlignUp(layout.namesOffset + namesLength);
+		return layout;
+	}
+
+	static Layout MakeLayout(const Game& game, const Array<std::string>& names)
+	{
+		size_t trailLength = 0;
+		size_t namesLength = 0;
+		for (const auto [id, snake] : Indexed(game.snakes()))
+		{
+			trailLength += snake.bodyPath.size();
+			namesLength += names[id].size();
+		}
+		return MakeLayout(game.snakes().size(), trailLength, game.field().num_elements(), namesLength);
+	}
+
+	static Array<std::string> EncodeNames(const Game& game)
+	{
+		return game.snakes().map([](const Snake& snake) {
+			std::string name = snake.name.toUTF8();
+			name.resize(Min<size_t>(name.size(), UINT16_MAX));
+			return name;
+		});
+	}
+
+	size_t EncodedSize(const Game& game)
+	{
+		return MakeLayout(game, EncodeNames(game)).totalSize;
+	}
+
+	size_t Append(const Game& game, Array<Byte>& bytes)
+	{
+		const auto names = EncodeNames(game);
+		const Layout layout = MakeLayout(game, names);
+		const size_t begin = AlignUp(bytes.size());
+		bytes.resize(begin + layout.totalSize, Byte{ 0 });
+		Byte* data = bytes.data() + begin;
+
+		const Header header{
+			.magic = Magic,
+			.version = Version,
+			.headerSize = static_cast<uint16>(sizeof(Header)),
+			.totalSize = static_cast<uint32>(layout.totalSize),
+			.gameId = game.gameId,
+			.step = game.step(),
+			.width = static_cast<uint16>(game.field().width()),
+			.height = static_cast<uint16>(game.field().height()),
+			.snakeCount = static_cast<uint8>(game.snakes().size()),
+			.gameOver = static_cast<uint8>(game.isGameOver()),
+			.reserved = 0,
+			.snakesOffset = static_cast<uint32>(layout.snakesOffset),
+			.trailsOffset = static_cast<uint32>(layout.trailsOffset),
+			.fieldOffset = static_cast<uint32>(layout.fieldOffset),
+			.namesOffset = static_cast<uint32>(layout.namesOffset)
+		};
+		std::memcpy(data, &header, sizeof(header));
+
+		uint32 trailOffset = 0;
+		uint32 nameOffset = 0;
+		for (const auto [id, snake] : Indexed(game.snakes()))
+		{
+			const SnakeRecord record{
+				.point = snake.point,
+				.x = static_cast<int16>(snake.position.x),
+				.y = static_cast<int16>(snake.position.y),
+				.direction = static_cast<uint8>(snake.direction),
+				.state = static_cast<uint8>(snake.state),
+				.nameLength = static_cast<uint16>(names[id].size()),
+				.nameOffset = nameOffset,
+				.trailOffset = trailOffset,
+				.trailLength = static_cast<uint32>(snake.bodyPath.size())
+			};
+			std::memcpy(data + layout.snakesOffset + id * sizeof(SnakeRecord), &record, sizeof(record));
+
+			for (const auto& point : snake.bodyPath)
+			{
+				const TrailPoint trailPoint{ static_cast<int16>(point.x), static_cast<int16>(point.y) };
+				std::memcpy(data + layout.trailsOffset + trailOffset * sizeof(TrailPoint), &trailPoint, sizeof(trailPoint));
+				trailOffset++;
+			}
+
+			std::memcpy(data + layout.namesOffset + nameOffset, names[id].data(), names[id].size());
+			nameOffset += static_cast<uint32>(names[id].size());
+		}
+
+		// CellState は int8 に収まる値で定義されている
+		Byte* field = data + layout.fieldOffset;
+		for (const CellState cell : game.field())
+		{
+			*field++ = static_cast<Byte>(static_cast<int8>(cell));
+		}
+		return begin;
+	}
+
+	Optional<GameView> GameView::Open(const void* data, size_t size)
+	{
+		if (not data ||
+			reinterpret_cast<uintptr_t>(data) % Alignment != 0 ||
+			size < sizeof(Header))
+		{
+			return none;
+		}
+
+		GameView view;
+		view.m_data = static_cast<const Byte*>(data);
+		view.m_header = reinterpret_cast<const Header*>(data);
+		const Header& header = *view.m_header;
+		if (header.magic != Magic ||
+			not IsCompatibleVersion(header.version) ||
+			header.headerSize < sizeof(Header) ||
+			header.totalSize > size ||
+			header.width < 2 || header.height < 2 ||
+			header.snakeCount < 1 || header.snakeCount > 4)
+		{
+			return none;
+		}
+
+		// 区画が境界に揃っていて, 全体に収まっているか
+		const size_t cellCount = static_cast<size_t>(header.width) * header.height;
+		const auto fits = [&](size_t offset, size_t length) {
+			return offset % Alignment == 0 && offset >= header.headerSize && offset <= header.totalSize && length <= header.totalSize - offset;
+		};
+		if (not fits(header.snakesOffset, header.snakeCount * sizeof(SnakeRecord)) ||
+			not fits(header.fieldOffset, cellCount) ||
+			not fits(header.trailsOffset, 0) ||
+			not fits(header.namesOffset, 0))
+		{
+			return none;
+		}
+
+		const size_t trailCapacity = (header.totalSize - header.trailsOffset) / sizeof(TrailPoint);
+		const size_t namesCapacity = header.totalSize - header.namesOffset;
+		const auto inField = [&](int16 x, int16 y) {
+			return 0 <= x && x < header.width && 0 <= y && y < header.height;
+		};
+		for (const size_t id : Iota(header.snakeCount))
+		{
+			const SnakeRecord& record = view.snake(id);
+			if (record.direction >= 8 ||
+				record.state > static_cast<uint8>(SnakeState::Dead) ||
+				record.trailOffset > trailCapacity || record.trailLength > trailCapacity - record.trailOffset ||
+				record.nameOffset > namesCapacity || record.nameLength > namesCapacity - record.nameOffset)
+			{
+				return none;
+			}
+
+			// 壁に衝突して死亡したスネークは頭と胴体の末尾がフィールドの外にある
+			const bool dead = (record.state == static_cast<uint8>(SnakeState::Dead));
+			if (not dead && not inField(record.x, record.y))
+			{
+				return none;
+			}
+
+			const auto trail = view.trail(id);
+			const size_t checkedLength = (dead && not trail.empty()) ? trail.size() - 1 : trail.size();
+			for (const TrailPoint& point : trail.first(checkedLength))
+			{
+				if (not inField(point.x, point.y))
+				{
+					return none;
+				}
+			}
+		}
+
+		for (const int8 cell : view.fieldPlane())
+		{
+			if (cell < static_cast<int8>(CellState::Unallocated) || cell > static_cast<int8>(CellState::Conflict))
+			{
+				return none;
+			}
+		}
+		return view;
+	}
+
+	std::span<const int8> GameView::fieldPlane() const
+	{
+		return { reinterpret_cast<const int8*>(m_data + m_header->fieldOffset), static_cast<size_t>(m_header->width) * m_header->height };
+	}
+
+	const SnakeRecord& GameView::snake(size_t id) const
+	{
+		return reinterpret_cast<const SnakeRecord*>(m_data + m_header->snakesOffset)[id];
+	}
+
+	std::span<const TrailPoint> GameView::trail(size_t id) const
+	{
+		const SnakeRecord& record = snake(id);
+		return { reinterpret_cast<const TrailPoint*>(m_data + m_header->trailsOffset) + record.trailOffset, record.trailLength };
+	}
+
+	std::string_view GameView::name(size_t id) const
+	{
+		const SnakeRecord& record = snake(id);
+		return { reinterpret_cast<const char*>(m_data + m_header->namesOffset + record.nameOffset), record.nameLength };
+	}
+
+	Game GameView::toGame() const
+	{
+		Grid<CellState> field(fieldSize(), CellState::Unallocated);
+		std::transform(fieldPlane().begin(), fieldPlane().end(), field.begin(), [](int8 cell) {
+			return static_cast<CellState>(cell);
+		});
+
+		Array<Snake> snakes;
+		for (const size_t id : Iota(snakeCount()))
+		{
+			const SnakeRecord& record = snake(id);
+			Array<Point> bodyPath;
+			bodyPath.reserve(record.trailLength);
+			for (const TrailPoint& point : trail(id))
+			{
+				bodyPath.emplace_back(point.x, point.y);
+			}
+
+			snakes.push_back(Snake{
+				.point = record.point,
+				.name = Unicode::FromUTF8(name(id)),
+				.position = Point{ record.x, record.y },
+				.direction = static_cast<Direction>(record.direction),
+				.state = static_cast<SnakeState>(record.state),
+				.bodyPath = std::move(bodyPath)
+				});
+		}
+
+		return Game(gameId(), step(), std::move(field), std::move(snakes), isGameOver());
+	}
+}
@@ -0,0 +1,171 @@
+﻿#pragma once
+#include <bit>
+#include <span>
+#include "SuperSnake.hpp"
+
+/// @brief Game の状態を1つの連続した領域に置く, 平坦でバージョン付きの形式
+/// @remark 数値はリトルエンディアンで, 各レコードは自然な境界に揃えて配置します
+/// メモリマップしたファイルや受信したバッファを GameView でそのまま読めるため, ヒープ上のオブジェクトに変換する必要がありません
+/// 配置: Header, SnakeRecord × snakeCount, TrailPoint × 胴体の合計, フィールド (int8 × width × height), 名前 (UTF-8)
+/// 各区画の先頭は Alignment の倍数で, 形式の先頭も Alignment の倍数のアドレスに置いてください
+namespace GameFormat
+{
+	static_assert(std::endian::native == std::endian::little, "GameFormat is read in place and requires a little-endian target");
+
+	// "SSGM"
+	constexpr uint32 Magic = 0x4D475353;
+
+	/// @brief 上位8ビット: 互換の無い変更で上げる, 下位8ビット: ヘッダーの末尾への項目の追加など, 古い読み取り側がそのまま読める変更で上げる
+	/// @remark 読み取り側は上位8ビットが同じであれば, 自分より新しいバージョンも読み取ります
+	constexpr uint16 Version = 0x0001;
+
+	/// @brief 互換性のあるバージョンか
+	constexpr bool IsCompatibleVersion(uint16 version)
+	{
+		return (version >> 8) == (Version >> 8);
+	}
+
+	constexpr size_t Alignment = 8;
+
+	struct Header
+	{
+		uint32 magic;
+
+		uint16 version;
+
+		/// @brief このヘッダーのバイト数 (後のバージョンで末尾に項目を追加した場合に読み飛ばす)
+		uint16 headerSize;
+
+		/// @brief 形式全体のバイト数
+		uint32 totalSize;
+
+		/// @brief ゲームID (局面の生成に使う乱数のシードを兼ねる)
+		int32 gameId;
+
+		int32 step;
+
+		uint16 width;
+
+		uint16 height;
+
+		uint8 snakeCount;
+
+		uint8 gameOver;
+
+		uint16 reserved;
+
+		/// @brief 各区画の先頭からのバイト数
+		uint32 snakesOffset;
+
+		uint32 trailsOffset;
+
+		uint32 fieldOffset;
+
+		uint32 namesOffset;
+	};
+
+	struct SnakeRecord
+	{
+		int32 point;
+
+		int16 x;
+
+		int16 y;
+
+		/// @brief Direction
+		uint8 direction;
+
+		/// @brief SnakeState
+		uint8 state;
+
+		/// @brief 名前のバイト数
+		uint16 nameLength;
+
+		/// @brief 名前の区画の先頭からのバイト数
+		uint32 nameOffset;
+
+		/// @brief 胴体の区画の先頭からの要素数
+		uint32 trailOffset;
+
+		/// @brief 胴体の長さ (尾 -> 頭)
+		uint32 trailLength;
+	};
+
+	struct TrailPoint
+	{
+		int16 x;
+
+		int16 y;
+	};
+
+	static_assert(sizeof(Header) == 44 && sizeof(SnakeRecord) == 24 && sizeof(TrailPoint) == 4);
+
+	/// @brief 書き出したときのバイト数
+	size_t EncodedSize(const SuperSnake::Game& game);
+
+	/// @brief bytes の末尾に書き出します
+	/// @remark 書き出す位置が Alignment の倍数になるよう, 先に bytes を0で埋めます
+	/// @return 書き出した位置
+	size_t Append(const SuperSnake::Game& game, Array<Byte>& bytes);
+
+	inline Array<Byte> Encode(const SuperSnake::Game& game)
+	{
+		Array<Byte> bytes;
+		Append(game, bytes);
+		return bytes;
+	}
+
+	/// @brief 書き出した Game をその場で読み取るビュー
+	/// @remark 元の領域を参照するため, 領域より長く使わないでください
+	class GameView
+	{
+	public:
+
+		/// @brief 範囲と値を検証してビューを作成します
+		/// @param data 先頭 (Alignment の倍数のアドレス)
+		/// @param size 読み取れるバイト数 (形式より長くても構いません)
+		/// @return 不正な場合, 互換性の無いバージョンの場合, 境界が揃っていない場合none
+		static Optional<GameView> Open(const void* data, size_t size);
+
+		const Header& header() const { return *m_header; }
+
+		/// @brief 形式全体のバイト数
+		size_t size() const { return m_header->totalSize; }
+
+		int32 gameId() const { return m_header->gameId; }
+
+		int32 step() const { return m_header->step; }
+
+		bool isGameOver() const { return m_header->gameOver != 0; }
+
+		Size fieldSize() const { return { m_header->width, m_header->height }; }
+
+		size_t snakeCount() const { return m_header->snakeCount; }
+
+		/// @brief 行優先のフィールド (CellState)
+		std::span<const int8> fieldPlane() const;
+
+		SuperSnake::CellState cell(Point pos) const
+		{
+			return static_cast<SuperSnake::CellState>(fieldPlane()[static_cast<size_t>(pos.y) * m_header->width + pos.x]);
+		}
+
+		const SnakeRecord& snake(size_t id) const;
+
+		std::span<const TrailPoint> trail(size_t id) const;
+
+		/// @brief 名前 (UTF-8)
+		std::string_view name(size_t id) const;
+
+		/// @brief Game に変換します
+		SuperSnake::Game toGame() const;
+
+	private:
+
+		const Byte* m_data = nullptr;
+
+		const Header* m_header = nullptr;
+
+		GameView() = default;
+	};
+}
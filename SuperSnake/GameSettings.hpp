@@ -10,18 +10,63 @@ struct GameSettings
 
 	bool hideConfirmedAction = false;
 
+	/// @brief 対戦を観戦者に配信する
+	bool hostSpectators = false;
+
+	/// @brief ソルバーのワーカー数 (0の場合は 論理コア数 - 1)
+	int32 solverWorkerCount = 0;
+
+	/// @brief スネーク1匹あたりの探索の制限時間 [ms] (0の場合は無制限)
+	int32 solverTimeLimitMs = 2000;
+
+	/// @brief ソルバーのワーカーを固定する論理プロセッサのマスク (0の場合は固定しない)
+	uint64 solverAffinityMask = 0;
+
+	/// @brief ソルバーのワーカーを固定するNUMAノード (負の場合は固定しない)
+	int32 solverNumaNode = -1;
+
 	size_t snakeCount() const
 	{
 		return selectedControllers.size();
 	}
+
+	Optional<Duration> solverTimeLimit() const
+	{
+		if (solverTimeLimitMs <= 0)
+		{
+			return none;
+		}
+		return Duration{ solverTimeLimitMs / 1000.0 };
+	}
 };
 
+// 1: ソルバーの計算資源の設定を追加
+// 2: 観戦の配信の設定を追加
+CEREAL_CLASS_VERSION(GameSettings, 2)
+
 template<class Archive>
-static void SIV3D_SERIALIZE(Archive& archive, GameSettings& settings)
+static void SIV3D_SERIALIZE(Archive& archive, GameSettings& settings, const std::uint32_t version)
 {
 	archive(
 		cereal::make_nvp("fieldSize", settings.fieldSize),
 		cereal::make_nvp("selectedControllers", settings.selectedControllers),
 		cereal::make_nvp("hideConfirmedAction", settings.hideConfirmedAction)
 	);
+
+	if (version >= 1)
+	{
+		archive(
+			cereal::make_nvp("solverWorkerCount", settings.solverWorkerCount),
+			cereal::make_nvp("solverTimeLimitMs", settings.solverTimeLimitMs),
+			cereal::make_nvp("solverAffinityMask", settings.solverAffinityMask),
+			cereal::make_nvp("solverNumaNode", settings.solverNumaNode)
+		);
+	}
+
+	if (version >= 2)
+	{
+		archive(
+			cereal::make_nvp("hostSpectators", settings.hostSpectators)
+		);
+	}
 }
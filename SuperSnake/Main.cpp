@@ -5,7 +5,7 @@
 #include "Config.hpp"
 #include "GameController.hpp"
 #include "SettingsWindow.hpp"
-#include "SolverRunner.hpp"
+#include "MatchSimulation.hpp"
 #include "KeyConfigWindow.hpp"
 
 static double GetAxisValue(const detail::Gamepad_impl& gamepad, uint8 id)
@@ -32,161 +32,99 @@ public:
 		m_settingsWindow.startCallback = [this] {
 			gameStart(m_settingsWindow.settings());
 		};
+		m_settingsWindow.watchCallback = [this](const String& host) {
+			m_simulation.watch(host);
+		};
 		m_settingsWindow.setVisible(true);
 	}
 
 	void update()
 	{
 		m_settingsWindow.renderWindow();
-		if (not m_game || m_game->isGameOver())
+
+		// Printは描画スレッドでのみ使える
+		for (const auto& message : m_simulation.takeMessages())
 		{
-			m_footerText = U"";
+			Print << message;
 		}
-		else
+
+		const MatchFrame& frame = m_simulation.latestFrame();
+		if (not frame.game() || frame.game()->isGameOver() || frame.watching)
 		{
-			if (std::all_of(
-				m_indexedControllerStates.cbegin(),
-				std::next(m_indexedControllerStates.cbegin(), m_game->snakes().size()),
-				[this, id = 0](const std::shared_ptr<ControllerState>& state) mutable {
-				return
-					m_game->snakes()[id++].state == SuperSnake::SnakeState::Dead ||
-					state->isConfirmed;
-			}))
+			return;
+		}
+
+		// 入力はこのフレームの時刻を付けて対戦のスレッドに渡す
+		const auto now = std::chrono::steady_clock::now();
+		Array<GameController> postedControllers;
+		for (const auto& controller : frame.controllers)
+		{
+			if ((controller.kind != GameController::Kind::Keyboard && controller.kind != GameController::Kind::Gamepad) ||
+				postedControllers.includes(controller))
 			{
-				if (m_nextStw.elapsed() > 1s)
-				{
-					m_next = true;
-				}
+				continue;
 			}
-			else
+			postedControllers.push_back(controller);
+
+			MatchSimulation::InputEvent input{ .timestamp = now, .controller = controller };
+
+			switch (controller.kind)
 			{
-				m_nextStw.restart();
+			case GameController::Kind::Keyboard:
+			{
+				input.prev = KeyLeft.down();
+				input.next = KeyRight.down();
+				input.select = KeyEnter.down();
+
+				if (KeyW.down()) input.pov = 0;
+				else if (KeyE.down()) input.pov = 1;
+				else if (KeyD.down()) input.pov = 2;
+				else if (KeyC.down()) input.pov = 3;
+				else if (KeyX.down()) input.pov = 4;
+				else if (KeyZ.down()) input.pov = 5;
+				else if (KeyA.down()) input.pov = 6;
+				else if (KeyQ.down()) input.pov = 7;
 			}
-
-			for (auto& state : m_controllerStates)
+			break;
+			case GameController::Kind::Gamepad:
 			{
-				bool next = false;
-				bool prev = false;
-				Optional<int> pov;
-				bool select = false;
-
-				switch (state->controller.kind)
-				{
-				case GameController::Kind::Keyboard:
+				if (auto& gamepad = Gamepad(controller.index))
 				{
-					prev = KeyLeft.down();
-					next = KeyRight.down();
-					select = KeyEnter.down();
-
-					if (KeyW.down()) pov = 0;
-					else if (KeyE.down()) pov = 1;
-					else if (KeyD.down()) pov = 2;
-					else if (KeyC.down()) pov = 3;
-					else if (KeyX.down()) pov = 4;
-					else if (KeyZ.down()) pov = 5;
-					else if (KeyA.down()) pov = 6;
-					else if (KeyQ.down()) pov = 7;
-				}
-				break;
-				case GameController::Kind::Gamepad:
-				{
-					if (auto& gamepad = Gamepad(state->controller.index))
-					{
-						auto config = GetKeyConfig(gamepad.getInfo());
-
-						prev = config.leftButtonId < gamepad.buttons.size() && gamepad.buttons[config.leftButtonId].down();
-						next = config.rightButtonId < gamepad.buttons.size() && gamepad.buttons[config.rightButtonId].down();
-						select = config.selectButtonId < gamepad.buttons.size() && gamepad.buttons[config.selectButtonId].down();
-
-						const Vec2 stick{ -GetAxisValue(gamepad, config.stickXaxisId), GetAxisValue(gamepad, config.stickYaxisId) };
-						if (stick.length() > config.stickDeadzone)
-						{
-							pov = static_cast<int>(stick.getAngle() * 8 / Math::TwoPi + 4.5) % 8;
-						}
-						else if (JoyCon::IsJoyCon(gamepad))
-						{
-							pov = JoyCon(gamepad).povD8();
-						}
-					}
-				}
-				break;
-				case GameController::Kind::Solver:
-				{
-					while (auto result = m_solverRunner.getResult(state->idList[state->targetIdx]))
-					{
-						const auto snakeId = result->snakeId;
-						if (result->gameId == m_game->gameId &&
-							result->step == m_game->step() &&
-							m_game->snakes()[snakeId].state == SuperSnake::SnakeState::Alive)
-						{
-							try
-							{
-								m_actions[snakeId] = result->future.get();
-								m_indexedControllerStates[snakeId]->isConfirmed = true;
-							}
-							catch (std::exception ex)
-							{
-								Print << U"[Error] {}\n"_fmt(m_game->snakes()[snakeId].name) << Unicode::FromUTF8(ex.what());
-							}
-							catch (Error ex)
-							{
-								Print << U"[Error] {}\n"_fmt(m_game->snakes()[snakeId].name) << ex;
-							}
-						}
-					}
-				}
-				}
+					auto config = GetKeyConfig(gamepad.getInfo());
 
-				state->targetIdx +=
-					next ? -1
-					: prev ? 1
-					: 0;
-				state->targetIdx = (state->idList.size() + state->targetIdx) % state->idList.size();
+					input.prev = config.leftButtonId < gamepad.buttons.size() && gamepad.buttons[config.leftButtonId].down();
+					input.next = config.rightButtonId < gamepad.buttons.size() && gamepad.buttons[config.rightButtonId].down();
+					input.select = config.selectButtonId < gamepad.buttons.size() && gamepad.buttons[config.selectButtonId].down();
 
-				const int snakeId = state->idList[state->targetIdx];
-				auto& snake = m_game->snakes()[snakeId];
-
-				if (not state->isConfirmed && pov)
-				{
-					auto direction = static_cast<SuperSnake::Direction>(*pov);
-					for (int i : Range(-1, 1))
+					const Vec2 stick{ -GetAxisValue(gamepad, config.stickXaxisId), GetAxisValue(gamepad, config.stickYaxisId) };
+					if (stick.length() > config.stickDeadzone)
 					{
-						auto action = static_cast<SuperSnake::SnakeAction>(i);
-						if (direction == SuperSnake::Util::DoAction(snake.direction, action))
-						{
-							m_actions[snakeId] = action;
-						}
+						input.pov = static_cast<int>(stick.getAngle() * 8 / Math::TwoPi + 4.5) % 8;
+					}
+					else if (JoyCon::IsJoyCon(gamepad))
+					{
+						input.pov = JoyCon(gamepad).povD8();
 					}
-				}
-
-				if (select &&
-					std::all_of(
-						state->idList.cbegin(),
-						state->idList.cend(),
-						[this](int id) {
-							return
-								m_game->snakes()[id].state == SuperSnake::SnakeState::Dead ||
-								m_actions[id] != SuperSnake::SnakeAction::Stay;
-						}))
-				{
-					state->isConfirmed = !state->isConfirmed;
 				}
 			}
-		}
+			break;
+			}
 
-		if (m_next)
-		{
-			nextStep();
-			m_next = false;
+			if (input.prev || input.next || input.pov || input.select)
+			{
+				m_simulation.post(input);
+			}
 		}
 	}
 
 	void draw(RectF rect)
 	{
+		const MatchFrame& frame = m_simulation.latestFrame();
+
 		const RectF baseRect = rect.stretched(-10);
 		const SizeF nextButtonSize = SimpleGUI::ButtonRegion(U"Next▶", {}).size;
 		const double headerHeight = nextButtonSize.y;
-		const double footerHeight = m_font(m_footerText).region().h;
+		const double footerHeight = m_font(frame.footerText).region().h;
 
 		const RectF headerRect{
 			baseRect.pos,
@@ -235,18 +173,29 @@ public:
 		//	rect.drawFrame(1, 0, Palette::Red);
 		//}
 
-		m_font(m_footerText).draw(Arg::bottomCenter = footerRect.bottomCenter(), Palette::Gray);
-		if (m_game)
+		m_font(frame.footerText).draw(Arg::bottomCenter = footerRect.bottomCenter(), Palette::Gray);
+		if (const auto* game = frame.game())
 		{
-			if (not m_game->isGameOver() &&
+			const size_t overlay = static_cast<size_t>(m_overlay);
+			if (SimpleGUI::Button(U"Analysis: {}"_fmt(AnalysisOverlayNames[overlay]), headerRect.tl()))
+			{
+				m_overlay = static_cast<AnalysisOverlay>((overlay + 1) % AnalysisOverlayNames.size());
+			}
+			if (not frame.watching &&
+				SimpleGUI::Button(U"Turbo: {}"_fmt(m_simulation.isTurbo() ? U"On" : U"Off"), headerRect.tl() + Vec2{ SimpleGUI::ButtonRegion(U"Analysis: Territory", {}).w + 8, 0 }))
+			{
+				m_simulation.setTurbo(not m_simulation.isTurbo());
+			}
+			if (not game->isGameOver() && not frame.watching &&
 				SimpleGUI::Button(U"Next▶", headerRect.tr() - Vec2{ nextButtonSize.x, 0 }))
 			{
-				m_next = true;
+				m_simulation.requestNext();
 			}
-			drawField(fieldRect);
-			for (const SuperSnake::SnakeID id : Iota(m_game->snakes().size()))
+			drawField(fieldRect, frame);
+			for (const SuperSnake::SnakeID id : Iota(game->snakes().size()))
 			{
-				drawPlayerState(playerStateRectList[id].stretched(-8 - 40, -8, -8, -8), id);
+				drawPlayerState(playerStateRectList[id].stretched(-8 - 40, -8, -8, -8), frame, id);
+				drawSolverStats(playerStateRectList[id].stretched(-8 - 40, -8, -8, -8), frame, id, rect.center().y);
 			}
 		}
 	}
@@ -257,19 +206,21 @@ private:
 
 	Texture m_confirmedIcon;
 
-	String m_stateText;
-
-	String m_footerText;
-
-	std::unique_ptr<SuperSnake::Game> m_game;
-
-	GameSettings m_settings;
-
 	SettingsWindow m_settingsWindow;
 
-	Stopwatch m_nextStw;
+	// 盤面に重ねて表示する解析結果
+	enum class AnalysisOverlay
+	{
+		None,
+		// 最初に到達するスネーク
+		Territory,
+		// つながっている領域
+		Region
+	};
+
+	static constexpr std::array<StringView, 3> AnalysisOverlayNames{ U"Off", U"Territory", U"Region" };
 
-	bool m_next = false;
+	AnalysisOverlay m_overlay = AnalysisOverlay::None;
 
 	std::map<GameController::Kind, Texture> m_controllerTextures{
 		{GameController::Kind::Network, Texture{ {Icon::Type::MaterialDesign, 0xF0317 }, 36 }},
@@ -278,37 +229,15 @@ private:
 		{GameController::Kind::Keyboard, Texture{ {Icon::Type::MaterialDesign, 0xF030C }, 36 }}
 	};
 
-	std::array<SuperSnake::SnakeAction, 4> m_actions = {
-		SuperSnake::SnakeAction::Stay,
-		SuperSnake::SnakeAction::Stay,
-		SuperSnake::SnakeAction::Stay,
-		SuperSnake::SnakeAction::Stay,
-	};
-
-	SolverRunner m_solverRunner;
-
-	struct ControllerState
-	{
-		GameController controller;
-
-		std::vector<int> idList;
-
-		int targetIdx;
-
-		bool isConfirmed;
-	};
-
-	std::vector<std::shared_ptr<ControllerState>> m_controllerStates;
-
-	std::array<std::shared_ptr<ControllerState>, 4> m_indexedControllerStates;
+	// 対戦の進行 (描画は公開された MatchFrame から行う)
+	MatchSimulation m_simulation;
 
-	void drawPlayerState(RectF rect, const SuperSnake::SnakeID id) const
+	void drawPlayerState(RectF rect, const MatchFrame& frame, const SuperSnake::SnakeID id) const
 	{
-		const auto& snake = m_game->snakes()[id];
-		const auto& action = m_actions[id];
+		const auto& snake = frame.game()->snakes()[id];
+		const auto& action = frame.actions[id];
 		const ColorF frameColor = SnakeColors[id].lerp(Palette::Black, 0.1);
-		const auto& controller = m_settings.selectedControllers[id];
-		const auto& controllerState = *m_indexedControllerStates[id];
+		const auto& controller = frame.controllers[id];
 
 		rect.rounded(PlayerStateBoxRound)
 			.draw(Palette::White)
@@ -316,13 +245,9 @@ private:
 		m_font(snake.name)
 			.draw(Arg::topCenter = rect.topCenter(), Palette::Black);
 
-		if (not controllerState.isConfirmed && snake.state == SuperSnake::SnakeState::Alive)
+		if (not frame.confirmed[id] && snake.state == SuperSnake::SnakeState::Alive && frame.targeted[id])
 		{
-			const auto selectedId = controllerState.idList[controllerState.targetIdx];
-			if (selectedId == id)
-			{
-				drawController(rect.tl() + Vec2{ 0, -8 }, controller);
-			}
+			drawController(rect.tl() + Vec2{ 0, -8 }, controller);
 		}
 
 		if (snake.state == SuperSnake::SnakeState::Dead)
@@ -340,7 +265,7 @@ private:
 			{
 				RectF(Arg::center = contentRect.center(), contentSize * 0.8, contentSize * 0.14).draw(Palette::Lightslategray);
 			}
-			else if (m_settings.hideConfirmedAction && controllerState.isConfirmed)
+			else if (frame.hideConfirmedAction && frame.confirmed[id])
 			{
 				m_confirmedIcon
 					.scaled(contentSize / Max(m_confirmedIcon.width(), m_confirmedIcon.height()))
@@ -370,9 +295,42 @@ private:
 		}
 	}
 
-	void drawField(RectF rect) const
+	// プレイヤー状態の上下に, ソルバーの統計情報を表示する
+	void drawSolverStats(RectF rect, const MatchFrame& frame, const SuperSnake::SnakeID id, double centerY) const
+	{
+		const auto& stats = frame.solverStats[id];
+		if (not stats)
+		{
+			return;
+		}
+
+		const bool isUpper = rect.center().y < centerY;
+		ImGui::SetNextWindowPos(
+			isUpper ? ImVec2(static_cast<float>(rect.x), static_cast<float>(rect.bottomY() + 4))
+			: ImVec2(static_cast<float>(rect.x), static_cast<float>(rect.y - 4)),
+			ImGuiCond_Always,
+			isUpper ? ImVec2(0.f, 0.f) : ImVec2(0.f, 1.f));
+		ImGui::SetNextWindowBgAlpha(0.8f);
+		ImGui::Begin(fmt::format("SolverStats##{}", id).data(), nullptr,
+			ImGuiWindowFlags_NoDecoration |
+			ImGuiWindowFlags_AlwaysAutoResize |
+			ImGuiWindowFlags_NoSavedSettings |
+			ImGuiWindowFlags_NoFocusOnAppearing |
+			ImGuiWindowFlags_NoNav);
+		{
+			ImGui::Text("time  : %.1f ms", stats->elapsed.count() * 1000);
+			ImGui::Text("nodes : %llu (%.0f nps)", stats->nodes, stats->nodesPerSecond());
+			ImGui::Text("depth : %d", stats->depth);
+			ImGui::Text("tt    : %llu / %llu (%.1f%%)", stats->ttHits, stats->ttProbes, stats->ttHitRate() * 100);
+			ImGui::Text("pv    : %s", Unicode::ToUTF8(stats->pvText()).data());
+		}
+		ImGui::End();
+	}
+
+	void drawField(RectF rect, const MatchFrame& frame) const
 	{
-		const Size fieldSize = m_game->field().size();
+		const SuperSnake::Game& game = *frame.game();
+		const Size fieldSize = game.field().size();
 		const double cellSize = Min(rect.w / (fieldSize.x + 2), rect.h / (fieldSize.y + 2));
 		const RectF renderRect{ Arg::center = rect.center(), cellSize * fieldSize };
 		const Mat3x2 renderMat(
@@ -386,7 +344,7 @@ private:
 		// Cell
 		for (Point pos : Iota2D(fieldSize))
 		{
-			const auto cell = m_game->field()[pos];
+			const auto cell = game.field()[pos];
 			RectF cellRect{
 				renderMat.transformPoint(pos),
 				cellSize, cellSize
@@ -407,6 +365,11 @@ private:
 				break;
 			}
 
+			if (const auto overlay = analysisColor(frame, pos))
+			{
+				color = color.lerp(*overlay, AnalysisOverlayStrength);
+			}
+
 			cellRect.draw(color);
 		}
 
@@ -428,7 +391,7 @@ private:
 		}
 
 		// Body
-		for (auto [snakeID, snake] : IndexedRef(m_game->snakes()))
+		for (auto [snakeID, snake] : IndexedRef(game.snakes()))
 		{
 			LineString lineStr(Arg::reserve = snake.bodyPath.size());
 			for (Point p : snake.bodyPath)
@@ -439,7 +402,7 @@ private:
 		}
 
 		// Head
-		for (auto [snakeID, snake] : IndexedRef(m_game->snakes()))
+		for (auto [snakeID, snake] : IndexedRef(game.snakes()))
 		{
 			ColorF color = snake.state == SuperSnake::SnakeState::Dead
 				? DeadSnakeColor
@@ -449,117 +412,78 @@ private:
 		}
 	}
 
-	void drawController(const Vec2 bottomLeft, const GameController& controller) const
+	// 解析結果のセルの色 (表示しない場合はnone)
+	Optional<ColorF> analysisColor(const MatchFrame& frame, Point pos) const
 	{
-		const Texture& tex = m_controllerTextures.at(controller.kind);
-		const double rectSize = Max({ tex.width(), tex.height(), m_font.height() }) * 1.1;
-		const String str = controller.kind == GameController::Kind::Gamepad
-			? Format(controller.index)
-			: U"";
-
-		RectF rect(Arg::bottomLeft = bottomLeft, rectSize + 4, rectSize);
-		if (not str.empty())
+		if (m_overlay == AnalysisOverlay::None)
 		{
-			rect.w += m_font(str).region().w + 4;
+			return none;
 		}
-		rect.rounded(rectSize / 4).draw(ColorF{ 0.4 });
-		tex.drawAt(rect.leftCenter() + Vec2{ rectSize / 2 + 2, 0 }, Palette::White);
-		m_font(str).draw(Arg::leftCenter = rect.leftCenter() + Vec2{ rectSize + 4, 0 }, Palette::White);
-	}
 
-	void gameStart(GameSettings settings)
-	{
-		m_settings = settings;
-		m_game = std::make_unique<SuperSnake::Game>(
-			m_settings.fieldSize,
-			m_settings.snakeCount(),
-			m_settings.selectedControllers.map([](const GameController c) -> Optional<String> {
-				switch (c.kind)
-				{
-				case GameController::Kind::Keyboard: return U"Keyboard";
-				case GameController::Kind::Gamepad: return Gamepad(c.index).getInfo().name;
-				case GameController::Kind::Solver: return Solvers[c.index].first;
-				default: return none;
-				}
-				}));
-
-		m_controllerStates.clear();
-		m_indexedControllerStates.fill(nullptr);
-		for (const auto [idx, controller] : Indexed(m_settings.selectedControllers))
+		// 局面と解析結果は同じスナップショットのため, 常に一致する
+		const StepSnapshot& analysis = *frame.snapshot;
+		const int32 idx = analysis.occupied().index(pos);
+		switch (m_overlay)
+		{
+		case AnalysisOverlay::Territory:
 		{
-			if (controller.kind == GameController::Kind::Keyboard ||
-				controller.kind == GameController::Kind::Gamepad)
+			const int32 owner = analysis.owners()[idx];
+			if (owner == StepSnapshot::Contested)
 			{
-				m_footerText = U"←/→ 操作対象選択, W/E/D/C/X/Z/A/Q 方向選択, [Enter] 確定\n[L]/[R] 操作対象選択, [Stick] 方向選択, [Select] 確定";
+				return ConflictCellColor;
 			}
-
-			if (controller.kind == GameController::Kind::Keyboard ||
-				controller.kind == GameController::Kind::Gamepad)
+			if (owner != StepSnapshot::NoOwner)
 			{
-				auto itr = std::find_if(
-					m_controllerStates.begin(),
-					m_controllerStates.end(),
-					[&](std::shared_ptr<ControllerState>& s) {
-						return s->controller == controller;
-				});
-				if (itr == m_controllerStates.end())
-				{
-					m_controllerStates.emplace_back(std::shared_ptr<ControllerState>(new ControllerState{
-						.controller = controller,
-						.idList = { int(idx) },
-						.targetIdx = 0,
-						}));
-					m_indexedControllerStates[idx] = m_controllerStates.back();
-				}
-				else
-				{
-					auto state = *itr;
-					state->idList.push_back(int(idx));
-					std::sort(state->idList.begin(), state->idList.end());
-					m_indexedControllerStates[idx] = state;
-				}
+				return SnakeColors[owner];
 			}
-			else
+		}
+		break;
+		case AnalysisOverlay::Region:
+		{
+			const int32 label = analysis.regionLabels()[idx];
+			if (label != StepSnapshot::NoRegion)
 			{
-				m_controllerStates.emplace_back(std::shared_ptr<ControllerState>(new ControllerState{
-					.controller = controller,
-					.idList = { int(idx) },
-					.targetIdx = 0,
-					}));
-				m_indexedControllerStates[idx] = m_controllerStates.back();
+				return HSV{ label * 137.5, 0.5, 0.9 }.toColorF();
 			}
 		}
-		beginStep();
+		break;
+		}
+
+		return none;
 	}
 
-	void nextStep()
+	void drawController(const Vec2 bottomLeft, const GameController& controller) const
 	{
-		m_game->doActions(Array<SuperSnake::SnakeAction>(
-			m_actions.cbegin(),
-			std::next(m_actions.cbegin(), m_game->snakes().size())
-			));
-		if (not m_game->isGameOver())
+		const Texture& tex = m_controllerTextures.at(controller.kind);
+		const double rectSize = Max({ tex.width(), tex.height(), m_font.height() }) * 1.1;
+		const String str = controller.kind == GameController::Kind::Gamepad
+			? Format(controller.index)
+			: U"";
+
+		RectF rect(Arg::bottomLeft = bottomLeft, rectSize + 4, rectSize);
+		if (not str.empty())
 		{
-			beginStep();
+			rect.w += m_font(str).region().w + 4;
 		}
+		rect.rounded(rectSize / 4).draw(ColorF{ 0.4 });
+		tex.drawAt(rect.leftCenter() + Vec2{ rectSize / 2 + 2, 0 }, Palette::White);
+		m_font(str).draw(Arg::leftCenter = rect.leftCenter() + Vec2{ rectSize + 4, 0 }, Palette::White);
 	}
 
-	void beginStep()
+	void gameStart(GameSettings settings)
 	{
-		for (auto& state : m_controllerStates)
-		{
-			state->isConfirmed = false;
-		}
-		m_nextStw.restart();
-		m_actions.fill(SuperSnake::SnakeAction::Stay);
-		for (auto [idx, controller] : Indexed(m_settings.selectedControllers))
-		{
-			if (controller.kind == GameController::Kind::Solver &&
-				m_game->snakes()[idx].state == SuperSnake::SnakeState::Alive)
+		// Gamepadの情報は描画スレッドでのみ取得できるため, 名前はここで決める
+		const auto names = settings.selectedControllers.map([](const GameController c) -> Optional<String> {
+			switch (c.kind)
 			{
-				m_solverRunner.solve(controller.index, *m_game, idx);
+			case GameController::Kind::Keyboard: return U"Keyboard";
+			case GameController::Kind::Gamepad: return Gamepad(c.index).getInfo().name;
+			case GameController::Kind::Solver: return Solvers[c.index].first;
+			case GameController::Kind::Network: return U"Network";
+			default: return none;
 			}
-		}
+			});
+		m_simulation.start(settings, names);
 	}
 
 	static void drawArrow(Vec2 center, double size, SuperSnake::Direction direction, ColorF color)
@@ -0,0 +1,383 @@
+﻿#include "MatchServer.hpp"
+#include "SolverV1.hpp"
+#include "SolverArena.hpp"
+
+using namespace SuperSnake;
+
+void MatchServer::LatencyStats::add(Duration latency)
+{
+	count++;
+	total += latency;
+	max = Max(max, latency);
+
+	const double units = latency.count() * 1e5;
+	const size_t idx = units <= 1 ? 0 : Min(static_cast<size_t>(std::log2(units) * 4), m_histogram.size() - 1);
+	m_histogram[idx]++;
+}
+
+void MatchServer::LatencyStats::merge(const LatencyStats& other)
+{
+	count += other.count;
+	total += other.total;
+	max = Max(max, other.max);
+	for (size_t i = 0; i < m_histogram.size(); i++)
+	{
+		m_histogram[i] += other.m_histogram[i];
+	}
+}
+
+Duration MatchServer::LatencyStats::percentile(double p) const
+{
+	const uint64 target = Max<uint64>(static_cast<uint64>(std::ceil(p * count)), 1);
+	uint64 cumulative = 0;
+	for (size_t i = 0; i < m_histogram.size(); i++)
+	{
+		cumulative += m_histogram[i];
+		if (cumulative >= target)
+		{
+			return Min(Duration{ 1e-5 * std::exp2((i + 1) / 4.0) }, max);
+		}
+	}
+	return max;
+}
+
+MatchServer::MatchServer(const Options& options)
+	: m_options(options)
+	, m_matches(Max(options.concurrentMatches, 1))
+	, m_pool(std::make_unique<ThreadPool>(ThreadPool::Options{ .workerCount = options.workerCount, .lowPriority = false }))
+{
+	assert(0 <= options.networkSeats && options.networkSeats <= options.snakeCount);
+	m_server.startAcceptMulti(options.port);
+}
+
+MatchServer::~MatchServer()
+{
+	m_pool.reset();
+}
+
+bool MatchServer::update()
+{
+	bool busy = false;
+
+	acceptSessions();
+	for (auto& [id, session] : m_sessions)
+	{
+		busy |= receive(id, session);
+	}
+
+	for (const auto& result : m_solverResults.popAll())
+	{
+		Match& match = m_matches[result.matchIndex];
+		if (match.game &&
+			match.game->gameId == result.gameId &&
+			match.game->step() == result.step)
+		{
+			match.actions[result.snakeId] = result.action;
+			busy = true;
+		}
+	}
+
+	busy |= checkDeadlines();
+	busy |= startMatches();
+
+	for (size_t i = 0; i < m_matches.size(); i++)
+	{
+		busy |= tryAdvance(i);
+	}
+
+	flush();
+	return busy;
+}
+
+void MatchServer::wait(Duration timeout)
+{
+	std::unique_lock lock(m_wakeMutex);
+	m_wakeCondition.wait_for(lock, timeout, [this] { return m_woken; });
+	m_woken = false;
+}
+
+bool MatchServer::isFinished() const
+{
+	return m_options.totalMatches > 0 && m_finishedMatches >= m_options.totalMatches;
+}
+
+Array<MatchServer::MatchResult> MatchServer::takeResults()
+{
+	return std::exchange(m_results, {});
+}
+
+int32 MatchServer::runningMatches() const
+{
+	return static_cast<int32>(std::count_if(m_matches.begin(), m_matches.end(), [](const Match& match) {
+		return match.game != nullptr;
+	}));
+}
+
+void MatchServer::acceptSessions()
+{
+	NetworkProtocol::SyncSessions(m_server, m_sessions, [this](TCPSessionID id, const Session& session) {
+		// 切断されたクライアントの席は以降直進させる
+		if (session.seat)
+		{
+			const auto [matchIndex, snakeId] = *session.seat;
+			m_matches[matchIndex].seats[snakeId].session.reset();
+		}
+		m_lobby.remove(id);
+	});
+}
+
+bool MatchServer::receive(TCPSessionID id, Session& session)
+{
+	bool received = false;
+	NetworkProtocol::Frame frame;
+	while (NetworkProtocol::ReadFrame(m_server, id, frame) == NetworkProtocol::ReadStatus::Complete)
+	{
+		const auto& payload = frame.payload;
+		received = true;
+
+		switch (frame.type)
+		{
+		case NetworkProtocol::MessageType::Hello:
+			if (not session.greeted && NetworkProtocol::DecodeHello(payload))
+			{
+				session.greeted = true;
+				m_lobby.push_back(id);
+			}
+			break;
+		case NetworkProtocol::MessageType::Action:
+			if (const auto message = NetworkProtocol::DecodeAction(payload); message && session.seat)
+			{
+				const auto [matchIndex, snakeId] = *session.seat;
+				Match& match = m_matches[matchIndex];
+				if (match.game &&
+					match.game->gameId == message->gameId &&
+					match.game->step() == message->step &&
+					not match.actions[snakeId])
+				{
+					match.actions[snakeId] = message->action;
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return received;
+}
+
+bool MatchServer::startMatches()
+{
+	bool started = false;
+	for (size_t i = 0; i < m_matches.size(); i++)
+	{
+		Match& match = m_matches[i];
+		if (match.game ||
+			(m_options.totalMatches > 0 && m_startedMatches >= m_options.totalMatches) ||
+			m_lobby.size() < static_cast<size_t>(m_options.networkSeats))
+		{
+			continue;
+		}
+
+		// 先頭の席から順にネットワークのクライアントを座らせる
+		Array<Optional<String>> names;
+		match.seats.clear();
+		for (const SnakeID id : Iota(m_options.snakeCount))
+		{
+			const bool network = id < m_options.networkSeats;
+			names.push_back(network ? U"Network" : U"SolverV1");
+			match.seats.push_back(Seat{ .network = network });
+		}
+		match.game = std::make_unique<Game>(m_options.fieldSize, m_options.snakeCount, names);
+		match.latency = LatencyStats{};
+
+		for (const SnakeID id : Iota(m_options.networkSeats))
+		{
+			const TCPSessionID sessionId = m_lobby.front();
+			m_lobby.pop_front();
+			m_sessions[sessionId].seat = std::pair{ i, id };
+			match.seats[id].session = sessionId;
+			send(sessionId, NetworkProtocol::MessageType::Assign, NetworkProtocol::EncodeAssign(id));
+		}
+
+		m_startedMatches++;
+		beginStep(i);
+		started = true;
+	}
+	return started;
+}
+
+void MatchServer::beginStep(size_t matchIndex)
+{
+	Match& match = m_matches[matchIndex];
+	const Game& game = *match.game;
+	match.actions.fill(none);
+	match.stopwatch.restart();
+
+	const auto deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_options.timeLimit);
+	const auto timeLimitMs = Max<uint32>(static_cast<uint32>(m_options.timeLimit.count() * 1000), 1);
+
+	// 同じ対戦のソルバーは局面のスナップショットを共有する
+	std::shared_ptr<const StepSnapshot> snapshot;
+	for (const auto [id, seat] : Indexed(match.seats))
+	{
+		const SnakeID snakeId = static_cast<SnakeID>(id);
+		if (game.snakes()[snakeId].state == SnakeState::Dead)
+		{
+			match.actions[snakeId] = SnakeAction::Stay;
+		}
+		else if (seat.network)
+		{
+			if (not seat.session)
+			{
+				match.actions[snakeId] = SnakeAction::MoveStraight;
+				continue;
+			}
+
+			Session& session = m_sessions[*seat.session];
+			send(*seat.session, NetworkProtocol::MessageType::Position,
+				NetworkProtocol::EncodePosition(game, session.lastSent ? &*session.lastSent : nullptr, timeLimitMs));
+			session.lastSent.emplace(game);
+		}
+		else
+		{
+			if (not snapshot)
+			{
+				snapshot = StepSnapshot::Create(game);
+			}
+
+			m_pool->submit([this, snapshot, matchIndex, snakeId, deadline] {
+				// ワーカー毎に使い回す
+				thread_local SolverV1 solver;
+				thread_local SolverArena arena;
+
+				SolverResult result{
+					.matchIndex = matchIndex,
+					.gameId = snapshot->game().gameId,
+					.step = snapshot->game().step(),
+					.snakeId = snakeId,
+					.action = SnakeAction::MoveStraight
+				};
+				try
+				{
+					arena.reset(snapshot->game().field().size());
+					const SolveContext context{ .deadline = deadline, .arena = &arena, .snapshot = snapshot.get() };
+					result.action = solver.solve(snapshot->game(), snakeId, context);
+				}
+				catch (...) { }
+				m_solverResults.push(result);
+
+				{
+					std::lock_guard lock(m_wakeMutex);
+					m_woken = true;
+				}
+				m_wakeCondition.notify_one();
+			}, deadline);
+		}
+	}
+}
+
+bool MatchServer::tryAdvance(size_t matchIndex)
+{
+	Match& match = m_matches[matchIndex];
+	if (not match.game)
+	{
+		return false;
+	}
+
+	const size_t snakeCount = match.game->snakes().size();
+	if (not std::all_of(match.actions.begin(), std::next(match.actions.begin(), snakeCount), [](const auto& action) {
+		return action.has_value();
+	}))
+	{
+		return false;
+	}
+
+	const Duration latency = match.stopwatch.elapsed();
+	match.latency.add(latency);
+	m_latency.add(latency);
+	m_totalSteps++;
+
+	Array<SnakeAction> actions;
+	for (size_t i = 0; i < snakeCount; i++)
+	{
+		actions.push_back(*match.actions[i]);
+	}
+	match.game->doActions(actions);
+
+	if (match.game->isGameOver())
+	{
+		finishMatch(matchIndex);
+	}
+	else
+	{
+		beginStep(matchIndex);
+	}
+	return true;
+}
+
+void MatchServer::finishMatch(size_t matchIndex)
+{
+	Match& match = m_matches[matchIndex];
+	m_results.push_back(MatchResult{
+		.gameId = match.game->gameId,
+		.steps = match.game->step(),
+		.points = match.game->snakes().map([](const Snake& snake) { return snake.point; }),
+		.latency = match.latency
+	});
+	m_finishedMatches++;
+
+	// クライアントは次の対戦を待つ
+	for (const auto& seat : match.seats)
+	{
+		if (seat.session)
+		{
+			m_sessions[*seat.session].seat.reset();
+			send(*seat.session, NetworkProtocol::MessageType::Assign, NetworkProtocol::EncodeAssign(none));
+			m_lobby.push_back(*seat.session);
+		}
+	}
+	match.seats.clear();
+	match.game.reset();
+}
+
+bool MatchServer::checkDeadlines()
+{
+	bool changed = false;
+	const Duration limit = m_options.timeLimit + m_options.deadlineGrace;
+	for (auto& match : m_matches)
+	{
+		if (not match.game)
+		{
+			continue;
+		}
+
+		const bool overdue = match.stopwatch.elapsed() > limit;
+		for (const auto [id, seat] : Indexed(match.seats))
+		{
+			if (seat.network && not match.actions[id] && (overdue || not seat.session))
+			{
+				match.actions[id] = SnakeAction::MoveStraight;
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+void MatchServer::send(TCPSessionID id, NetworkProtocol::MessageType type, const Array<Byte>& payload)
+{
+	m_sessions[id].outgoing.append(NetworkProtocol::EncodeFrame(type, payload));
+}
+
+void MatchServer::flush()
+{
+	for (auto& [id, session] : m_sessions)
+	{
+		if (not session.outgoing.isEmpty())
+		{
+			m_server.send(session.outgoing.data(), session.outgoing.size(), id);
+			session.outgoing.clear();
+		}
+	}
+}
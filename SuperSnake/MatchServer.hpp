@@ -0,0 +1,225 @@
+﻿#pragma once
+#include <condition_variable>
+#include "NetworkProtocol.hpp"
+#include "ThreadPool.hpp"
+#include "CompletionQueue.hpp"
+#include "StepSnapshot.hpp"
+
+/// @brief 多数の対戦を同時に進行させる, ウィンドウを持たないサーバー
+/// @remark ネットワークのクライアントは1つのポートで受け付け, 接続順に空いている席に割り当てます
+/// ソルバーのスネークは共有のスレッドプールで期限の早い順に探索し, 各対戦は全員の行動が揃い次第それぞれ次のステップに進みます
+/// update は1スレッドから繰り返し呼び出してください
+/// 1回の update でクライアントに送るメッセージは1回の送信にまとめます (NetworkProtocol::EncodeFrame を参照)
+class MatchServer
+{
+public:
+
+	struct Options
+	{
+		Size fieldSize{ 16, 16 };
+
+		int32 snakeCount = 2;
+
+		/// @brief 対戦毎のネットワークのクライアントの席数 (残りは SolverV1)
+		int32 networkSeats = 0;
+
+		/// @brief 同時に進行させる対戦数
+		int32 concurrentMatches = 1;
+
+		/// @brief 終了するまでの対戦数 (0の場合は無制限)
+		int32 totalMatches = 0;
+
+		/// @brief 1ステップの制限時間
+		Duration timeLimit{ 0.1 };
+
+		/// @brief ネットワークのクライアントの制限時間に加えて通信の遅れを待つ時間
+		Duration deadlineGrace{ 0.1 };
+
+		uint16 port = NetworkProtocol::DefaultPort;
+
+		/// @brief ソルバーのワーカー数 (0の場合は ThreadPool::DefaultWorkerCount)
+		size_t workerCount = 0;
+	};
+
+	/// @brief 遅延の統計
+	/// @remark 分位数は約19%刻みの対数ヒストグラムから求めた上限です
+	struct LatencyStats
+	{
+		uint64 count = 0;
+
+		Duration total{ 0 };
+
+		Duration max{ 0 };
+
+		void add(Duration latency);
+
+		void merge(const LatencyStats& other);
+
+		Duration mean() const { return count ? total / static_cast<double>(count) : Duration{ 0 }; }
+
+		/// @param p 0 ~ 1
+		Duration percentile(double p) const;
+
+	private:
+
+		// 10μs * 2^(i/4) 以上
+		std::array<uint64, 96> m_histogram{};
+	};
+
+	struct MatchResult
+	{
+		int32 gameId;
+
+		int32 steps;
+
+		Array<int32> points;
+
+		/// @brief 全員の行動が揃うまでの時間
+		LatencyStats latency;
+	};
+
+	explicit MatchServer(const Options& options);
+
+	MatchServer(const MatchServer&) = delete;
+
+	MatchServer& operator=(const MatchServer&) = delete;
+
+	/// @brief 探索中のタスクを待ってから終了します
+	~MatchServer();
+
+	/// @brief 受信, 探索結果の反映, ステップの進行を行います
+	/// @return 何か処理したか (falseの場合は wait で待ってください)
+	bool update();
+
+	/// @brief 探索が完了するか, timeout が経つまで待ちます
+	/// @remark ネットワークの受信では起きないため, timeout は受信を確認する間隔にしてください
+	void wait(Duration timeout);
+
+	/// @brief totalMatches の対戦が全て終了したか
+	bool isFinished() const;
+
+	/// @brief 終了した対戦の結果を終了順に全て取り出します
+	Array<MatchResult> takeResults();
+
+	/// @brief 全ての対戦の遅延の統計
+	const LatencyStats& latency() const { return m_latency; }
+
+	/// @brief 進行したステップの合計
+	uint64 totalSteps() const { return m_totalSteps; }
+
+	int32 finishedMatches() const { return m_finishedMatches; }
+
+	int32 runningMatches() const;
+
+	/// @brief 席が空くのを待っているクライアント数
+	size_t waitingClients() const { return m_lobby.size(); }
+
+private:
+
+	struct Seat
+	{
+		// ネットワークのクライアント (noneの場合はソルバー, 切断された場合は直進)
+		Optional<TCPSessionID> session;
+
+		bool network = false;
+	};
+
+	struct Match
+	{
+		std::unique_ptr<SuperSnake::Game> game;
+
+		Array<Seat> seats;
+
+		std::array<Optional<SuperSnake::SnakeAction>, 4> actions;
+
+		// ステップの開始から
+		Stopwatch stopwatch;
+
+		LatencyStats latency;
+	};
+
+	struct Session
+	{
+		bool greeted = false;
+
+		// 席 (対戦の番号, スネーク)
+		Optional<std::pair<size_t, SuperSnake::SnakeID>> seat;
+
+		// 前回送った局面 (差分の基)
+		Optional<SuperSnake::Game> lastSent;
+
+		// まだ送信していないメッセージ
+		Array<Byte> outgoing;
+	};
+
+	struct SolverResult
+	{
+		size_t matchIndex;
+
+		int32 gameId;
+
+		int32 step;
+
+		SuperSnake::SnakeID snakeId;
+
+		SuperSnake::SnakeAction action;
+	};
+
+	Options m_options;
+
+	TCPServer m_server;
+
+	std::map<TCPSessionID, Session> m_sessions;
+
+	// 席が空くのを待っているクライアント (接続順)
+	Array<TCPSessionID> m_lobby;
+
+	// 同時に進行させる対戦 (進行していない枠はgameがnullptr)
+	Array<Match> m_matches;
+
+	int32 m_startedMatches = 0;
+
+	int32 m_finishedMatches = 0;
+
+	uint64 m_totalSteps = 0;
+
+	LatencyStats m_latency;
+
+	Array<MatchResult> m_results;
+
+	CompletionQueue<SolverResult> m_solverResults;
+
+	// 探索の完了で wait を起こす
+	std::mutex m_wakeMutex;
+
+	std::condition_variable m_wakeCondition;
+
+	bool m_woken = false;
+
+	// 探索中のタスクが m_solverResults などを参照するため, 最後に宣言して最初に破棄する (ワーカーの終了を待つ)
+	std::unique_ptr<ThreadPool> m_pool;
+
+	void acceptSessions();
+
+	// 届いたメッセージを全て処理する
+	bool receive(TCPSessionID id, Session& session);
+
+	// 空いている枠で新しい対戦を始める
+	bool startMatches();
+
+	void beginStep(size_t matchIndex);
+
+	// 全員の行動が揃っていれば次のステップに進める
+	bool tryAdvance(size_t matchIndex);
+
+	void finishMatch(size_t matchIndex);
+
+	// 制限時間を過ぎたネットワークの席を直進させる
+	bool checkDeadlines();
+
+	// メッセージを送信待ちに加える (flushで送る)
+	void send(TCPSessionID id, NetworkProtocol::MessageType type, const Array<Byte>& payload);
+
+	// 送信待ちのメッセージをクライアント毎に1回で送る
+	void flush();
+};
@@ -0,0 +1,678 @@
+﻿#include "MatchSimulation.hpp"
+
+MatchSimulation::MatchSimulation()
+{
+	m_solverRunner.setCompletionCallback([this] { wake(); });
+	m_thread = std::jthread([this](std::stop_token stopToken) { run(stopToken); });
+}
+
+MatchSimulation::~MatchSimulation()
+{
+	m_thread.request_stop();
+	wake();
+}
+
+void MatchSimulation::start(const GameSettings& settings, const Array<Optional<String>>& names)
+{
+	m_commands.push(StartCommand{ settings, names });
+	wake();
+}
+
+void MatchSimulation::watch(const String& host)
+{
+	m_commands.push(WatchCommand{ host });
+	wake();
+}
+
+void MatchSimulation::post(const InputEvent& event)
+{
+	m_inputs.push(event);
+	wake();
+}
+
+void MatchSimulation::requestNext()
+{
+	m_commands.push(NextCommand{});
+	wake();
+}
+
+void MatchSimulation::setTurbo(bool turbo)
+{
+	m_turbo = turbo;
+	wake();
+}
+
+const MatchFrame& MatchSimulation::latestFrame()
+{
+	m_frames.update();
+	return m_frames.front();
+}
+
+void MatchSimulation::wake()
+{
+	{
+		std::lock_guard lock(m_wakeMutex);
+		m_woken = true;
+	}
+	m_wakeCondition.notify_one();
+}
+
+void MatchSimulation::run(std::stop_token stopToken)
+{
+	while (not stopToken.stop_requested())
+	{
+		step();
+
+		if (m_dirty)
+		{
+			publish();
+			m_dirty = false;
+		}
+
+		const auto timeout = wakeTimeout();
+		std::unique_lock lock(m_wakeMutex);
+		if (timeout)
+		{
+			m_wakeCondition.wait_for(lock, *timeout, [this] { return m_woken; });
+		}
+		else
+		{
+			m_wakeCondition.wait(lock, [this] { return m_woken; });
+		}
+		m_woken = false;
+	}
+}
+
+Optional<Duration> MatchSimulation::wakeTimeout() const
+{
+	// 観戦中は受信をポーリングする
+	if (m_spectatorClient)
+	{
+		return SimulationPollInterval;
+	}
+
+	// 対戦していなければ何も起きないため, 次のコマンドまで待つ (新しい観戦者は次の対戦から受け付ける)
+	if (not m_game || m_game->isGameOver())
+	{
+		return none;
+	}
+
+	// ネットワークのクライアントの行動は期限があるため頻繁に確認する
+	if (m_networkHost)
+	{
+		return SimulationPollInterval;
+	}
+
+	Optional<Duration> timeout;
+	if (m_spectatorHost)
+	{
+		timeout = SpectatorPollInterval;
+	}
+
+	// 全員が確定していれば, 1秒経ったら次のステップに進める
+	if (m_allConfirmed)
+	{
+		const Duration remaining = Max(Duration{ 1s } - m_nextStw.elapsed(), Duration{ 0 });
+		timeout = timeout ? Min(*timeout, remaining) : remaining;
+	}
+	return timeout;
+}
+
+void MatchSimulation::step()
+{
+	for (auto& command : m_commands.popAll())
+	{
+		std::visit([this](auto& c) { handle(c); }, command);
+		m_dirty = true;
+	}
+
+	if (m_spectatorHost)
+	{
+		m_spectatorHost->update(m_game.get());
+	}
+
+	if (m_spectatorClient)
+	{
+		// 観戦中は入力を使わない
+		m_inputs.popAll();
+		updateWatching();
+		return;
+	}
+
+	const auto inputs = m_inputs.popAll();
+
+	if (not m_game || m_game->isGameOver())
+	{
+		if (not m_footerText.empty())
+		{
+			m_footerText.clear();
+			m_dirty = true;
+		}
+		return;
+	}
+
+	// 完了した探索の結果を反映
+	applySolverResults();
+
+	// ネットワークのクライアントから届いた行動を反映
+	applyNetworkActions();
+
+	for (const auto& input : inputs)
+	{
+		// 前のステップの間に行われた操作は無視する
+		if (input.timestamp < m_stepStartedAt)
+		{
+			continue;
+		}
+		handleInput(input);
+	}
+
+	if (isAllConfirmed())
+	{
+		// 入力が無い間は起きないため, 全員が確定した時点から数える
+		if (not m_allConfirmed)
+		{
+			m_allConfirmed = true;
+			m_nextStw.restart();
+		}
+
+		// ターボモードでは待たずに進める
+		if (m_turbo || m_nextStw.elapsed() > 1s)
+		{
+			m_next = true;
+		}
+	}
+	else
+	{
+		m_allConfirmed = false;
+	}
+
+	// 人間が選択中の行動を変えたら, 先読みする候補を並べ直す
+	if (not m_pondered || m_actions != m_ponderedActions)
+	{
+		ponder();
+	}
+
+	if (m_next)
+	{
+		nextStep();
+		m_next = false;
+		m_dirty = true;
+	}
+}
+
+void MatchSimulation::handle(StartCommand& command)
+{
+	m_spectatorClient.reset();
+	m_settings = command.settings;
+	m_solverRunner.configure(ThreadPool::Options{
+		.workerCount = static_cast<size_t>(Max(m_settings.solverWorkerCount, 0)),
+		.affinityMask = m_settings.solverAffinityMask,
+		.numaNode = m_settings.solverNumaNode >= 0
+			? Optional<uint32>{ static_cast<uint32>(m_settings.solverNumaNode) }
+			: none
+	});
+	m_game = std::make_unique<SuperSnake::Game>(
+		m_settings.fieldSize,
+		m_settings.snakeCount(),
+		command.names);
+
+	m_footerText.clear();
+	m_controllerStates.clear();
+	m_indexedControllerStates.fill(nullptr);
+	m_solverStats.fill(none);
+	for (const auto [idx, controller] : Indexed(m_settings.selectedControllers))
+	{
+		if (controller.kind == GameController::Kind::Keyboard ||
+			controller.kind == GameController::Kind::Gamepad)
+		{
+			m_footerText = U"←/→ 操作対象選択, W/E/D/C/X/Z/A/Q 方向選択, [Enter] 確定\n[L]/[R] 操作対象選択, [Stick] 方向選択, [Select] 確定";
+
+			auto itr = std::find_if(
+				m_controllerStates.begin(),
+				m_controllerStates.end(),
+				[&](std::shared_ptr<ControllerState>& s) {
+					return s->controller == controller;
+			});
+			if (itr == m_controllerStates.end())
+			{
+				m_controllerStates.emplace_back(std::shared_ptr<ControllerState>(new ControllerState{
+					.controller = controller,
+					.idList = { int(idx) },
+					.targetIdx = 0,
+					}));
+				m_indexedControllerStates[idx] = m_controllerStates.back();
+			}
+			else
+			{
+				auto state = *itr;
+				state->idList.push_back(int(idx));
+				std::sort(state->idList.begin(), state->idList.end());
+				m_indexedControllerStates[idx] = state;
+			}
+		}
+		else
+		{
+			m_controllerStates.emplace_back(std::shared_ptr<ControllerState>(new ControllerState{
+				.controller = controller,
+				.idList = { int(idx) },
+				.targetIdx = 0,
+				}));
+			m_indexedControllerStates[idx] = m_controllerStates.back();
+		}
+	}
+
+	Array<SuperSnake::SnakeID> networkIds;
+	for (const auto [idx, controller] : Indexed(m_settings.selectedControllers))
+	{
+		if (controller.kind == GameController::Kind::Network)
+		{
+			networkIds.push_back(SuperSnake::SnakeID(idx));
+		}
+	}
+	if (networkIds.isEmpty())
+	{
+		m_networkHost.reset();
+	}
+	else
+	{
+		// 接続済みのクライアントは次の対戦でもそのまま使う
+		if (not m_networkHost)
+		{
+			m_networkHost = std::make_unique<NetworkHost>(NetworkPort, NetworkDeadlineGrace);
+		}
+		m_networkHost->setSnakes(networkIds);
+	}
+
+	if (not m_settings.hostSpectators)
+	{
+		m_spectatorHost.reset();
+	}
+	else
+	{
+		// 観戦中の観戦者には次の対戦もそのまま配信する
+		if (not m_spectatorHost)
+		{
+			m_spectatorHost = std::make_unique<SpectatorHost>(SpectatorPort);
+		}
+
+		if (m_spectatorHost->isListening())
+		{
+			m_spectatorHost->sendKeyframe(*m_game);
+		}
+		else
+		{
+			// 次の対戦の開始時に再度試す
+			m_spectatorHost.reset();
+			m_messages.push(U"[Error] 観戦用のポート {} で待ち受けできません"_fmt(SpectatorPort));
+		}
+	}
+	beginStep();
+}
+
+void MatchSimulation::handle(WatchCommand& command)
+{
+	m_spectatorHost.reset();
+	m_networkHost.reset();
+	m_game.reset();
+	m_controllerStates.clear();
+	m_indexedControllerStates.fill(nullptr);
+	m_spectatorClient = std::make_unique<SpectatorClient>(IPv4Address{ command.host }, SpectatorPort);
+}
+
+void MatchSimulation::handle(NextCommand&)
+{
+	if (m_game && not m_game->isGameOver() && not m_spectatorClient)
+	{
+		m_next = true;
+	}
+}
+
+void MatchSimulation::handleInput(const InputEvent& input)
+{
+	for (auto& state : m_controllerStates)
+	{
+		if (state->controller.kind != input.controller.kind ||
+			(input.controller.kind == GameController::Kind::Gamepad && state->controller.index != input.controller.index))
+		{
+			continue;
+		}
+
+		state->targetIdx +=
+			input.next ? -1
+			: input.prev ? 1
+			: 0;
+		state->targetIdx = (static_cast<int>(state->idList.size()) + state->targetIdx) % static_cast<int>(state->idList.size());
+
+		const int snakeId = state->idList[state->targetIdx];
+		auto& snake = m_game->snakes()[snakeId];
+
+		if (not state->isConfirmed && input.pov)
+		{
+			auto direction = static_cast<SuperSnake::Direction>(*input.pov);
+			for (int i : Range(-1, 1))
+			{
+				auto action = static_cast<SuperSnake::SnakeAction>(i);
+				if (direction == SuperSnake::Util::DoAction(snake.direction, action))
+				{
+					m_actions[snakeId] = action;
+				}
+			}
+		}
+
+		if (input.select &&
+			std::all_of(
+				state->idList.cbegin(),
+				state->idList.cend(),
+				[this](int id) {
+					return
+						m_game->snakes()[id].state == SuperSnake::SnakeState::Dead ||
+						m_actions[id] != SuperSnake::SnakeAction::Stay;
+				}))
+		{
+			state->isConfirmed = !state->isConfirmed;
+		}
+
+		m_dirty = true;
+	}
+}
+
+// 観戦中は受け取った局面を表示するだけで, 操作や探索は行わない
+void MatchSimulation::updateWatching()
+{
+	if (m_spectatorClient->update(m_game))
+	{
+		m_settings = GameSettings{};
+		m_settings.selectedControllers = Array<GameController>(m_game->snakes().size(), GameController::Unselected());
+		m_controllerStates.clear();
+		m_indexedControllerStates.fill(nullptr);
+		for (const SuperSnake::SnakeID id : Iota(m_game->snakes().size()))
+		{
+			m_controllerStates.emplace_back(std::shared_ptr<ControllerState>(new ControllerState{
+				.controller = GameController::Unselected(),
+				.idList = { id },
+				.targetIdx = 0,
+				.isConfirmed = true,
+				}));
+			m_indexedControllerStates[id] = m_controllerStates.back();
+		}
+		m_actions.fill(SuperSnake::SnakeAction::Stay);
+		m_solverStats.fill(none);
+		m_dirty = true;
+	}
+
+	String footerText;
+	if (m_spectatorClient->hasError())
+	{
+		footerText = U"観戦: ホストとの接続が切れました";
+	}
+	else if (not m_spectatorClient->isConnected())
+	{
+		footerText = U"観戦: 接続中...";
+	}
+	else
+	{
+		footerText = U"観戦中 (受信 {} bytes)"_fmt(m_spectatorClient->receivedBytes());
+	}
+	if (footerText != m_footerText)
+	{
+		m_footerText = footerText;
+		m_dirty = true;
+	}
+}
+
+void MatchSimulation::applySolverResults()
+{
+	for (const auto& result : m_solverRunner.takeResults())
+	{
+		const auto snakeId = result.snakeId;
+		if (result.gameId != m_game->gameId ||
+			result.step != m_game->step() ||
+			m_game->snakes()[snakeId].state != SuperSnake::SnakeState::Alive)
+		{
+			continue;
+		}
+
+		try
+		{
+			if (result.error)
+			{
+				std::rethrow_exception(result.error);
+			}
+			m_actions[snakeId] = result.action;
+			m_solverStats[snakeId] = result.stats;
+			m_indexedControllerStates[snakeId]->isConfirmed = true;
+			m_dirty = true;
+		}
+		catch (std::exception ex)
+		{
+			m_messages.push(U"[Error] {}\n{}"_fmt(m_game->snakes()[snakeId].name, Unicode::FromUTF8(ex.what())));
+		}
+		catch (Error ex)
+		{
+			m_messages.push(U"[Error] {}\n{}"_fmt(m_game->snakes()[snakeId].name, ex));
+		}
+	}
+}
+
+void MatchSimulation::applyNetworkActions()
+{
+	if (not m_networkHost)
+	{
+		return;
+	}
+
+	m_networkHost->update();
+	for (const auto& remote : m_networkHost->takeActions())
+	{
+		const auto snakeId = remote.snakeId;
+		if (remote.message.gameId != m_game->gameId ||
+			remote.message.step != m_game->step() ||
+			m_game->snakes()[snakeId].state != SuperSnake::SnakeState::Alive ||
+			m_indexedControllerStates[snakeId]->isConfirmed)
+		{
+			continue;
+		}
+
+		if (remote.timedOut)
+		{
+			m_messages.push(U"[Timeout] {}"_fmt(m_game->snakes()[snakeId].name));
+		}
+		m_actions[snakeId] = remote.message.action;
+		m_indexedControllerStates[snakeId]->isConfirmed = true;
+		m_dirty = true;
+	}
+}
+
+bool MatchSimulation::isAllConfirmed() const
+{
+	return std::all_of(
+		m_indexedControllerStates.cbegin(),
+		std::next(m_indexedControllerStates.cbegin(), m_game->snakes().size()),
+		[this, id = 0](const std::shared_ptr<ControllerState>& state) mutable {
+		return
+			m_game->snakes()[id++].state == SuperSnake::SnakeState::Dead ||
+			state->isConfirmed;
+	});
+}
+
+void MatchSimulation::nextStep()
+{
+	const Array<SuperSnake::SnakeAction> actions(
+		m_actions.cbegin(),
+		std::next(m_actions.cbegin(), m_game->snakes().size()));
+	const auto events = m_game->doActions(actions);
+	if (m_spectatorHost)
+	{
+		m_spectatorHost->sendStep(*m_game, actions, events);
+	}
+	if (not m_game->isGameOver())
+	{
+		beginStep();
+	}
+}
+
+void MatchSimulation::beginStep()
+{
+	for (auto& state : m_controllerStates)
+	{
+		state->isConfirmed = false;
+	}
+	m_pondered = false;
+	m_allConfirmed = false;
+	m_nextStw.restart();
+	m_stepStartedAt = std::chrono::steady_clock::now();
+	m_actions.fill(SuperSnake::SnakeAction::Stay);
+
+	// 同じソルバーが操作するスネークはまとめて探索させる
+	std::map<size_t, Array<SuperSnake::SnakeID>> solverGroups;
+	for (auto [idx, controller] : Indexed(m_settings.selectedControllers))
+	{
+		if (controller.kind == GameController::Kind::Solver &&
+			m_game->snakes()[idx].state == SuperSnake::SnakeState::Alive)
+		{
+			solverGroups[controller.index].push_back(idx);
+		}
+	}
+	const auto timeLimit = m_settings.solverTimeLimit();
+	for (const auto& [solverId, ids] : solverGroups)
+	{
+		m_solverRunner.solveJoint(solverId, *m_game, ids, timeLimit
+			? Optional<Duration>{ *timeLimit * static_cast<double>(ids.size()) }
+			: none);
+	}
+
+	if (m_networkHost)
+	{
+		m_networkHost->sendPosition(*m_game, timeLimit);
+	}
+}
+
+// 人間が行動を確定して次の局面が候補と一致すれば, ソルバーはすぐに行動を返せる
+void MatchSimulation::ponder()
+{
+	Array<SuperSnake::SnakeID> undecidedIds;
+	for (auto [idx, controller] : Indexed(m_settings.selectedControllers))
+	{
+		if (m_game->snakes()[idx].state == SuperSnake::SnakeState::Dead)
+		{
+			continue;
+		}
+
+		if (controller.kind == GameController::Kind::Solver)
+		{
+			if (not m_indexedControllerStates[idx]->isConfirmed)
+			{
+				// ソルバーの思考中
+				return;
+			}
+		}
+		else if (not m_indexedControllerStates[idx]->isConfirmed)
+		{
+			undecidedIds.push_back(SuperSnake::SnakeID(idx));
+		}
+	}
+
+	m_pondered = true;
+	m_ponderedActions = m_actions;
+
+	if (undecidedIds.isEmpty())
+	{
+		return;
+	}
+
+	// 各スネークの行動候補を, 選択中の行動 -> 直進 -> 左右 の順に並べる
+	Array<Array<SuperSnake::SnakeAction>> choices;
+	for (const auto id : undecidedIds)
+	{
+		Array<SuperSnake::SnakeAction> actions;
+		for (const auto action : {
+			m_actions[id],
+			SuperSnake::SnakeAction::MoveStraight,
+			SuperSnake::SnakeAction::MoveLeft,
+			SuperSnake::SnakeAction::MoveRight })
+		{
+			if (action != SuperSnake::SnakeAction::Stay && not actions.includes(action))
+			{
+				actions.push_back(action);
+			}
+		}
+		choices.push_back(actions);
+	}
+
+	// 候補の順位の和が小さい組み合わせほど可能性が高いとみなす
+	Array<std::pair<size_t, std::array<SuperSnake::SnakeAction, 4>>> jointActions;
+	size_t jointCount = 1;
+	for (size_t i = 0; i < undecidedIds.size(); i++)
+	{
+		jointCount *= 3;
+	}
+	for (size_t n : Iota(jointCount))
+	{
+		size_t rank = 0;
+		std::array<SuperSnake::SnakeAction, 4> actions = m_actions;
+		for (auto [i, id] : Indexed(undecidedIds))
+		{
+			actions[id] = choices[i][n % 3];
+			rank += n % 3;
+			n /= 3;
+		}
+		jointActions.emplace_back(rank, actions);
+	}
+	std::stable_sort(jointActions.begin(), jointActions.end(), [](const auto& a, const auto& b) {
+		return a.first < b.first;
+	});
+
+	Array<SuperSnake::Game> candidates;
+	for (const auto& [rank, actions] : jointActions.take(PonderCandidateCount))
+	{
+		SuperSnake::Game& candidate = candidates.emplace_back(*m_game);
+		candidate.doActions(Array<SuperSnake::SnakeAction>(
+			actions.cbegin(),
+			std::next(actions.cbegin(), m_game->snakes().size())
+			));
+	}
+	candidates.remove_if([](const SuperSnake::Game& g) { return g.isGameOver(); });
+
+	// 同じソルバーが操作するスネークはまとめて探索させる (beginStepと同じ)
+	std::map<size_t, Array<SuperSnake::SnakeID>> solverGroups;
+	for (auto [idx, controller] : Indexed(m_settings.selectedControllers))
+	{
+		if (controller.kind == GameController::Kind::Solver &&
+			m_game->snakes()[idx].state == SuperSnake::SnakeState::Alive)
+		{
+			solverGroups[controller.index].push_back(idx);
+		}
+	}
+	const auto timeLimit = m_settings.solverTimeLimit();
+	for (const auto& [solverId, ids] : solverGroups)
+	{
+		m_solverRunner.ponder(solverId, candidates, ids, timeLimit
+			? Optional<Duration>{ *timeLimit * static_cast<double>(ids.size()) }
+			: none);
+	}
+}
+
+void MatchSimulation::publish()
+{
+	// 前回公開したときの値が残っているため, 全ての項目を書き直す
+	MatchFrame& frame = m_frames.back();
+	frame.snapshot = m_game ? m_solverRunner.snapshot(*m_game) : nullptr;
+	frame.controllers = m_settings.selectedControllers;
+	frame.actions = m_actions;
+	frame.solverStats = m_solverStats;
+	frame.confirmed.fill(false);
+	frame.targeted.fill(false);
+	for (const auto& state : m_controllerStates)
+	{
+		for (const int id : state->idList)
+		{
+			frame.confirmed[id] = state->isConfirmed;
+		}
+		frame.targeted[state->idList[state->targetIdx]] = true;
+	}
+	frame.hideConfirmedAction = m_settings.hideConfirmedAction;
+	frame.watching = static_cast<bool>(m_spectatorClient);
+	frame.footerText = m_footerText;
+	m_frames.publish();
+}
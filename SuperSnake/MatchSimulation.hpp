@@ -0,0 +1,232 @@
+﻿#pragma once
+#include <condition_variable>
+#include "Config.hpp"
+#include "SolverRunner.hpp"
+#include "NetworkHost.hpp"
+#include "SpectatorHost.hpp"
+#include "SpectatorClient.hpp"
+#include "CompletionQueue.hpp"
+#include "TripleBuffer.hpp"
+
+/// @brief 描画スレッドに渡す, ある時点の対戦の状態
+struct MatchFrame
+{
+	/// @brief 局面と解析結果 (対戦が無い場合はnullptr)
+	std::shared_ptr<const StepSnapshot> snapshot;
+
+	Array<GameController> controllers;
+
+	std::array<SuperSnake::SnakeAction, 4> actions{};
+
+	std::array<bool, 4> confirmed{};
+
+	/// @brief 人間のコントローラーの操作対象として選択中
+	std::array<bool, 4> targeted{};
+
+	/// @brief 直前のターンのソルバーの統計情報
+	std::array<Optional<SolverStats>, 4> solverStats;
+
+	bool hideConfirmedAction = false;
+
+	/// @brief 観戦中
+	bool watching = false;
+
+	String footerText;
+
+	const SuperSnake::Game* game() const { return snapshot ? &snapshot->game() : nullptr; }
+};
+
+/// @brief 対戦の進行を専用のスレッドで行うシミュレーション
+/// @remark 描画スレッドは入力をタイムスタンプ付きのイベントとして渡し, 状態は TripleBuffer で公開された MatchFrame から読み取ります
+/// 描画が遅れても対戦は進み, 探索や通信を待っても描画は止まりません
+class MatchSimulation
+{
+public:
+
+	/// @brief 人間のコントローラーの1フレーム分の入力
+	struct InputEvent
+	{
+		std::chrono::steady_clock::time_point timestamp;
+
+		GameController controller;
+
+		/// @brief 操作対象を前のスネークへ
+		bool prev = false;
+
+		/// @brief 操作対象を次のスネークへ
+		bool next = false;
+
+		/// @brief 選択した方向 (0: 上, 時計回りに8方向)
+		Optional<int32> pov;
+
+		/// @brief 確定の切り替え
+		bool select = false;
+	};
+
+	MatchSimulation();
+
+	MatchSimulation(const MatchSimulation&) = delete;
+
+	MatchSimulation& operator=(const MatchSimulation&) = delete;
+
+	/// @brief シミュレーションのスレッドを止めてから破棄します
+	~MatchSimulation();
+
+	/// @brief 新しい対戦を始めます
+	/// @param names スネークの名前 (Gamepadの名前などは描画スレッドで取得してください)
+	void start(const GameSettings& settings, const Array<Optional<String>>& names);
+
+	/// @brief 対戦をやめて観戦を始めます
+	void watch(const String& host);
+
+	/// @brief 入力を渡します (行動を待っているステップが始まる前の入力は無視されます)
+	void post(const InputEvent& event);
+
+	/// @brief 次のステップに進めます (確定していないスネークは選択中の行動で進みます)
+	void requestNext();
+
+	/// @brief 全員が確定し次第, 待たずに次のステップに進めます
+	void setTurbo(bool turbo);
+
+	bool isTurbo() const { return m_turbo; }
+
+	/// @brief 公開された最新の状態に更新して返します (描画スレッド)
+	const MatchFrame& latestFrame();
+
+	/// @brief エラーなど, 画面に表示するメッセージを全て取り出します (描画スレッド)
+	Array<String> takeMessages() { return m_messages.popAll(); }
+
+private:
+
+	struct StartCommand
+	{
+		GameSettings settings;
+
+		Array<Optional<String>> names;
+	};
+
+	struct WatchCommand
+	{
+		String host;
+	};
+
+	struct NextCommand
+	{
+	};
+
+	using Command = std::variant<StartCommand, WatchCommand, NextCommand>;
+
+	struct ControllerState
+	{
+		GameController controller;
+
+		std::vector<int> idList;
+
+		int targetIdx;
+
+		bool isConfirmed;
+	};
+
+	// 描画スレッドから渡すもの
+	CompletionQueue<Command> m_commands;
+
+	CompletionQueue<InputEvent> m_inputs;
+
+	CompletionQueue<String> m_messages;
+
+	std::atomic<bool> m_turbo = false;
+
+	TripleBuffer<MatchFrame> m_frames;
+
+	// シミュレーションのスレッドを起こす
+	std::mutex m_wakeMutex;
+
+	std::condition_variable m_wakeCondition;
+
+	bool m_woken = false;
+
+	// 以下はシミュレーションのスレッドのみが参照する
+
+	std::unique_ptr<SuperSnake::Game> m_game;
+
+	GameSettings m_settings;
+
+	SolverRunner m_solverRunner;
+
+	// Networkのコントローラーが選択されている場合のみ
+	std::unique_ptr<NetworkHost> m_networkHost;
+
+	// 対戦を行っている場合のみ
+	std::unique_ptr<SpectatorHost> m_spectatorHost;
+
+	// 観戦している場合のみ
+	std::unique_ptr<SpectatorClient> m_spectatorClient;
+
+	std::array<SuperSnake::SnakeAction, 4> m_actions{};
+
+	// 直前のターンのソルバーの統計情報
+	std::array<Optional<SolverStats>, 4> m_solverStats;
+
+	std::vector<std::shared_ptr<ControllerState>> m_controllerStates;
+
+	std::array<std::shared_ptr<ControllerState>, 4> m_indexedControllerStates;
+
+	// ステップの開始時刻 (これより前の入力は無視する)
+	std::chrono::steady_clock::time_point m_stepStartedAt;
+
+	// 全員が確定してからの時間 (1秒経ったら次のステップに進める)
+	Stopwatch m_nextStw;
+
+	// 前回確認したときに全員が確定していた (確定した時点から m_nextStw を数える)
+	bool m_allConfirmed = false;
+
+	bool m_next = false;
+
+	bool m_pondered = false;
+
+	// 先読みの候補を並べたときの選択中の行動
+	std::array<SuperSnake::SnakeAction, 4> m_ponderedActions{};
+
+	String m_footerText;
+
+	// 公開していない変更がある
+	bool m_dirty = false;
+
+	// 最後に宣言して最初に破棄する (スレッドを止めてから, スレッドが参照する他のメンバーを破棄する)
+	std::jthread m_thread;
+
+	void wake();
+
+	void run(std::stop_token stopToken);
+
+	// 描画スレッドから渡されたコマンドと入力を処理し, 対戦を進める
+	void step();
+
+	// 次に起きるまでの時間 (noneの場合は入力, コマンド, 探索の完了まで待つ)
+	Optional<Duration> wakeTimeout() const;
+
+	void handle(StartCommand& command);
+
+	void handle(WatchCommand& command);
+
+	void handle(NextCommand& command);
+
+	void handleInput(const InputEvent& event);
+
+	void updateWatching();
+
+	void applySolverResults();
+
+	void applyNetworkActions();
+
+	bool isAllConfirmed() const;
+
+	void nextStep();
+
+	void beginStep();
+
+	// ソルバーの行動が揃った後, 人間の操作待ちの間に次の局面に対する探索を先に行わせる
+	void ponder();
+
+	void publish();
+};
@@ -0,0 +1,179 @@
+﻿#include "NNEvaluator.hpp"
+#include "NNEvaluatorAVX2.hpp"
+
+using namespace SuperSnake;
+
+// AVX2に対応していないCPUでは通常の計算を使う
+static const bool UseAVX2 = NNEvaluatorAVX2::IsSupported();
+
+NNEvaluator::NNEvaluator(FilePathView path)
+	: m_weights(Load(path))
+{ }
+
+void NNEvaluator::refresh(Accumulator& accumulator, const Array<uint32>& features) const
+{
+	accumulator.values = m_weights->b1;
+	for (const uint32 feature : features)
+	{
+		addFeature(accumulator, feature);
+	}
+}
+
+void NNEvaluator::addFeature(Accumulator& accumulator, uint32 feature) const
+{
+	const int16* weights = m_weights->w1.data() + feature * Hidden1;
+	if (UseAVX2)
+	{
+		NNEvaluatorAVX2::Add(accumulator.values.data(), weights, Hidden1);
+		return;
+	}
+
+	for (size_t i = 0; i < Hidden1; i++)
+	{
+		accumulator.values[i] += weights[i];
+	}
+}
+
+void NNEvaluator::removeFeature(Accumulator& accumulator, uint32 feature) const
+{
+	const int16* weights = m_weights->w1.data() + feature * Hidden1;
+	if (UseAVX2)
+	{
+		NNEvaluatorAVX2::Subtract(accumulator.values.data(), weights, Hidden1);
+		return;
+	}
+
+	for (size_t i = 0; i < Hidden1; i++)
+	{
+		accumulator.values[i] -= weights[i];
+	}
+}
+
+double NNEvaluator::evaluate(const Accumulator& accumulator) const
+{
+	const Weights& w = *m_weights;
+
+	// 第1層: ClippedReLU [0, 127]
+	alignas(32) std::array<uint8, Hidden1> h1;
+	if (UseAVX2)
+	{
+		NNEvaluatorAVX2::ClippedReLU(accumulator.values.data(), h1.data(), Hidden1);
+	}
+	else
+	{
+		for (size_t i = 0; i < Hidden1; i++)
+		{
+			h1[i] = static_cast<uint8>(Clamp<int32>(accumulator.values[i], 0, 127));
+		}
+	}
+
+	// 第2層: int8内積 -> ClippedReLU [0, 127]
+	std::array<int32, Hidden2> h2;
+	for (size_t j = 0; j < Hidden2; j++)
+	{
+		const int8* row = w.w2.data() + j * Hidden1;
+		int32 dot = 0;
+		if (UseAVX2)
+		{
+			dot = NNEvaluatorAVX2::Dot(h1.data(), row, Hidden1);
+		}
+		else
+		{
+			for (size_t i = 0; i < Hidden1; i++)
+			{
+				dot += static_cast<int32>(h1[i]) * row[i];
+			}
+		}
+		h2[j] = Clamp((dot + w.b2[j]) >> 6, 0, 127);
+	}
+
+	// 出力層
+	int32 output = w.b3;
+	for (size_t j = 0; j < Hidden2; j++)
+	{
+		output += h2[j] * w.w3[j];
+	}
+
+	return output / (127.0 * 64.0) * w.header.outputScale;
+}
+
+Array<uint32> NNEvaluator::ActiveFeatures(const Game& game, SnakeID id)
+{
+	const auto& field = game.field();
+	const int32 cellCount = field.width() * field.height();
+	const auto toIndex = [&](Point pos) { return pos.y * field.width() + pos.x; };
+
+	Array<uint32> features;
+	for (const Point pos : Iota2D(field.size()))
+	{
+		if (field[pos] != CellState::Unallocated)
+		{
+			features.push_back(OccupiedFeature(toIndex(pos)));
+		}
+	}
+
+	for (const auto [snakeId, snake] : Indexed(game.snakes()))
+	{
+		if (snake.state == SnakeState::Dead)
+		{
+			continue;
+		}
+
+		if (SnakeID(snakeId) == id)
+		{
+			features.push_back(OwnHeadFeature(toIndex(snake.position), snake.direction, cellCount));
+		}
+		else
+		{
+			features.push_back(OtherHeadFeature(toIndex(snake.position), cellCount));
+		}
+	}
+
+	return features;
+}
+
+std::shared_ptr<const NNEvaluator::Weights> NNEvaluator::Load(FilePathView path)
+{
+	static std::mutex mutex;
+	static std::map<FilePath, std::weak_ptr<const Weights>> cache;
+
+	std::lock_guard lock(mutex);
+	if (auto weights = cache[FilePath(path)].lock())
+	{
+		return weights;
+	}
+
+	BinaryReader reader{ path };
+	if (not reader)
+	{
+		return nullptr;
+	}
+
+	auto weights = std::make_shared<Weights>();
+	Header& header = weights->header;
+	if (not reader.read(header) ||
+		header.magic != Magic ||
+		header.version != Version ||
+		header.hidden1 != Hidden1 ||
+		header.hidden2 != Hidden2 ||
+		header.width < 2 ||
+		header.height < 2)
+	{
+		return nullptr;
+	}
+
+	weights->w1.resize(FeatureCount(header.width * header.height) * Hidden1);
+	const int64 w1Size = static_cast<int64>(weights->w1.size() * sizeof(int16));
+	if (reader.read(weights->w1.data(), w1Size) != w1Size ||
+		not reader.read(weights->b1) ||
+		not reader.read(weights->w2) ||
+		not reader.read(weights->b2) ||
+		not reader.read(weights->w3) ||
+		not reader.read(weights->b3))
+	{
+		return nullptr;
+	}
+
+	cache[FilePath(path)] = weights;
+	return weights;
+}
@@ -0,0 +1,116 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+
+/// @brief 自己対戦の棋譜から学習した評価関数 (特徴量 -> 64 -> 32 -> 1 の量子化MLP)
+/// @remark 第1層の出力(Accumulator)は着手/戻しに合わせて差分更新します
+class NNEvaluator
+{
+public:
+
+	static constexpr size_t Hidden1 = 64;
+
+	static constexpr size_t Hidden2 = 32;
+
+	struct Header
+	{
+		uint32 magic;
+
+		uint32 version;
+
+		int32 width;
+
+		int32 height;
+
+		uint32 hidden1;
+
+		uint32 hidden2;
+
+		/// @brief 出力1.0あたりのマス数
+		float outputScale;
+
+		uint32 reserved;
+	};
+
+	// "SSNN"
+	static constexpr uint32 Magic = 0x4E4E5353;
+
+	static constexpr uint32 Version = 1;
+
+	struct Weights
+	{
+		Header header;
+
+		// [特徴量][Hidden1], 127倍
+		Array<int16> w1;
+
+		std::array<int16, Hidden1> b1;
+
+		// [Hidden2][Hidden1], 64倍
+		std::array<int8, Hidden2 * Hidden1> w2;
+
+		// 127 * 64倍
+		std::array<int32, Hidden2> b2;
+
+		// 64倍
+		std::array<int8, Hidden2> w3;
+
+		// 127 * 64倍
+		int32 b3;
+	};
+
+	/// @brief 第1層の出力
+	struct alignas(32) Accumulator
+	{
+		std::array<int16, Hidden1> values;
+	};
+
+	NNEvaluator() = default;
+
+	/// @brief 重みファイルを読み込みます
+	explicit NNEvaluator(FilePathView path);
+
+	/// @brief フィールドサイズに対応する重みが読み込まれているか
+	bool isAvailable(Size fieldSize) const
+	{
+		return m_weights && m_weights->header.width == fieldSize.x && m_weights->header.height == fieldSize.y;
+	}
+
+	/// @brief 特徴量から第1層を計算し直します
+	void refresh(Accumulator& accumulator, const Array<uint32>& features) const;
+
+	/// @brief 特徴量を追加します
+	void addFeature(Accumulator& accumulator, uint32 feature) const;
+
+	/// @brief 特徴量を取り除きます
+	void removeFeature(Accumulator& accumulator, uint32 feature) const;
+
+	/// @brief 評価値を計算します
+	/// @return 視点のスネークがこれから相手より多く獲得できるマス数の予測
+	double evaluate(const Accumulator& accumulator) const;
+
+	/// @brief 特徴量の数
+	static size_t FeatureCount(int32 cellCount) { return static_cast<size_t>(cellCount) * 10; }
+
+	/// @brief 確保済みのマス
+	static uint32 OccupiedFeature(int32 cell) { return cell; }
+
+	/// @brief 視点のスネークの頭の位置と向き
+	static uint32 OwnHeadFeature(int32 cell, SuperSnake::Direction direction, int32 cellCount)
+	{
+		return cellCount + cell * 8 + static_cast<int32>(direction);
+	}
+
+	/// @brief 他のスネークの頭の位置
+	static uint32 OtherHeadFeature(int32 cell, int32 cellCount) { return cellCount * 9 + cell; }
+
+	/// @brief 局面の有効な特徴量を列挙します
+	static Array<uint32> ActiveFeatures(const SuperSnake::Game& game, SuperSnake::SnakeID id);
+
+	/// @brief 重みファイルを読み込みます (同じファイルは共有されます)
+	/// @return 読み込みに失敗した場合nullptr
+	static std::shared_ptr<const Weights> Load(FilePathView path);
+
+private:
+
+	std::shared_ptr<const Weights> m_weights;
+};
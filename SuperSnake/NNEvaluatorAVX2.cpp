@@ -0,0 +1,101 @@
+﻿#include "NNEvaluatorAVX2.hpp"
+#include <immintrin.h>
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+// MSVCは /arch:AVX2 を指定した翻訳単位でのみ使うため不要, GCC, Clangは関数毎に有効にする
+#if defined(_MSC_VER)
+# define NN_AVX2_TARGET
+#else
+# define NN_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	NN_AVX2_TARGET int32_t HorizontalSum(__m256i v)
+	{
+		__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtsi128_si32(sum);
+	}
+}
+
+namespace NNEvaluatorAVX2
+{
+	bool IsSupported()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		// AVX, OSXSAVE と, OSがYMMレジスタを保存するか
+		__cpuid(info, 1);
+		constexpr int AVX = 1 << 28;
+		constexpr int OSXSAVE = 1 << 27;
+		if ((info[2] & (AVX | OSXSAVE)) != (AVX | OSXSAVE) || (_xgetbv(0) & 0b110) != 0b110)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		constexpr int AVX2 = 1 << 5;
+		return (info[1] & AVX2) != 0;
+#elif defined(__GNUC__)
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	}
+
+	NN_AVX2_TARGET void Add(int16_t* accumulator, const int16_t* weights, size_t count)
+	{
+		for (size_t i = 0; i < count; i += 16)
+		{
+			auto* acc = reinterpret_cast<__m256i*>(accumulator + i);
+			const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+			_mm256_store_si256(acc, _mm256_add_epi16(_mm256_load_si256(acc), w));
+		}
+	}
+
+	NN_AVX2_TARGET void Subtract(int16_t* accumulator, const int16_t* weights, size_t count)
+	{
+		for (size_t i = 0; i < count; i += 16)
+		{
+			auto* acc = reinterpret_cast<__m256i*>(accumulator + i);
+			const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+			_mm256_store_si256(acc, _mm256_sub_epi16(_mm256_load_si256(acc), w));
+		}
+	}
+
+	NN_AVX2_TARGET void ClippedReLU(const int16_t* input, uint8_t* output, size_t count)
+	{
+		for (size_t i = 0; i < count; i += 32)
+		{
+			const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(input + i));
+			const __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(input + i + 16));
+			// packusはレーン毎に交互に並ぶため並び替える
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0b11011000);
+			packed = _mm256_min_epu8(packed, _mm256_set1_epi8(127));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(output + i), packed);
+		}
+	}
+
+	NN_AVX2_TARGET int32_t Dot(const uint8_t* x, const int8_t* y, size_t count)
+	{
+		const __m256i ones = _mm256_set1_epi16(1);
+		__m256i sum = _mm256_setzero_si256();
+		for (size_t i = 0; i < count; i += 32)
+		{
+			const __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(x + i));
+			const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y + i));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), ones));
+		}
+		return HorizontalSum(sum);
+	}
+}
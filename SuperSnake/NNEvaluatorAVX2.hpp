@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/// @brief NNEvaluator のAVX2版の計算
+/// @remark このファイルの関数を定義する NNEvaluatorAVX2.cpp のみをAVX2を有効にしてコンパイルします
+/// インライン関数が他の翻訳単位と共有されるとAVX2の命令が混ざるため, Siv3Dのヘッダーをインクルードしないでください
+/// 呼び出す前に CPUがAVX2に対応していることを NNEvaluatorAVX2::IsSupported で確認してください
+namespace NNEvaluatorAVX2
+{
+	/// @brief CPUとOSがAVX2に対応しているか
+	bool IsSupported();
+
+	/// @brief accumulator[i] += weights[i] (count は16の倍数, accumulator は32バイト境界)
+	void Add(int16_t* accumulator, const int16_t* weights, size_t count);
+
+	/// @brief accumulator[i] -= weights[i] (count は16の倍数, accumulator は32バイト境界)
+	void Subtract(int16_t* accumulator, const int16_t* weights, size_t count);
+
+	/// @brief output[i] = clamp(input[i], 0, 127) (count は32の倍数, input, output は32バイト境界)
+	void ClippedReLU(const int16_t* input, uint8_t* output, size_t count);
+
+	/// @brief Σ x[i] * y[i] (count は32の倍数, x は32バイト境界)
+	int32_t Dot(const uint8_t* x, const int8_t* y, size_t count);
+}
@@ -0,0 +1,152 @@
+﻿#include "NetworkHost.hpp"
+
+using namespace SuperSnake;
+
+NetworkHost::NetworkHost(uint16 port, Duration deadlineGrace)
+	: m_port(port)
+	, m_deadlineGrace(deadlineGrace)
+{
+	m_server.startAcceptMulti(port);
+}
+
+void NetworkHost::update()
+{
+	NetworkProtocol::SyncSessions(m_server, m_sessions);
+
+	for (auto& [id, session] : m_sessions)
+	{
+		receive(id, session);
+		checkDeadline(session);
+	}
+
+	assignSnakes();
+	flush();
+}
+
+void NetworkHost::setSnakes(const Array<SnakeID>& ids)
+{
+	m_ids = ids;
+	m_game.reset();
+	assignSnakes();
+	flush();
+}
+
+void NetworkHost::sendPosition(const Game& game, Optional<Duration> timeLimit)
+{
+	m_game.emplace(game);
+	m_timeLimit = timeLimit;
+	for (auto& [id, session] : m_sessions)
+	{
+		sendPosition(session);
+	}
+	flush();
+}
+
+Array<NetworkHost::RemoteAction> NetworkHost::takeActions()
+{
+	return std::exchange(m_actions, {});
+}
+
+void NetworkHost::assignSnakes()
+{
+	size_t next = 0;
+	for (auto& [id, session] : m_sessions)
+	{
+		if (not session.greeted)
+		{
+			continue;
+		}
+
+		const Optional<SnakeID> snakeId = next < m_ids.size() ? Optional<SnakeID>{ m_ids[next++] } : none;
+		if (session.snakeId != snakeId)
+		{
+			session.snakeId = snakeId;
+			session.waiting.reset();
+			send(session, NetworkProtocol::MessageType::Assign, NetworkProtocol::EncodeAssign(snakeId));
+			sendPosition(session);
+		}
+	}
+}
+
+void NetworkHost::send(Session& session, NetworkProtocol::MessageType type, const Array<Byte>& payload)
+{
+	session.outgoing.append(NetworkProtocol::EncodeFrame(type, payload));
+}
+
+void NetworkHost::flush()
+{
+	for (auto& [id, session] : m_sessions)
+	{
+		if (not session.outgoing.isEmpty())
+		{
+			m_server.send(session.outgoing.data(), session.outgoing.size(), id);
+			session.outgoing.clear();
+		}
+	}
+}
+
+void NetworkHost::sendPosition(Session& session)
+{
+	if (not m_game || not session.snakeId ||
+		m_game->snakes()[*session.snakeId].state != SnakeState::Alive)
+	{
+		return;
+	}
+
+	const uint32 timeLimitMs = m_timeLimit
+		? Max<uint32>(static_cast<uint32>(m_timeLimit->count() * 1000), 1)
+		: 0;
+	send(session, NetworkProtocol::MessageType::Position,
+		NetworkProtocol::EncodePosition(*m_game, session.lastSent ? &*session.lastSent : nullptr, timeLimitMs));
+	session.lastSent.emplace(*m_game);
+	session.waiting.emplace(StartImmediately::Yes);
+}
+
+void NetworkHost::receive(TCPSessionID id, Session& session)
+{
+	NetworkProtocol::Frame frame;
+	while (NetworkProtocol::ReadFrame(m_server, id, frame) == NetworkProtocol::ReadStatus::Complete)
+	{
+		const auto& payload = frame.payload;
+		switch (frame.type)
+		{
+		case NetworkProtocol::MessageType::Hello:
+			if (NetworkProtocol::DecodeHello(payload))
+			{
+				session.greeted = true;
+			}
+			break;
+		case NetworkProtocol::MessageType::Action:
+			if (const auto message = NetworkProtocol::DecodeAction(payload);
+				message && session.snakeId && session.waiting &&
+				session.lastSent && session.lastSent->gameId == message->gameId && session.lastSent->step() == message->step)
+			{
+				session.waiting.reset();
+				m_actions.push_back(RemoteAction{ .snakeId = *session.snakeId, .message = *message });
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void NetworkHost::checkDeadline(Session& session)
+{
+	if (not session.waiting || not session.snakeId || not session.lastSent || not m_timeLimit ||
+		session.waiting->elapsed() <= *m_timeLimit + m_deadlineGrace)
+	{
+		return;
+	}
+
+	session.waiting.reset();
+	m_actions.push_back(RemoteAction{
+		.snakeId = *session.snakeId,
+		.message = {
+			.gameId = session.lastSent->gameId,
+			.step = session.lastSent->step(),
+			.action = SnakeAction::MoveStraight
+		},
+		.timedOut = true
+	});
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include "NetworkProtocol.hpp"
+
+/// @brief ネットワーク越しにスネークを操作させるホスト (GameController::Kind::Network)
+/// @remark 接続したクライアントに, 接続順に操作させるスネークを割り当てます
+/// 1回の呼び出しでクライアントに送るメッセージは1回の送信にまとめます (NetworkProtocol::EncodeFrame を参照)
+class NetworkHost
+{
+public:
+
+	struct RemoteAction
+	{
+		SuperSnake::SnakeID snakeId;
+
+		NetworkProtocol::ActionMessage message;
+
+		/// @brief 期限までに届かなかったため直進とした
+		bool timedOut = false;
+	};
+
+	/// @param port 待ち受けるポート
+	/// @param deadlineGrace 制限時間に加えて通信の遅れを待つ時間
+	NetworkHost(uint16 port, Duration deadlineGrace);
+
+	/// @brief 接続の受け付けと受信を行います (毎フレーム呼び出してください)
+	void update();
+
+	/// @brief ネットワークで操作するスネークを設定します
+	void setSnakes(const Array<SuperSnake::SnakeID>& ids);
+
+	/// @brief 新しいステップの局面を, 生存しているスネークのクライアントに送ります
+	/// @param timeLimit 行動を返すまでの制限時間 (過ぎた場合は直進として扱います)
+	void sendPosition(const SuperSnake::Game& game, Optional<Duration> timeLimit);
+
+	/// @brief 受信した行動を受信順に全て取り出します
+	/// @remark 古い局面に対する行動も含まれるため, gameId, stepを確認してください
+	Array<RemoteAction> takeActions();
+
+	uint16 port() const { return m_port; }
+
+private:
+
+	struct Session
+	{
+		// Helloを受け取った
+		bool greeted = false;
+
+		Optional<SuperSnake::SnakeID> snakeId;
+
+		// 前回送った局面 (差分の基)
+		Optional<SuperSnake::Game> lastSent;
+
+		// 行動を待っている局面の送信時刻
+		Optional<Stopwatch> waiting;
+
+		// まだ送信していないメッセージ
+		Array<Byte> outgoing;
+	};
+
+	TCPServer m_server;
+
+	uint16 m_port;
+
+	Duration m_deadlineGrace;
+
+	Array<SuperSnake::SnakeID> m_ids;
+
+	std::map<TCPSessionID, Session> m_sessions;
+
+	// 現在の局面 (後から接続したクライアントに送る)
+	Optional<SuperSnake::Game> m_game;
+
+	Optional<Duration> m_timeLimit;
+
+	Array<RemoteAction> m_actions;
+
+	// 接続順にスネークを割り当て直し, 変わったクライアントに通知する
+	void assignSnakes();
+
+	// メッセージを送信待ちに加える (flushで送る)
+	void send(Session& session, NetworkProtocol::MessageType type, const Array<Byte>& payload);
+
+	// 送信待ちのメッセージをクライアント毎に1回で送る
+	void flush();
+
+	void sendPosition(Session& session);
+
+	// 届いたメッセージを全て処理する
+	void receive(TCPSessionID id, Session& session);
+
+	void checkDeadline(Session& session);
+};
@@ -0,0 +1,623 @@
+﻿#include "NetworkProtocol.hpp"
+#include "BinaryIO.hpp"
+
+using namespace SuperSnake;
+
+namespace NetworkProtocol
+{
+	using BinaryIO::Append;
+	using BinaryIO::Extract;
+
+	// 7bitずつ, 続きがあれば最上位bitを立てる
+	static void AppendVarint(Array<Byte>& bytes, uint32 value)
+	{
+		while (value >= 0x80)
+		{
+			bytes.push_back(static_cast<Byte>(value | 0x80));
+			value >>= 7;
+		}
+		bytes.push_back(static_cast<Byte>(value));
+	}
+
+	static bool ExtractVarint(const Array<Byte>& bytes, size_t& offset, uint32& value)
+	{
+		value = 0;
+		for (int32 shift = 0; shift < 35; shift += 7)
+		{
+			if (offset >= bytes.size())
+			{
+				return false;
+			}
+			const uint8 byte = static_cast<uint8>(bytes[offset++]);
+			value |= static_cast<uint32>(byte & 0x7F) << shift;
+			if (not (byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static Optional<Direction> DirectionBetween(Point from, Point to)
+	{
+		for (const int32 direction : Iota(8))
+		{
+			if (from + Util::ToPoint(static_cast<Direction>(direction)) == to)
+			{
+				return static_cast<Direction>(direction);
+			}
+		}
+		return none;
+	}
+
+	static bool IsValidCell(int8 value)
+	{
+		return static_cast<int8>(CellState::Unallocated) <= value && value <= static_cast<int8>(CellState::Conflict);
+	}
+
+	Game RemotePosition::toGame() const
+	{
+		return Game(gameId, step, field, snakes);
+	}
+
+	Array<Byte> EncodeFrame(MessageType type, const Array<Byte>& payload)
+	{
+		assert(payload.size() <= MaxPayloadSize);
+
+		Array<Byte> bytes;
+		bytes.reserve(sizeof(FrameHeader) + payload.size());
+		Append(bytes, static_cast<FrameHeader>((static_cast<uint32>(type) << 24) | payload.size()));
+		bytes.append(payload);
+		return bytes;
+	}
+
+	Optional<std::pair<MessageType, uint32>> DecodeHeader(FrameHeader header)
+	{
+		const uint32 type = header >> 24;
+		if (type < static_cast<uint32>(MessageType::Hello) || type > static_cast<uint32>(MessageType::Step))
+		{
+			return none;
+		}
+		return std::pair{ static_cast<MessageType>(type), header & MaxPayloadSize };
+	}
+
+	// TCPServer のセッションを TCPClient と同じように読む
+	struct SessionReader
+	{
+		TCPServer& server;
+
+		TCPSessionID id;
+
+		size_t available() { return server.available(id); }
+
+		bool lookahead(void* dst, size_t size) const { return server.lookahead(dst, size, id); }
+
+		bool skip(size_t size) { return server.skip(size, id); }
+
+		bool read(void* dst, size_t size) { return server.read(dst, size, id); }
+	};
+
+	template<class Reader>
+	static ReadStatus ReadFrameFrom(Reader& reader, Frame& frame)
+	{
+		FrameHeader header;
+		if (reader.available() < sizeof(header) ||
+			not reader.lookahead(&header, sizeof(header)))
+		{
+			return ReadStatus::Incomplete;
+		}
+
+		const auto decoded = DecodeHeader(header);
+		if (not decoded)
+		{
+			// 形式が不正なデータは読み捨てる
+			reader.skip(reader.available());
+			return ReadStatus::Invalid;
+		}
+
+		const auto [type, size] = *decoded;
+		if (reader.available() < sizeof(header) + size)
+		{
+			return ReadStatus::Incomplete;
+		}
+
+		frame.type = type;
+		frame.payload.resize(size);
+		reader.skip(sizeof(header));
+		reader.read(frame.payload.data(), size);
+		return ReadStatus::Complete;
+	}
+
+	ReadStatus ReadFrame(TCPServer& server, TCPSessionID id, Frame& frame)
+	{
+		SessionReader reader{ server, id };
+		return ReadFrameFrom(reader, frame);
+	}
+
+	ReadStatus ReadFrame(TCPClient& client, Frame& frame)
+	{
+		return ReadFrameFrom(client, frame);
+	}
+
+	// magic, version
+	Array<Byte> EncodeHello()
+	{
+		Array<Byte> bytes;
+		Append(bytes, Magic);
+		Append(bytes, Version);
+		return bytes;
+	}
+
+	bool DecodeHello(const Array<Byte>& payload)
+	{
+		size_t offset = 0;
+		uint32 magic;
+		uint16 version;
+		return Extract(payload, offset, magic) &&
+			Extract(payload, offset, version) &&
+			magic == Magic &&
+			version == Version;
+	}
+
+	// id
+	Array<Byte> EncodeAssign(Optional<SnakeID> id)
+	{
+		Array<Byte> bytes;
+		Append(bytes, id ? static_cast<int8>(*id) : Unassigned);
+		return bytes;
+	}
+
+	Optional<int8> DecodeAssign(const Array<Byte>& payload)
+	{
+		size_t offset = 0;
+		int8 id;
+		if (not Extract(payload, offset, id) || id < Unassigned || id >= 4)
+		{
+			return none;
+		}
+		return id;
+	}
+
+	// gameId, step, timeLimitMs, snakeCount, full
+	// 全体: width, height, マス毎に CellState
+	// 差分: baseStep, changedCount, 変化したマス毎に index, CellState
+	// スネーク毎: x, y, direction, state
+	Array<Byte> EncodePosition(const Game& game, const Game* previous, uint32 timeLimitMs)
+	{
+		const auto& field = game.field();
+		const bool full = not previous ||
+			previous->gameId != game.gameId ||
+			previous->field().size() != field.size() ||
+			previous->snakes().size() != game.snakes().size();
+
+		Array<Byte> bytes;
+		Append(bytes, game.gameId);
+		Append(bytes, game.step());
+		Append(bytes, timeLimitMs);
+		Append(bytes, static_cast<uint8>(game.snakes().size()));
+		Append(bytes, static_cast<uint8>(full));
+		if (full)
+		{
+			Append(bytes, static_cast<uint16>(field.width()));
+			Append(bytes, static_cast<uint16>(field.height()));
+			for (const CellState cell : field)
+			{
+				Append(bytes, static_cast<int8>(cell));
+			}
+		}
+		else
+		{
+			Array<uint32> changed;
+			for (const size_t idx : Iota(field.num_elements()))
+			{
+				if (field.data()[idx] != previous->field().data()[idx])
+				{
+					changed.push_back(static_cast<uint32>(idx));
+				}
+			}
+
+			Append(bytes, previous->step());
+			Append(bytes, static_cast<uint32>(changed.size()));
+			for (const uint32 idx : changed)
+			{
+				Append(bytes, idx);
+				Append(bytes, static_cast<int8>(field.data()[idx]));
+			}
+		}
+
+		for (const auto& snake : game.snakes())
+		{
+			Append(bytes, static_cast<int16>(snake.position.x));
+			Append(bytes, static_cast<int16>(snake.position.y));
+			Append(bytes, static_cast<uint8>(snake.direction));
+			Append(bytes, static_cast<uint8>(snake.state));
+		}
+		return bytes;
+	}
+
+	bool ApplyPosition(const Array<Byte>& payload, RemotePosition& position)
+	{
+		size_t offset = 0;
+		int32 gameId, step;
+		uint32 timeLimitMs;
+		uint8 snakeCount, full;
+		if (not Extract(payload, offset, gameId) ||
+			not Extract(payload, offset, step) ||
+			not Extract(payload, offset, timeLimitMs) ||
+			not Extract(payload, offset, snakeCount) ||
+			not Extract(payload, offset, full) ||
+			snakeCount < 1 || snakeCount > 4)
+		{
+			return false;
+		}
+
+		Grid<CellState> field;
+		if (full)
+		{
+			uint16 width, height;
+			if (not Extract(payload, offset, width) ||
+				not Extract(payload, offset, height) ||
+				width < 2 || height < 2)
+			{
+				return false;
+			}
+
+			field = Grid<CellState>(width, height, CellState::Unallocated);
+			for (auto& cell : field)
+			{
+				int8 value;
+				if (not Extract(payload, offset, value) || not IsValidCell(value))
+				{
+					return false;
+				}
+				cell = static_cast<CellState>(value);
+			}
+		}
+		else
+		{
+			int32 baseStep;
+			uint32 changedCount;
+			if (not Extract(payload, offset, baseStep) ||
+				not Extract(payload, offset, changedCount) ||
+				position.gameId != gameId ||
+				position.step != baseStep ||
+				position.snakes.size() != snakeCount)
+			{
+				return false;
+			}
+
+			field = position.field;
+			for (uint32 i = 0; i < changedCount; i++)
+			{
+				uint32 idx;
+				int8 value;
+				if (not Extract(payload, offset, idx) ||
+					not Extract(payload, offset, value) ||
+					idx >= field.num_elements() ||
+					not IsValidCell(value))
+				{
+					return false;
+				}
+				field.data()[idx] = static_cast<CellState>(value);
+			}
+		}
+
+		Array<Snake> snakes;
+		for (const int32 snakeId : Iota(snakeCount))
+		{
+			int16 x, y;
+			uint8 direction, state;
+			if (not Extract(payload, offset, x) ||
+				not Extract(payload, offset, y) ||
+				not Extract(payload, offset, direction) ||
+				not Extract(payload, offset, state) ||
+				direction >= 8 || state > static_cast<uint8>(SnakeState::Dead))
+			{
+				return false;
+			}
+
+			// 壁に衝突して死亡したスネークの頭はフィールドの外にある
+			if (state != static_cast<uint8>(SnakeState::Dead) && not field.inBounds(Point{ x, y }))
+			{
+				return false;
+			}
+
+			snakes.push_back(Snake{
+				.point = 0,
+				.name = U"Snake {}"_fmt(char32_t(U'A' + snakeId)),
+				.position = Point{ x, y },
+				.direction = static_cast<Direction>(direction),
+				.state = static_cast<SnakeState>(state),
+				.bodyPath = { Point{ x, y } }
+				});
+		}
+
+		position.gameId = gameId;
+		position.step = step;
+		position.timeLimitMs = timeLimitMs;
+		position.field = std::move(field);
+		position.snakes = std::move(snakes);
+		return true;
+	}
+
+	// gameId, step, action
+	Array<Byte> EncodeAction(const ActionMessage& message)
+	{
+		Array<Byte> bytes;
+		Append(bytes, message.gameId);
+		Append(bytes, message.step);
+		Append(bytes, static_cast<int8>(message.action));
+		return bytes;
+	}
+
+	Optional<ActionMessage> DecodeAction(const Array<Byte>& payload)
+	{
+		size_t offset = 0;
+		ActionMessage message;
+		int8 action;
+		if (not Extract(payload, offset, message.gameId) ||
+			not Extract(payload, offset, message.step) ||
+			not Extract(payload, offset, action) ||
+			action < static_cast<int8>(SnakeAction::MoveLeft) ||
+			action > static_cast<int8>(SnakeAction::MoveRight))
+		{
+			return none;
+		}
+		message.action = static_cast<SnakeAction>(action);
+		return message;
+	}
+
+	// gameId, step, gameOver, width, height, snakeCount
+	// フィールド: 連続する同じ CellState の数, 続く (CellState, 長さ)
+	// スネーク毎: 名前 (UTF-8), point, state, direction, 胴体の長さ, 尾の x, y, 尾から頭へ進んだ方向 (4bitずつ)
+	Array<Byte> EncodeKeyframe(const Game& game)
+	{
+		const auto& field = game.field();
+		Array<Byte> bytes;
+		Append(bytes, game.gameId);
+		Append(bytes, game.step());
+		Append(bytes, static_cast<uint8>(game.isGameOver()));
+		Append(bytes, static_cast<uint16>(field.width()));
+		Append(bytes, static_cast<uint16>(field.height()));
+		Append(bytes, static_cast<uint8>(game.snakes().size()));
+
+		Array<std::pair<CellState, uint32>> runs;
+		for (const CellState cell : field)
+		{
+			if (not runs.isEmpty() && runs.back().first == cell)
+			{
+				runs.back().second++;
+			}
+			else
+			{
+				runs.emplace_back(cell, 1);
+			}
+		}
+		AppendVarint(bytes, static_cast<uint32>(runs.size()));
+		for (const auto& [cell, length] : runs)
+		{
+			Append(bytes, static_cast<int8>(cell));
+			AppendVarint(bytes, length);
+		}
+
+		for (const auto& snake : game.snakes())
+		{
+			const std::string name = snake.name.toUTF8().substr(0, 255);
+			Append(bytes, static_cast<uint8>(name.size()));
+			for (const char c : name)
+			{
+				Append(bytes, c);
+			}
+			Append(bytes, static_cast<int32>(snake.point));
+			Append(bytes, static_cast<uint8>(snake.state));
+			Append(bytes, static_cast<uint8>(snake.direction));
+
+			const auto& body = snake.bodyPath;
+			AppendVarint(bytes, static_cast<uint32>(body.size()));
+			if (body.isEmpty())
+			{
+				Append(bytes, static_cast<int16>(snake.position.x));
+				Append(bytes, static_cast<int16>(snake.position.y));
+				continue;
+			}
+
+			Append(bytes, static_cast<int16>(body.front().x));
+			Append(bytes, static_cast<int16>(body.front().y));
+			for (size_t i = 1; i < body.size(); i += 2)
+			{
+				// 胴体は1マスずつ進むため, 隣り合う点の方向は必ず求まる
+				const uint8 low = static_cast<uint8>(DirectionBetween(body[i - 1], body[i]).value_or(Direction::Up));
+				const uint8 high = i + 1 < body.size()
+					? static_cast<uint8>(DirectionBetween(body[i], body[i + 1]).value_or(Direction::Up))
+					: 0;
+				Append(bytes, static_cast<uint8>(low | (high << 4)));
+			}
+		}
+		return bytes;
+	}
+
+	std::unique_ptr<Game> DecodeKeyframe(const Array<Byte>& payload)
+	{
+		size_t offset = 0;
+		int32 gameId, step;
+		uint8 gameOver, snakeCount;
+		uint16 width, height;
+		uint32 runCount;
+		if (not Extract(payload, offset, gameId) ||
+			not Extract(payload, offset, step) ||
+			not Extract(payload, offset, gameOver) ||
+			not Extract(payload, offset, width) ||
+			not Extract(payload, offset, height) ||
+			not Extract(payload, offset, snakeCount) ||
+			not ExtractVarint(payload, offset, runCount) ||
+			width < 2 || height < 2 || snakeCount < 1 || snakeCount > 4)
+		{
+			return nullptr;
+		}
+
+		Grid<CellState> field(width, height, CellState::Unallocated);
+		size_t filled = 0;
+		for (uint32 i = 0; i < runCount; i++)
+		{
+			int8 value;
+			uint32 length;
+			if (not Extract(payload, offset, value) ||
+				not ExtractVarint(payload, offset, length) ||
+				not IsValidCell(value) ||
+				length > field.num_elements() - filled)
+			{
+				return nullptr;
+			}
+			std::fill_n(field.data() + filled, length, static_cast<CellState>(value));
+			filled += length;
+		}
+		if (filled != field.num_elements())
+		{
+			return nullptr;
+		}
+
+		Array<Snake> snakes;
+		for (int32 i = 0; i < snakeCount; i++)
+		{
+			uint8 nameLength;
+			if (not Extract(payload, offset, nameLength) || payload.size() < offset + nameLength)
+			{
+				return nullptr;
+			}
+			const std::string name(reinterpret_cast<const char*>(payload.data() + offset), nameLength);
+			offset += nameLength;
+
+			int32 point;
+			uint8 state, direction;
+			uint32 bodyLength;
+			int16 x, y;
+			if (not Extract(payload, offset, point) ||
+				not Extract(payload, offset, state) ||
+				not Extract(payload, offset, direction) ||
+				not ExtractVarint(payload, offset, bodyLength) ||
+				not Extract(payload, offset, x) ||
+				not Extract(payload, offset, y) ||
+				state > static_cast<uint8>(SnakeState::Dead) || direction >= 8 ||
+				payload.size() < offset + bodyLength / 2)
+			{
+				return nullptr;
+			}
+
+			Array<Point> body;
+			if (bodyLength > 0)
+			{
+				body.reserve(bodyLength);
+				body.emplace_back(x, y);
+				for (uint32 j = 1; j < bodyLength; j++)
+				{
+					const uint8 packed = static_cast<uint8>(payload[offset + (j - 1) / 2]);
+					const uint8 code = (j % 2 ? packed : packed >> 4) & 0x0F;
+					if (code >= 8)
+					{
+						return nullptr;
+					}
+					body.push_back(body.back() + Util::ToPoint(static_cast<Direction>(code)));
+				}
+				offset += bodyLength / 2;
+			}
+
+			// 壁に衝突して死亡したスネークは頭と胴体の末尾がフィールドの外にある
+			const bool dead = (state == static_cast<uint8>(SnakeState::Dead));
+			const Point head = body.isEmpty() ? Point{ x, y } : body.back();
+			if (not dead && not field.inBounds(head))
+			{
+				return nullptr;
+			}
+			const size_t checkedLength = (dead && not body.isEmpty()) ? body.size() - 1 : body.size();
+			for (size_t j = 0; j < checkedLength; j++)
+			{
+				if (not field.inBounds(body[j]))
+				{
+					return nullptr;
+				}
+			}
+
+			snakes.push_back(Snake{
+				.point = point,
+				.name = Unicode::FromUTF8(name),
+				.position = head,
+				.direction = static_cast<Direction>(direction),
+				.state = static_cast<SnakeState>(state),
+				.bodyPath = std::move(body)
+				});
+		}
+
+		return std::make_unique<Game>(gameId, step, std::move(field), std::move(snakes), gameOver != 0);
+	}
+
+	// gameId, step, 行動 (2bitずつ, 0: 左, 1: 直進, 2: 右, 3: 停止), deadMask
+	Array<Byte> EncodeStep(const Game& game, const Array<SnakeAction>& actions, const Array<GameEvent>& events)
+	{
+		assert(actions.size() <= 4);
+
+		uint8 packed = 0;
+		for (const auto [i, action] : Indexed(actions))
+		{
+			packed |= static_cast<uint8>(static_cast<int32>(action) + 1) << (i * 2);
+		}
+
+		uint8 deadMask = 0;
+		for (const auto& event : events)
+		{
+			if (const auto dead = std::get_if<DeadEvent>(&event))
+			{
+				deadMask |= static_cast<uint8>(1 << dead->id);
+			}
+		}
+
+		Array<Byte> bytes;
+		Append(bytes, game.gameId);
+		Append(bytes, game.step() - 1);
+		Append(bytes, static_cast<uint8>(actions.size()));
+		Append(bytes, packed);
+		Append(bytes, deadMask);
+		return bytes;
+	}
+
+	Optional<StepMessage> DecodeStep(const Array<Byte>& payload)
+	{
+		size_t offset = 0;
+		StepMessage message;
+		uint8 snakeCount, packed;
+		if (not Extract(payload, offset, message.gameId) ||
+			not Extract(payload, offset, message.step) ||
+			not Extract(payload, offset, snakeCount) ||
+			not Extract(payload, offset, packed) ||
+			not Extract(payload, offset, message.deadMask) ||
+			snakeCount < 1 || snakeCount > 4)
+		{
+			return none;
+		}
+
+		for (const int32 i : Iota(snakeCount))
+		{
+			message.actions.push_back(static_cast<SnakeAction>(((packed >> (i * 2)) & 0b11) - 1));
+		}
+		return message;
+	}
+
+	bool ApplyStep(const StepMessage& message, Game& game)
+	{
+		if (message.gameId != game.gameId ||
+			message.step != game.step() ||
+			message.actions.size() != game.snakes().size())
+		{
+			return false;
+		}
+
+		uint8 deadMask = 0;
+		for (const auto& event : game.doActions(message.actions))
+		{
+			if (const auto dead = std::get_if<DeadEvent>(&event))
+			{
+				deadMask |= static_cast<uint8>(1 << dead->id);
+			}
+		}
+		return deadMask == message.deadMask;
+	}
+}
@@ -0,0 +1,197 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+
+/// @brief ネットワーク越しにスネークを操作するクライアントとの通信形式
+/// @remark 全てのメッセージは FrameHeader + ペイロード で, 数値はリトルエンディアンです
+/// 接続直後にクライアントが Hello を送り, ホストは操作させるスネークを Assign で通知します
+/// 以降, ホストはステップ毎に局面を Position で送り, クライアントは Action を返します
+/// Position は同じ接続に前回送った局面からの差分で, 最初の1回とゲームが変わったときは全体を送ります
+/// 観戦者は Watch を送り, ホストは局面全体を Keyframe で, 以降はステップ毎の行動と死亡したスネークを Step で送ります
+namespace NetworkProtocol
+{
+	// "SSNP"
+	constexpr uint32 Magic = 0x504E5353;
+
+	constexpr uint16 Version = 1;
+
+	/// @brief ホストが既定で待ち受けるポート
+	constexpr uint16 DefaultPort = 50730;
+
+	/// @brief 観戦用のホストが既定で待ち受けるポート
+	constexpr uint16 DefaultSpectatorPort = 50731;
+
+	enum class MessageType : uint8
+	{
+		/// @brief 接続開始 (クライアント -> ホスト)
+		Hello = 1,
+
+		/// @brief 操作させるスネークの通知 (ホスト -> クライアント)
+		Assign = 2,
+
+		/// @brief 局面 (ホスト -> クライアント)
+		Position = 3,
+
+		/// @brief 行動 (クライアント -> ホスト)
+		Action = 4,
+
+		/// @brief 観戦開始, 局面全体の再送要求 (観戦者 -> ホスト, ペイロードは Hello と同じ)
+		Watch = 5,
+
+		/// @brief 局面全体 (ホスト -> 観戦者)
+		Keyframe = 6,
+
+		/// @brief 1ステップ分の差分 (ホスト -> 観戦者)
+		Step = 7,
+	};
+
+	/// @brief ヘッダー (下位24bit: ペイロードのバイト数, 上位8bit: MessageType)
+	using FrameHeader = uint32;
+
+	constexpr uint32 MaxPayloadSize = (1 << 24) - 1;
+
+	/// @brief 操作させるスネークが無い場合の Assign
+	constexpr int8 Unassigned = -1;
+
+	/// @brief クライアントが受け取った局面
+	/// @remark 差分を適用するため, 接続中は同じものを使い続けてください
+	struct RemotePosition
+	{
+		int32 gameId = 0;
+
+		int32 step = -1;
+
+		/// @brief 行動を返すまでの制限時間 [ms], 0の場合は無制限
+		uint32 timeLimitMs = 0;
+
+		Grid<SuperSnake::CellState> field;
+
+		/// @brief スネーク (名前, 胴体, ポイントは送りません)
+		Array<SuperSnake::Snake> snakes;
+
+		SuperSnake::Game toGame() const;
+	};
+
+	struct ActionMessage
+	{
+		int32 gameId;
+
+		int32 step;
+
+		SuperSnake::SnakeAction action;
+	};
+
+	/// @brief 観戦者に送る1ステップ分の差分
+	/// @remark 確保したマス, 衝突, ポイントは観戦者が Game::doActions で再現します
+	struct StepMessage
+	{
+		int32 gameId;
+
+		/// @brief 行動する前のステップ
+		int32 step;
+
+		Array<SuperSnake::SnakeAction> actions;
+
+		/// @brief このステップで死亡したスネーク (bit i: スネーク i)
+		uint8 deadMask;
+	};
+
+	/// @brief 受信したメッセージ
+	struct Frame
+	{
+		MessageType type;
+
+		Array<Byte> payload;
+	};
+
+	enum class ReadStatus : uint8
+	{
+		/// @brief メッセージを1つ取り出した
+		Complete,
+
+		/// @brief メッセージ全体がまだ届いていない
+		Incomplete,
+
+		/// @brief ヘッダーが不正なため, 受信したデータを全て読み捨てた
+		Invalid,
+	};
+
+	/// @brief ヘッダーを付けたメッセージを作成します
+	/// @remark TCP_NODELAYを設定できないため, 同じ相手に続けて送るメッセージは連結して1回で送ってください
+	/// (2回に分けると, Nagleアルゴリズムと遅延ACKにより2つ目が遅れます)
+	Array<Byte> EncodeFrame(MessageType type, const Array<Byte>& payload);
+
+	/// @brief ヘッダーを読み取ります
+	/// @return 種類とペイロードのバイト数, 種類が不正な場合none
+	Optional<std::pair<MessageType, uint32>> DecodeHeader(FrameHeader header);
+
+	/// @brief セッションの受信済みのデータからメッセージを1つ取り出します
+	ReadStatus ReadFrame(TCPServer& server, TCPSessionID id, Frame& frame);
+
+	/// @brief 受信済みのデータからメッセージを1つ取り出します
+	ReadStatus ReadFrame(TCPClient& client, Frame& frame);
+
+	/// @brief 切断されたセッションを取り除き, 新しく接続したセッションを加えます
+	/// @param onDisconnected 切断されたセッションを取り除く前に (id, session) で呼び出します
+	template<class Session, class OnDisconnected>
+	void SyncSessions(const TCPServer& server, std::map<TCPSessionID, Session>& sessions, OnDisconnected onDisconnected)
+	{
+		const auto sessionIds = server.getSessionIDs();
+		std::erase_if(sessions, [&](const auto& pair) {
+			if (sessionIds.contains(pair.first))
+			{
+				return false;
+			}
+			onDisconnected(pair.first, pair.second);
+			return true;
+		});
+		for (const auto id : sessionIds)
+		{
+			sessions.try_emplace(id);
+		}
+	}
+
+	template<class Session>
+	void SyncSessions(const TCPServer& server, std::map<TCPSessionID, Session>& sessions)
+	{
+		SyncSessions(server, sessions, [](TCPSessionID, const Session&) {});
+	}
+
+	Array<Byte> EncodeHello();
+
+	/// @return マジックナンバー, バージョンが一致するか
+	bool DecodeHello(const Array<Byte>& payload);
+
+	Array<Byte> EncodeAssign(Optional<SuperSnake::SnakeID> id);
+
+	/// @return 不正な場合none, 割り当てが無い場合は Unassigned
+	Optional<int8> DecodeAssign(const Array<Byte>& payload);
+
+	/// @brief 局面を作成します
+	/// @param previous 同じ接続に前回送った局面 (無い場合, ゲームが異なる場合は全体を送ります)
+	Array<Byte> EncodePosition(const SuperSnake::Game& game, const SuperSnake::Game* previous, uint32 timeLimitMs);
+
+	/// @brief 受け取った局面を適用します
+	/// @return 不正な場合, 差分の基になる局面が一致しない場合false (positionは変更しません)
+	bool ApplyPosition(const Array<Byte>& payload, RemotePosition& position);
+
+	Array<Byte> EncodeAction(const ActionMessage& message);
+
+	Optional<ActionMessage> DecodeAction(const Array<Byte>& payload);
+
+	/// @brief 局面全体を作成します (名前, 胴体, ポイントも含みます)
+	Array<Byte> EncodeKeyframe(const SuperSnake::Game& game);
+
+	/// @return 不正な場合nullptr
+	std::unique_ptr<SuperSnake::Game> DecodeKeyframe(const Array<Byte>& payload);
+
+	/// @param game 行動した後の局面
+	/// @param actions 行動
+	/// @param events 行動したときのイベント
+	Array<Byte> EncodeStep(const SuperSnake::Game& game, const Array<SuperSnake::SnakeAction>& actions, const Array<SuperSnake::GameEvent>& events);
+
+	Optional<StepMessage> DecodeStep(const Array<Byte>& payload);
+
+	/// @brief 差分を局面に適用します
+	/// @return 差分の基になる局面が一致しない場合, 適用した結果が送られた差分と一致しない場合false
+	bool ApplyStep(const StepMessage& message, SuperSnake::Game& game);
+}
@@ -0,0 +1,240 @@
+﻿#include "OpeningBook.hpp"
+#include "PositionKey.hpp"
+#include "SolverV1.hpp"
+#include "Config.hpp"
+
+using namespace SuperSnake;
+
+static_assert(sizeof(OpeningBook::Header) == 32);
+
+OpeningBook::OpeningBook(FilePathView path)
+	: m_file{ path }
+{
+	if (not m_file)
+	{
+		return;
+	}
+
+	const auto memory = m_file.mapAll();
+	if (memory.size < sizeof(Header))
+	{
+		return;
+	}
+
+	const auto* header = reinterpret_cast<const Header*>(memory.data);
+	if (header->magic != Magic ||
+		header->version != Version ||
+		memory.size < sizeof(Header) + header->entryCount * sizeof(uint64))
+	{
+		return;
+	}
+
+	m_header = header;
+	m_entries = reinterpret_cast<const uint64*>(memory.data + sizeof(Header));
+	m_entryCount = static_cast<size_t>(header->entryCount);
+}
+
+Optional<SnakeAction> OpeningBook::probe(const Game& game, SnakeID id) const
+{
+	if (not isOpen() ||
+		game.field().width() != m_header->width ||
+		game.field().height() != m_header->height ||
+		static_cast<int32>(game.snakes().size()) != m_header->snakeCount)
+	{
+		return none;
+	}
+
+	const auto [key, symmetry] = CanonicalPositionKey(game, id);
+	const uint64 maskedKey = key & ~uint64(7);
+
+	const uint64* end = m_entries + m_entryCount;
+	const uint64* entry = std::lower_bound(m_entries, end, maskedKey);
+	if (entry == end || (*entry & ~uint64(7)) != maskedKey)
+	{
+		return none;
+	}
+
+	const auto& snake = game.snakes()[id];
+	const Direction direction = symmetry.inverse(Direction(*entry & 7));
+	for (int i : Range(-1, 1))
+	{
+		const SnakeAction action = static_cast<SnakeAction>(i);
+		if (Util::DoAction(snake.direction, action) == direction)
+		{
+			return action;
+		}
+	}
+
+	return none;
+}
+
+const OpeningBook* OpeningBook::Find(Size fieldSize, int32 snakeCount)
+{
+	static std::mutex mutex;
+	static std::map<std::tuple<int32, int32, int32>, std::unique_ptr<OpeningBook>> books;
+
+	std::lock_guard lock(mutex);
+	auto& book = books[{ fieldSize.x, fieldSize.y, snakeCount }];
+	if (not book)
+	{
+		book = std::make_unique<OpeningBook>(GetPath(fieldSize, snakeCount));
+	}
+	return book->isOpen() ? book.get() : nullptr;
+}
+
+FilePath OpeningBook::GetPath(Size fieldSize, int32 snakeCount)
+{
+	return U"{}{}x{}_{}.book"_fmt(OpeningBookDirectory, fieldSize.x, fieldSize.y, snakeCount);
+}
+
+bool OpeningBook::Build(Size fieldSize, int32 snakeCount, int32 plies, int32 searchDepth, FilePathView path, std::function<void(size_t, size_t)> progress)
+{
+	struct Job
+	{
+		size_t positionIdx;
+
+		SnakeID snakeId;
+
+		CanonicalKey key;
+
+		Direction direction;
+	};
+
+	// 初期局面からplies手先までの局面を列挙
+	Array<Game> positions;
+	{
+		HashSet<uint64> visited;
+		Array<Game> frontier{ Game(fieldSize, snakeCount) };
+		for (int32 ply : Range(0, plies))
+		{
+			Array<Game> next;
+			for (const auto& game : frontier)
+			{
+				if (game.isGameOver() || not visited.insert(PositionKey(game)).second)
+				{
+					continue;
+				}
+				positions.push_back(game);
+
+				if (ply == plies)
+				{
+					continue;
+				}
+
+				// 生存しているスネークの行動の組み合わせを全て試す
+				size_t jointCount = 1;
+				for (const auto& snake : game.snakes())
+				{
+					if (snake.state == SnakeState::Alive)
+					{
+						jointCount *= 3;
+					}
+				}
+				for (size_t n : Iota(jointCount))
+				{
+					Array<SnakeAction> actions(game.snakes().size(), SnakeAction::Stay);
+					for (auto [snakeId, snake] : Indexed(game.snakes()))
+					{
+						if (snake.state == SnakeState::Alive)
+						{
+							actions[snakeId] = static_cast<SnakeAction>(static_cast<int32>(n % 3) - 1);
+							n /= 3;
+						}
+					}
+					next.push_back(game);
+					next.back().doActions(actions);
+				}
+			}
+			frontier = std::move(next);
+		}
+	}
+
+	// 対称な局面を除いて探索対象を列挙
+	Array<Job> jobs;
+	{
+		HashSet<uint64> visited;
+		for (auto [positionIdx, game] : Indexed(positions))
+		{
+			for (auto [snakeId, snake] : Indexed(game.snakes()))
+			{
+				if (snake.state == SnakeState::Dead)
+				{
+					continue;
+				}
+
+				const CanonicalKey key = CanonicalPositionKey(game, SnakeID(snakeId));
+				if (visited.insert(key.key & ~uint64(7)).second)
+				{
+					jobs.push_back(Job{ .positionIdx = positionIdx, .snakeId = SnakeID(snakeId), .key = key });
+				}
+			}
+		}
+	}
+
+	// 探索
+	{
+		std::atomic<size_t> nextJob = 0;
+		std::atomic<size_t> completed = 0;
+
+		Array<std::thread> workers(Max<size_t>(Threading::GetConcurrency(), 1));
+		for (auto& worker : workers)
+		{
+			worker = std::thread([&] {
+				SolverV1 solver(searchDepth, false);
+				for (size_t jobIdx = nextJob++; jobIdx < jobs.size(); jobIdx = nextJob++)
+				{
+					Job& job = jobs[jobIdx];
+					const Game& game = positions[job.positionIdx];
+					const SnakeAction action = solver.solve(game, job.snakeId, SolveContext{});
+					job.direction = Util::DoAction(game.snakes()[job.snakeId].direction, action);
+					completed++;
+				}
+			});
+		}
+
+		while (completed < jobs.size())
+		{
+			if (progress)
+			{
+				progress(completed, jobs.size());
+			}
+			std::this_thread::sleep_for(100ms);
+		}
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		if (progress)
+		{
+			progress(jobs.size(), jobs.size());
+		}
+	}
+
+	Array<uint64> entries = jobs.map([](const Job& job) {
+		return (job.key.key & ~uint64(7)) | static_cast<uint64>(job.key.symmetry.apply(job.direction));
+	});
+	entries.sort();
+
+	const Header header{
+		.magic = Magic,
+		.version = Version,
+		.width = fieldSize.x,
+		.height = fieldSize.y,
+		.snakeCount = snakeCount,
+		.searchDepth = searchDepth,
+		.entryCount = entries.size()
+	};
+
+	FileSystem::CreateDirectories(FileSystem::ParentPath(path));
+	BinaryWriter writer{ path };
+	if (not writer)
+	{
+		return false;
+	}
+	writer.write(header);
+	writer.write(entries.data(), entries.size() * sizeof(uint64));
+
+	return true;
+}
@@ -0,0 +1,72 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+
+/// @brief 序盤の局面と最善手を記録した定跡
+/// @remark ファイルはメモリマップで開き, ヒープに展開せずに参照します
+class OpeningBook
+{
+public:
+
+	struct Header
+	{
+		uint32 magic;
+
+		uint32 version;
+
+		int32 width;
+
+		int32 height;
+
+		int32 snakeCount;
+
+		/// @brief 生成時の探索深さ
+		int32 searchDepth;
+
+		uint64 entryCount;
+	};
+
+	// "SSOB"
+	static constexpr uint32 Magic = 0x424F5353;
+
+	static constexpr uint32 Version = 1;
+
+	explicit OpeningBook(FilePathView path);
+
+	bool isOpen() const { return m_entries != nullptr; }
+
+	size_t size() const { return m_entryCount; }
+
+	/// @brief 定跡を検索します
+	/// @param game 局面
+	/// @param id 操作するスネーク
+	/// @return 定跡に含まれる局面であればその最善手, それ以外の場合none
+	Optional<SuperSnake::SnakeAction> probe(const SuperSnake::Game& game, SuperSnake::SnakeID id) const;
+
+	/// @brief フィールドサイズ, スネーク数に対応する定跡を取得します
+	/// @return 定跡ファイルが存在しない場合nullptr
+	static const OpeningBook* Find(Size fieldSize, int32 snakeCount);
+
+	/// @brief 定跡ファイルのパスを取得します
+	static FilePath GetPath(Size fieldSize, int32 snakeCount);
+
+	/// @brief 初期局面からplies手先までの局面を深く探索し, 定跡ファイルを生成します
+	/// @param fieldSize フィールドサイズ
+	/// @param snakeCount スネーク数
+	/// @param plies 定跡に含める手数
+	/// @param searchDepth 探索深さ
+	/// @param path 出力先
+	/// @param progress 進捗の通知 (完了した局面数, 局面数)
+	/// @return 書き出しに成功した場合true
+	static bool Build(Size fieldSize, int32 snakeCount, int32 plies, int32 searchDepth, FilePathView path, std::function<void(size_t, size_t)> progress = nullptr);
+
+private:
+
+	MemoryMappedFileView m_file;
+
+	const Header* m_header = nullptr;
+
+	// 上位61bit: 局面のハッシュ値, 下位3bit: 正規化した盤面での進行方向
+	const uint64* m_entries = nullptr;
+
+	size_t m_entryCount = 0;
+};
@@ -0,0 +1,162 @@
+﻿#include "PositionKey.hpp"
+
+namespace SuperSnake
+{
+	// SplitMix64
+	static constexpr uint64 Mix(uint64 x)
+	{
+		x += 0x9E3779B97F4A7C15;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+		return x ^ (x >> 31);
+	}
+
+	static Direction ToDirection(Point vec)
+	{
+		for (int32 i : Iota(8))
+		{
+			if (Util::ToPoint(Direction(i)) == vec)
+			{
+				return Direction(i);
+			}
+		}
+		return Direction::Up;
+	}
+
+	Point Symmetry::apply(Point pos, Size fieldSize) const
+	{
+		if (index & 4)
+		{
+			pos = { pos.y, pos.x };
+		}
+		if (index & 1)
+		{
+			pos.x = fieldSize.x - 1 - pos.x;
+		}
+		if (index & 2)
+		{
+			pos.y = fieldSize.y - 1 - pos.y;
+		}
+		return pos;
+	}
+
+	Direction Symmetry::apply(Direction direction) const
+	{
+		Point vec = Util::ToPoint(direction);
+		if (index & 4)
+		{
+			vec = { vec.y, vec.x };
+		}
+		if (index & 1)
+		{
+			vec.x = -vec.x;
+		}
+		if (index & 2)
+		{
+			vec.y = -vec.y;
+		}
+		return ToDirection(vec);
+	}
+
+	Direction Symmetry::inverse(Direction direction) const
+	{
+		Point vec = Util::ToPoint(direction);
+		if (index & 2)
+		{
+			vec.y = -vec.y;
+		}
+		if (index & 1)
+		{
+			vec.x = -vec.x;
+		}
+		if (index & 4)
+		{
+			vec = { vec.y, vec.x };
+		}
+		return ToDirection(vec);
+	}
+
+	Array<Symmetry> Symmetry::Enumerate(Size fieldSize)
+	{
+		Array<Symmetry> result;
+		for (int32 i : Iota(fieldSize.x == fieldSize.y ? 8 : 4))
+		{
+			result.push_back(Symmetry{ i });
+		}
+		return result;
+	}
+
+	uint64 PositionKey(const Game& game)
+	{
+		const auto& field = game.field();
+
+		uint64 key = Mix((static_cast<uint64>(field.width()) << 32) | static_cast<uint32>(field.height()));
+
+		for (const Point pos : Iota2D(field.size()))
+		{
+			key = Mix(key ^ static_cast<uint64>(static_cast<int32>(field[pos]) + 1));
+		}
+
+		for (const auto& snake : game.snakes())
+		{
+			key = Mix(key
+				^ (static_cast<uint64>(static_cast<uint16>(snake.position.x)))
+				^ (static_cast<uint64>(static_cast<uint16>(snake.position.y)) << 16)
+				^ (static_cast<uint64>(snake.direction) << 32)
+				^ (static_cast<uint64>(snake.state) << 40));
+		}
+
+		return key;
+	}
+
+	CanonicalKey CanonicalPositionKey(const Game& game, SnakeID id)
+	{
+		// 要素の種類毎のハッシュ値 (順序に依存しないようXORで合成する)
+		constexpr uint64 CellSalt = 0x1000000000000000;
+		constexpr uint64 OwnHeadSalt = 0x2000000000000000;
+		constexpr uint64 OtherHeadSalt = 0x3000000000000000;
+
+		const auto& field = game.field();
+		const Size fieldSize = field.size();
+		const auto cellHash = [&](Point pos, uint64 salt) {
+			return Mix(salt ^ (static_cast<uint64>(pos.y) * fieldSize.x + pos.x));
+		};
+		const auto headHash = [&](Point pos, Direction direction, uint64 salt) {
+			return Mix(cellHash(pos, salt) ^ static_cast<uint64>(direction));
+		};
+
+		CanonicalKey result{ .key = std::numeric_limits<uint64>::max() };
+		for (const Symmetry symmetry : Symmetry::Enumerate(fieldSize))
+		{
+			uint64 key = Mix((static_cast<uint64>(fieldSize.x) << 32) | static_cast<uint32>(fieldSize.y));
+
+			for (const Point pos : Iota2D(fieldSize))
+			{
+				if (field[pos] != CellState::Unallocated)
+				{
+					key ^= cellHash(symmetry.apply(pos, fieldSize), CellSalt);
+				}
+			}
+
+			for (const auto [snakeId, snake] : Indexed(game.snakes()))
+			{
+				if (snake.state == SnakeState::Dead)
+				{
+					continue;
+				}
+
+				key ^= headHash(
+					symmetry.apply(snake.position, fieldSize),
+					symmetry.apply(snake.direction),
+					SnakeID(snakeId) == id ? OwnHeadSalt : OtherHeadSalt);
+			}
+
+			if (key < result.key)
+			{
+				result = { key, symmetry };
+			}
+		}
+
+		return result;
+	}
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+
+namespace SuperSnake
+{
+	/// @brief 盤面の対称変換
+	/// @remark bit0: 左右反転, bit1: 上下反転, bit2: 転置(正方形のフィールドのみ)
+	struct Symmetry
+	{
+		int32 index = 0;
+
+		/// @brief 座標を変換します
+		Point apply(Point pos, Size fieldSize) const;
+
+		/// @brief 方向を変換します
+		Direction apply(Direction direction) const;
+
+		/// @brief 変換後の方向を元の方向に戻します
+		Direction inverse(Direction direction) const;
+
+		/// @brief フィールドサイズに対して有効な対称変換を列挙します
+		static Array<Symmetry> Enumerate(Size fieldSize);
+	};
+
+	struct CanonicalKey
+	{
+		/// @brief 対称変換のうち最小のハッシュ値
+		uint64 key;
+
+		/// @brief keyを与える対称変換
+		Symmetry symmetry;
+	};
+
+	/// @brief 局面(フィールド, 各スネークの状態)を識別するハッシュ値を計算します
+	/// @param game 局面
+	/// @return ハッシュ値
+	uint64 PositionKey(const Game& game);
+
+	/// @brief 指定したスネークから見た局面を, 盤面の対称性を除いて識別するハッシュ値を計算します
+	/// @remark スネークの色は区別せず, 確保済みのマスと各スネークの頭の位置, 向きのみを考慮します
+	/// @param game 局面
+	/// @param id 視点となるスネーク
+	/// @return ハッシュ値と, それを与える対称変換
+	CanonicalKey CanonicalPositionKey(const Game& game, SnakeID id);
+}
@@ -201,6 +201,28 @@ void SettingsWindow::renderWindow()
 		ImGui::Indent();
 		{
 			ImGui::Checkbox("Hide Confirmed Action", &m_settings.hideConfirmedAction);
+			ImGui::Checkbox("Host Spectators", &m_settings.hostSpectators);
+		}
+		ImGui::Unindent();
+
+		ImGui::BulletText("Solver");
+		ImGui::Indent();
+		{
+			if (ImGui::InputInt("workers (0: auto)", &m_settings.solverWorkerCount))
+			{
+				// 誤入力で大量のスレッドを作らないよう論理コア数までに制限する
+				m_settings.solverWorkerCount = Clamp(m_settings.solverWorkerCount, 0, static_cast<int32>(Threading::GetConcurrency()));
+			}
+			if (ImGui::InputInt("time limit [ms] (0: none)", &m_settings.solverTimeLimitMs, 100, 1000))
+			{
+				m_settings.solverTimeLimitMs = Max(m_settings.solverTimeLimitMs, 0);
+			}
+			ImGui::InputScalar("affinity mask (0: any)", ImGuiDataType_U64, &m_settings.solverAffinityMask,
+				nullptr, nullptr, "%llX", ImGuiInputTextFlags_CharsHexadecimal);
+			if (ImGui::InputInt("NUMA node (-1: any)", &m_settings.solverNumaNode))
+			{
+				m_settings.solverNumaNode = Max(m_settings.solverNumaNode, -1);
+			}
 		}
 		ImGui::Unindent();
 
@@ -220,6 +242,19 @@ void SettingsWindow::renderWindow()
 			}
 		}
 		ImGui::EndDisabled();
+
+		ImGui::SeparatorText("Spectate");
+
+		ImGui::InputTextWithHint("##WatchHost", "Host Address", &m_watchHost);
+		ImGui::SameLine();
+		if (ImGui::Button("Watch"))
+		{
+			m_visible = false;
+			if (watchCallback)
+			{
+				watchCallback(Unicode::FromUTF8(m_watchHost));
+			}
+		}
 	}
 	ImGui::End();
 
@@ -9,6 +9,9 @@ public:
 
 	std::function<void()> startCallback;
 
+	/// @brief 観戦の開始 (引数: ホストのアドレス)
+	std::function<void(const String&)> watchCallback;
+
 	const GameSettings& settings() const { return m_settings; }
 
 	void setVisible(bool v) { m_visible = v; }
@@ -29,5 +32,7 @@ private:
 
 	std::string m_presetName;
 
+	std::string m_watchHost = "127.0.0.1";
+
 	void renderControllerPicker(GameController& controller);
 };
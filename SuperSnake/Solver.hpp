@@ -1,11 +1,135 @@
 ﻿#pragma once
+#include <stop_token>
+#include <memory_resource>
 #include "SuperSnake.hpp"
+#include "StepSnapshot.hpp"
+
+/// @brief 1回の探索の統計情報
+struct SolverStats
+{
+	/// @brief 探索したノード数
+	uint64 nodes = 0;
+
+	/// @brief 置換表を参照した回数
+	uint64 ttProbes = 0;
+
+	/// @brief 置換表にヒットした回数
+	uint64 ttHits = 0;
+
+	/// @brief 読み切った深さ (途中で打ち切られた場合は, 最後まで読み切った深さ)
+	int32 depth = 0;
+
+	/// @brief 探索時間 (SolverRunnerが計測します)
+	Duration elapsed{ 0 };
+
+	/// @brief 読み筋 (自分の手から順に)
+	Array<SuperSnake::SnakeAction> pv;
+
+	double nodesPerSecond() const
+	{
+		return elapsed.count() > 0 ? nodes / elapsed.count() : 0.0;
+	}
+
+	double ttHitRate() const
+	{
+		return ttProbes > 0 ? static_cast<double>(ttHits) / ttProbes : 0.0;
+	}
+
+	/// @brief 読み筋を L(左), S(直進), R(右) の列で表します
+	String pvText() const
+	{
+		String text;
+		for (const auto action : pv)
+		{
+			switch (action)
+			{
+			case SuperSnake::SnakeAction::MoveLeft: text += U'L'; break;
+			case SuperSnake::SnakeAction::MoveStraight: text += U'S'; break;
+			case SuperSnake::SnakeAction::MoveRight: text += U'R'; break;
+			default: text += U'-'; break;
+			}
+		}
+		return text;
+	}
+};
+
+/// @brief 探索の打ち切り条件と作業領域
+struct SolveContext
+{
+	/// @brief 停止要求
+	std::stop_token stopToken;
+
+	/// @brief 探索の期限 (noneの場合は無制限)
+	Optional<std::chrono::steady_clock::time_point> deadline;
+
+	/// @brief 1回の探索の作業領域 (SolverArena)
+	/// @remark 呼び出し元が探索毎に解放するため, 探索を終える前に確保したものを全て破棄してください
+	std::pmr::memory_resource* arena = nullptr;
+
+	/// @brief 同じステップの探索で共有する局面のスナップショット
+	/// @remark 先読みなど, 探索する局面と一致しない場合があるため snapshotOf で参照してください
+	const StepSnapshot* snapshot = nullptr;
+
+	/// @brief 作業領域の確保に使うメモリリソース (arenaが無い場合はヒープ)
+	std::pmr::memory_resource* memoryResource() const
+	{
+		return arena ? arena : std::pmr::new_delete_resource();
+	}
+
+	/// @brief 局面の共有のスナップショットを返します
+	/// @return gameがスナップショットの局面でない場合はnullptr
+	const StepSnapshot* snapshotOf(const SuperSnake::Game& game) const
+	{
+		return snapshot && &snapshot->game() == &game ? snapshot : nullptr;
+	}
+
+	/// @brief 探索を打ち切るべきか
+	/// @remark 時刻の取得を伴うため, 数千ノードに1回程度呼び出してください
+	bool shouldStop() const
+	{
+		return stopToken.stop_requested() ||
+			(deadline && std::chrono::steady_clock::now() >= *deadline);
+	}
+
+	/// @brief 期限を設定したコンテキストを作成します
+	static SolveContext WithTimeLimit(std::stop_token stopToken, Optional<Duration> timeLimit)
+	{
+		SolveContext context{ .stopToken = std::move(stopToken) };
+		if (timeLimit)
+		{
+			context.deadline = std::chrono::steady_clock::now() +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(*timeLimit);
+		}
+		return context;
+	}
+};
 
 class Solver
 {
 public:
 
-	virtual SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id) = 0;
+	/// @brief 行動を決定します
+	/// @param game 現在の局面
+	/// @param id 操作するスネーク
+	/// @param context 打ち切り条件. 打ち切られた場合はそれまでの最善手を返します
+	virtual SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id, const SolveContext& context) = 0;
+
+	/// @brief 複数のスネークの行動をまとめて決定します
+	/// @remark 既定では1匹ずつsolveを呼び出します
+	/// @param ids 操作するスネーク
+	/// @return idsと同じ順の行動
+	virtual Array<SuperSnake::SnakeAction> solveJoint(const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids, const SolveContext& context)
+	{
+		return ids.map([&](SuperSnake::SnakeID id) { return solve(game, id, context); });
+	}
+
+	/// @brief solveJoint で複数のスネークを1回の探索で決定するか
+	/// @remark falseの場合, SolverRunner はスネーク毎に solve を並列に実行します
+	virtual bool searchesJointly() const { return false; }
+
+	/// @brief 直前のsolveの統計情報を返します
+	/// @return 統計情報を集計しないソルバーはnone
+	virtual Optional<SolverStats> stats() const { return none; }
 
 	virtual ~Solver() { }
 };
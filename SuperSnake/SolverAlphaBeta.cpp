@@ -0,0 +1,726 @@
+﻿#include "SolverAlphaBeta.hpp"
+#include "OpeningBook.hpp"
+#include "Tablebase.hpp"
+#include "Config.hpp"
+
+using namespace SuperSnake;
+
+SolverAlphaBeta::SolverAlphaBeta()
+	: m_table(TableSize)
+	, m_evaluator(EvalWeightsPath)
+{ }
+
+SnakeAction SolverAlphaBeta::solve(const Game& game, SnakeID id, const SolveContext& context)
+{
+	m_stats = SolverStats{};
+	return searchRoot(game, id, { id }, {}, context);
+}
+
+Array<SnakeAction> SolverAlphaBeta::solveJoint(const Game& game, const Array<SnakeID>& ids, const SolveContext& context)
+{
+	m_stats = SolverStats{};
+
+	// 先に決めた味方の移動先を確保済みとして, 1匹ずつ同じ置換表で探索する
+	Array<SnakeAction> actions;
+	Array<Point> reserved;
+	Array<SnakeAction> firstPV;
+	int32 minDepth = std::numeric_limits<int32>::max();
+	for (const auto [idx, id] : Indexed(ids))
+	{
+		// 残り時間を残りのスネークで等分する
+		SolveContext memberContext{ .stopToken = context.stopToken, .arena = context.arena, .snapshot = context.snapshot };
+		if (context.deadline)
+		{
+			const auto now = std::chrono::steady_clock::now();
+			memberContext.deadline = now + (*context.deadline - now) / static_cast<int64>(ids.size() - idx);
+		}
+
+		const SnakeAction action = searchRoot(game, id, ids, reserved, memberContext);
+		actions.push_back(action);
+		minDepth = Min(minDepth, m_stats.depth);
+		if (idx == 0)
+		{
+			firstPV = m_stats.pv;
+		}
+
+		const auto& snake = game.snakes()[id];
+		reserved.push_back(snake.position + Util::ToPoint(Util::DoAction(snake.direction, action)));
+	}
+
+	m_stats.depth = minDepth;
+	m_stats.pv = std::move(firstPV);
+	return actions;
+}
+
+SnakeAction SolverAlphaBeta::searchRoot(const Game& game, SnakeID id, const Array<SnakeID>& team, const Array<Point>& reserved, const SolveContext& context)
+{
+	m_stats.depth = 0;
+	m_stats.pv.clear();
+
+	// 終盤データベース, 定跡に含まれる局面であれば探索しない (味方がいる場合は局面の意味が変わるため使わない)
+	if (team.size() == 1 && reserved.isEmpty())
+	{
+		if (const auto tablebase = Tablebase::Find(game.field().size(), static_cast<int32>(game.snakes().size())))
+		{
+			if (const auto result = tablebase->probe(game, id))
+			{
+				m_stats.pv = { result->action };
+				return result->action;
+			}
+		}
+
+		if (const auto book = OpeningBook::Find(game.field().size(), static_cast<int32>(game.snakes().size())))
+		{
+			if (const auto action = book->probe(game, id))
+			{
+				m_stats.pv = { *action };
+				return *action;
+			}
+		}
+	}
+
+	// 共有のスナップショットが無い場合は自分で作成する
+	std::shared_ptr<const StepSnapshot> ownSnapshot;
+	const StepSnapshot* snapshot = context.snapshotOf(game);
+	if (not snapshot)
+	{
+		ownSnapshot = StepSnapshot::Create(game);
+		snapshot = ownSnapshot.get();
+	}
+
+	prepare(*snapshot, id, team, reserved);
+	m_context = &context;
+	m_stopped = false;
+
+	const Side& self = m_sides[0];
+	const Point rootPos = self.position;
+	const Direction rootDir = self.direction;
+
+	// 期限がある場合は期限まで深く読む
+	const auto startTime = std::chrono::steady_clock::now();
+	const int maxDepth = context.deadline ? MaxPly - 2 : MaxDepth;
+
+	// 反復深化: 浅い探索の結果で置換表, キラームーブ, ヒストリーを育てる
+	Move bestMove = NoMove;
+	for (int depth = 2; depth <= maxDepth; depth += 2)
+	{
+		int32 alpha = -Infinity;
+		Move iterationBest = NoMove;
+		for (const Move move : orderMoves(0, 0, bestMove))
+		{
+			const Direction nextDir = Util::DoAction(rootDir, static_cast<SnakeAction>(move - 1));
+			const Point nextPos = rootPos + Util::ToPoint(nextDir);
+			if (not m_occupied.inBounds(nextPos) || m_occupied.test(nextPos))
+			{
+				continue;
+			}
+
+			// 何も読めずに打ち切られた場合に備える
+			if (bestMove == NoMove && iterationBest == NoMove)
+			{
+				iterationBest = move;
+			}
+
+			makeMove(0, nextPos, nextDir);
+			const int32 value = ValueScale - search(depth - 1, ValueScale - Infinity, ValueScale - alpha, 1);
+			unmakeMove(0, rootPos, rootDir);
+
+			if (m_stopped)
+			{
+				break;
+			}
+
+			if (value > alpha)
+			{
+				alpha = value;
+				iterationBest = move;
+			}
+		}
+
+		// 動ける手が無い
+		if (iterationBest == NoMove)
+		{
+			break;
+		}
+
+		// 打ち切られた反復でも, 読み終えた手の中で前の反復の最善手以上のものを採用する
+		bestMove = iterationBest;
+		if (m_stopped)
+		{
+			break;
+		}
+		m_stats.depth = depth;
+
+		// 次の反復は今までの合計以上に時間がかかるため, 期限の半分を過ぎたら打ち切る
+		if (context.deadline &&
+			std::chrono::steady_clock::now() - startTime > (*context.deadline - startTime) / 2)
+		{
+			break;
+		}
+	}
+
+	m_context = nullptr;
+
+	if (bestMove == NoMove)
+	{
+		return SnakeAction::MoveStraight;
+	}
+	collectPV(bestMove, m_stats.depth);
+	return static_cast<SnakeAction>(bestMove - 1);
+}
+
+void SolverAlphaBeta::prepare(const StepSnapshot& snapshot, SnakeID id, const Array<SnakeID>& team, const Array<Point>& reserved)
+{
+	const Game& game = snapshot.game();
+	const Size fieldSize = game.field().size();
+	const int32 cellCount = fieldSize.x * fieldSize.y;
+
+	// フィールドサイズが変わった場合はハッシュテーブルを作り直す
+	if (m_cellKeys.size() != static_cast<size_t>(cellCount))
+	{
+		m_cellKeys.resize(cellCount);
+		for (auto& key : m_cellKeys)
+		{
+			key = RandomUint64();
+		}
+		for (auto& keys : m_headKeys)
+		{
+			keys.resize(cellCount * 8);
+			for (auto& key : keys)
+			{
+				key = RandomUint64();
+			}
+		}
+		m_sideKey = RandomUint64();
+
+		m_table.assign(TableSize, TableEntry{});
+		for (auto& history : m_history)
+		{
+			history.assign(cellCount * 8, 0);
+		}
+	}
+	else
+	{
+		// 前のターンのヒストリーは半分の重みで引き継ぐ
+		for (auto& history : m_history)
+		{
+			for (auto& value : history)
+			{
+				value /= 2;
+			}
+		}
+	}
+
+	for (auto& killers : m_killers)
+	{
+		killers.fill(NoMove);
+	}
+
+	m_occupied = snapshot.occupied();
+	for (const Point pos : reserved)
+	{
+		if (m_occupied.inBounds(pos))
+		{
+			m_occupied.set(pos);
+		}
+	}
+
+	// 自分と, 最も早く同じマスに到達できる相手 (味方は除く)
+	// 領域が分かれていて出会えない相手しかいない場合は, 頭の位置が最も近い相手
+	const auto& snakes = game.snakes();
+	const auto& self = snakes[id];
+	m_sides[0] = Side{ id, self.position, self.direction, true };
+	m_sides[1] = Side{ id, Point{ -1, -1 }, Direction::Up, false };
+
+	std::pair<int32, int32> minDistance{ std::numeric_limits<int32>::max(), std::numeric_limits<int32>::max() };
+	for (const auto [snakeId, snake] : Indexed(snakes))
+	{
+		if (team.contains(SnakeID(snakeId)) || snake.state == SnakeState::Dead)
+		{
+			continue;
+		}
+
+		const Point diff = snake.position - self.position;
+		const std::pair<int32, int32> distance{
+			snapshot.contactDistance(id, SnakeID(snakeId)).value_or(std::numeric_limits<int32>::max()),
+			Max(Abs(diff.x), Abs(diff.y)) };
+		if (distance < minDistance)
+		{
+			minDistance = distance;
+			m_sides[1] = Side{ SnakeID(snakeId), snake.position, snake.direction, true };
+		}
+	}
+
+	m_hash = 0;
+	for (const int32 idx : Iota(cellCount))
+	{
+		if (m_occupied.test(idx))
+		{
+			m_hash ^= m_cellKeys[idx];
+		}
+	}
+	for (const int side : Iota(2))
+	{
+		if (m_sides[side].alive)
+		{
+			m_hash ^= headKey(side, m_sides[side].position, m_sides[side].direction);
+		}
+	}
+
+	m_useEvaluator = m_evaluator.isAvailable(fieldSize);
+	if (m_useEvaluator)
+	{
+		// 2匹の頭の特徴量は探索中の位置で付け直す
+		for (const int side : Iota(2))
+		{
+			const Side& s = m_sides[side];
+			const Side& other = m_sides[side ^ 1];
+			if (not s.alive)
+			{
+				continue;
+			}
+
+			m_evaluator.refresh(m_accumulators[side], NNEvaluator::ActiveFeatures(game, s.id));
+			for (const Point pos : reserved)
+			{
+				if (m_occupied.inBounds(pos) && game.field()[pos] == CellState::Unallocated)
+				{
+					m_evaluator.addFeature(m_accumulators[side], NNEvaluator::OccupiedFeature(m_occupied.index(pos)));
+				}
+			}
+			m_evaluator.removeFeature(m_accumulators[side], NNEvaluator::OwnHeadFeature(m_occupied.index(s.position), s.direction, cellCount));
+			if (other.alive)
+			{
+				m_evaluator.removeFeature(m_accumulators[side], NNEvaluator::OtherHeadFeature(m_occupied.index(other.position), cellCount));
+			}
+		}
+		for (const int side : Iota(2))
+		{
+			if (m_sides[side].alive)
+			{
+				updateAccumulators(side, m_sides[side].position, m_sides[side].direction, true);
+			}
+		}
+	}
+}
+
+int32 SolverAlphaBeta::search(int depth, int32 alpha, int32 beta, int ply)
+{
+	const int side = ply & 1;
+	Side& s = m_sides[side];
+	const Side& other = m_sides[side ^ 1];
+	m_stats.nodes++;
+	if (m_stopped ||
+		(m_stats.nodes % StopCheckInterval == 0 && m_context->shouldStop()))
+	{
+		m_stopped = true;
+		return 0;
+	}
+
+	if (not s.alive && not other.alive)
+	{
+		return 0;
+	}
+
+	if (depth <= 0 || ply >= MaxPly)
+	{
+		return evaluate(side);
+	}
+
+	// 手番のスネークが死んでいる場合はパス
+	if (not s.alive)
+	{
+		m_hash ^= m_sideKey;
+		const int32 value = -search(depth - 1, -beta, -alpha, ply + 1);
+		m_hash ^= m_sideKey;
+		return value;
+	}
+
+	TableEntry& entry = m_table[m_hash & (TableSize - 1)];
+	Move ttMove = NoMove;
+	m_stats.ttProbes++;
+	if (entry.key == m_hash)
+	{
+		m_stats.ttHits++;
+		ttMove = entry.move;
+		if (entry.depth >= depth)
+		{
+			if (entry.bound == Bound::Exact ||
+				(entry.bound == Bound::Lower && entry.value >= beta) ||
+				(entry.bound == Bound::Upper && entry.value <= alpha))
+			{
+				return entry.value;
+			}
+		}
+	}
+
+	// 到達可能な領域による枝刈り
+	// 手番側の獲得は到達可能なマス数以下, 相手の獲得も同様 (頭同士の衝突で取り消される1マス分を加える)
+	// 8方向に移動できるため, 市松模様の偶奇による上限は成り立たない
+	// 学習済みの評価関数の値は到達可能なマス数で抑えられないため, 使う場合は行わない
+	// 上限はノード毎に打ち切り付きの塗りつぶしで数え直す (差分更新はしない)
+	if (depth >= 2 && not m_useEvaluator)
+	{
+		if (const int32 need = alpha / ValueScale - 1; need >= 0)
+		{
+			const int32 area = reachableCount(s.position, need + 1);
+			if (area <= need)
+			{
+				return (area + 1) * ValueScale;
+			}
+		}
+
+		if (beta < 0)
+		{
+			if (not other.alive)
+			{
+				return 0;
+			}
+
+			if (const int32 need = -beta / ValueScale - 1; need >= 0)
+			{
+				const int32 area = reachableCount(other.position, need + 1);
+				if (area <= need)
+				{
+					return -(area + 1) * ValueScale;
+				}
+			}
+		}
+	}
+
+	const int32 alphaOrig = alpha;
+	const Point prevPos = s.position;
+	const Direction prevDir = s.direction;
+
+	int32 maxValue = -Infinity;
+	Move bestMove = NoMove;
+	int moveCount = 0;
+	for (const Move move : orderMoves(side, ply, ttMove))
+	{
+		const Direction nextDir = Util::DoAction(prevDir, static_cast<SnakeAction>(move - 1));
+		const Point nextPos = prevPos + Util::ToPoint(nextDir);
+		if (not m_occupied.inBounds(nextPos))
+		{
+			continue;
+		}
+
+		int32 value;
+		if (m_occupied.test(nextPos))
+		{
+			// 自分が直前に動いたマスへの移動は頭同士の衝突となり, 2匹とも死ぬ
+			// 自分がそのマスを獲得した分も取り消される
+			if (side == 1 && other.alive && nextPos == other.position)
+			{
+				value = ValueScale;
+			}
+			else
+			{
+				continue;
+			}
+		}
+		else
+		{
+			// 2手目以降は置換表の手, キラームーブ以外を1手浅く読み, αを超えた場合のみ読み直す
+			const int reduction = (moveCount >= 1 && depth >= 3 &&
+				move != ttMove && move != m_killers[ply][0] && move != m_killers[ply][1]) ? 1 : 0;
+
+			makeMove(side, nextPos, nextDir);
+			value = ValueScale - search(depth - 1 - reduction, ValueScale - beta, ValueScale - alpha, ply + 1);
+			if (reduction && value > alpha)
+			{
+				value = ValueScale - search(depth - 1, ValueScale - beta, ValueScale - alpha, ply + 1);
+			}
+			unmakeMove(side, prevPos, prevDir);
+
+			// 打ち切られた探索の値は置換表に残さない
+			if (m_stopped)
+			{
+				return 0;
+			}
+		}
+		moveCount++;
+
+		if (value > maxValue)
+		{
+			maxValue = value;
+			bestMove = move;
+		}
+
+		if (value > alpha)
+		{
+			alpha = value;
+		}
+
+		if (alpha >= beta)
+		{
+			if (m_killers[ply][0] != move)
+			{
+				m_killers[ply][1] = m_killers[ply][0];
+				m_killers[ply][0] = move;
+			}
+			m_history[side][m_occupied.index(nextPos) * 8 + static_cast<int32>(nextDir)] += depth * depth;
+			break;
+		}
+	}
+
+	// 動ける手が無い: 相手は残りの領域を獲得できる
+	if (bestMove == NoMove)
+	{
+		return other.alive ? -reachableCount(other.position) * ValueScale : 0;
+	}
+
+	entry.key = m_hash;
+	entry.value = maxValue;
+	entry.depth = static_cast<int8>(depth);
+	entry.bound = maxValue <= alphaOrig ? Bound::Upper : (maxValue >= beta ? Bound::Lower : Bound::Exact);
+	entry.move = bestMove;
+
+	return maxValue;
+}
+
+void SolverAlphaBeta::collectPV(Move rootMove, int depth)
+{
+	struct Undo
+	{
+		int side;
+
+		Point position;
+
+		Direction direction;
+	};
+	Array<Undo> undoList;
+
+	Move move = rootMove;
+	for (int ply = 0; ply < depth && move != NoMove; ply++)
+	{
+		const int side = ply & 1;
+		const Side& s = m_sides[side];
+		if (not s.alive)
+		{
+			break;
+		}
+
+		const SnakeAction action = static_cast<SnakeAction>(move - 1);
+		const Direction nextDir = Util::DoAction(s.direction, action);
+		const Point nextPos = s.position + Util::ToPoint(nextDir);
+		if (not m_occupied.inBounds(nextPos) || m_occupied.test(nextPos))
+		{
+			break;
+		}
+
+		m_stats.pv.push_back(action);
+		undoList.push_back(Undo{ side, s.position, s.direction });
+		makeMove(side, nextPos, nextDir);
+
+		const TableEntry& entry = m_table[m_hash & (TableSize - 1)];
+		move = entry.key == m_hash ? entry.move : NoMove;
+	}
+
+	for (const auto& undo : undoList.reversed())
+	{
+		unmakeMove(undo.side, undo.position, undo.direction);
+	}
+}
+
+void SolverAlphaBeta::makeMove(int side, Point position, Direction direction)
+{
+	Side& s = m_sides[side];
+	const int32 idx = m_occupied.index(position);
+
+	m_hash ^= headKey(side, s.position, s.direction) ^ headKey(side, position, direction) ^ m_cellKeys[idx] ^ m_sideKey;
+	m_occupied.set(idx);
+	if (m_useEvaluator)
+	{
+		updateAccumulators(side, s.position, s.direction, false);
+		for (auto& accumulator : m_accumulators)
+		{
+			m_evaluator.addFeature(accumulator, NNEvaluator::OccupiedFeature(idx));
+		}
+		updateAccumulators(side, position, direction, true);
+	}
+
+	s.position = position;
+	s.direction = direction;
+}
+
+void SolverAlphaBeta::unmakeMove(int side, Point prevPosition, Direction prevDirection)
+{
+	Side& s = m_sides[side];
+	const int32 idx = m_occupied.index(s.position);
+
+	m_hash ^= headKey(side, s.position, s.direction) ^ headKey(side, prevPosition, prevDirection) ^ m_cellKeys[idx] ^ m_sideKey;
+	m_occupied.reset(idx);
+	if (m_useEvaluator)
+	{
+		updateAccumulators(side, s.position, s.direction, false);
+		for (auto& accumulator : m_accumulators)
+		{
+			m_evaluator.removeFeature(accumulator, NNEvaluator::OccupiedFeature(idx));
+		}
+		updateAccumulators(side, prevPosition, prevDirection, true);
+	}
+
+	s.position = prevPosition;
+	s.direction = prevDirection;
+}
+
+std::array<SolverAlphaBeta::Move, 3> SolverAlphaBeta::orderMoves(int side, int ply, Move ttMove) const
+{
+	const Side& s = m_sides[side];
+
+	// 置換表の手 > キラームーブ > ヒストリーの順
+	std::array<Move, 3> moves{ 0, 1, 2 };
+	std::array<int32, 3> scores{};
+	for (const Move move : moves)
+	{
+		const Direction nextDir = Util::DoAction(s.direction, static_cast<SnakeAction>(move - 1));
+		const Point nextPos = s.position + Util::ToPoint(nextDir);
+
+		int32& score = scores[move];
+		if (move == ttMove)
+		{
+			score = 1 << 30;
+		}
+		else if (move == m_killers[ply][0])
+		{
+			score = 1 << 29;
+		}
+		else if (move == m_killers[ply][1])
+		{
+			score = 1 << 28;
+		}
+		else if (m_occupied.inBounds(nextPos))
+		{
+			score = m_history[side][m_occupied.index(nextPos) * 8 + static_cast<int32>(nextDir)];
+		}
+		else
+		{
+			score = -1;
+		}
+	}
+
+	std::stable_sort(moves.begin(), moves.end(), [&](Move a, Move b) { return scores[a] > scores[b]; });
+	return moves;
+}
+
+int32 SolverAlphaBeta::evaluate(int side)
+{
+	const Side& s = m_sides[side];
+	const Side& other = m_sides[side ^ 1];
+
+	if (not other.alive)
+	{
+		return s.alive ? reachableCount(s.position) * ValueScale : 0;
+	}
+	if (not s.alive)
+	{
+		return -reachableCount(other.position) * ValueScale;
+	}
+
+	if (m_useEvaluator)
+	{
+		return static_cast<int32>(m_evaluator.evaluate(m_accumulators[side]) * ValueScale);
+	}
+
+	// ボロノイ領域: 先に到達できるマスの数の差 (同時に到達するマスはどちらにも数えない)
+	const int32 width = m_occupied.size().x;
+	m_distance.assign(m_occupied.cellCount(), -1);
+	m_owner.resize(m_occupied.cellCount());
+	m_queue.clear();
+	for (const int owner : Iota(2))
+	{
+		const int32 idx = m_occupied.index(m_sides[side ^ owner].position);
+		m_distance[idx] = 0;
+		m_owner[idx] = static_cast<int8>(owner);
+		m_queue.push_back(idx);
+	}
+
+	for (size_t i = 0; i < m_queue.size(); i++)
+	{
+		const int32 idx = m_queue[i];
+		const Point pos{ idx % width, idx / width };
+		for (int32 dir : Iota(8))
+		{
+			const Point nextPos = pos + Util::ToPoint(Direction(dir));
+			if (not m_occupied.inBounds(nextPos) || m_occupied.test(nextPos))
+			{
+				continue;
+			}
+
+			const int32 nextIdx = m_occupied.index(nextPos);
+			if (m_distance[nextIdx] < 0)
+			{
+				m_distance[nextIdx] = m_distance[idx] + 1;
+				m_owner[nextIdx] = m_owner[idx];
+				m_queue.push_back(nextIdx);
+			}
+			else if (m_distance[nextIdx] == m_distance[idx] + 1 && m_owner[nextIdx] != m_owner[idx])
+			{
+				m_owner[nextIdx] = -1;
+			}
+		}
+	}
+
+	int32 value = 0;
+	for (const int32 idx : m_queue)
+	{
+		if (m_distance[idx] > 0 && m_owner[idx] >= 0)
+		{
+			value += m_owner[idx] == 0 ? 1 : -1;
+		}
+	}
+
+	return value * ValueScale;
+}
+
+int32 SolverAlphaBeta::reachableCount(Point position, int32 limit)
+{
+	m_floodVisited = m_occupied;
+	m_queue.clear();
+	m_queue.push_back(m_occupied.index(position));
+
+	int32 count = 0;
+	while (not m_queue.isEmpty() && count < limit)
+	{
+		const int32 idx = m_queue.back();
+		m_queue.pop_back();
+
+		const Point pos{ idx % m_occupied.size().x, idx / m_occupied.size().x };
+		for (int32 dir : Iota(8))
+		{
+			const Point nextPos = pos + Util::ToPoint(Direction(dir));
+			if (m_floodVisited.inBounds(nextPos) && not m_floodVisited.test(nextPos))
+			{
+				m_floodVisited.set(nextPos);
+				m_queue.push_back(m_floodVisited.index(nextPos));
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+void SolverAlphaBeta::updateAccumulators(int side, Point position, Direction direction, bool add)
+{
+	const int32 cellCount = m_occupied.cellCount();
+	const int32 idx = m_occupied.index(position);
+	const uint32 ownFeature = NNEvaluator::OwnHeadFeature(idx, direction, cellCount);
+	const uint32 otherFeature = NNEvaluator::OtherHeadFeature(idx, cellCount);
+
+	if (add)
+	{
+		m_evaluator.addFeature(m_accumulators[side], ownFeature);
+		m_evaluator.addFeature(m_accumulators[side ^ 1], otherFeature);
+	}
+	else
+	{
+		m_evaluator.removeFeature(m_accumulators[side], ownFeature);
+		m_evaluator.removeFeature(m_accumulators[side ^ 1], otherFeature);
+	}
+}
+
+std::unique_ptr<Solver> CreateSolverAlphaBeta()
+{
+	return std::make_unique<SolverAlphaBeta>();
+}
@@ -0,0 +1,158 @@
+﻿#pragma once
+#include "Solver.hpp"
+#include "Bitboard.hpp"
+#include "NNEvaluator.hpp"
+
+/// @brief 最も近い相手との2人対戦とみなしてαβ探索を行うソルバー
+/// @remark 自分 -> 相手 の順に交互に動くものとし, 相手は自分の手を見てから動けるとみなします(悲観的)
+/// 評価値は「以降に自分が獲得するマス数 - 相手が獲得するマス数」で, 末端は学習済みの評価関数かボロノイ領域で評価します
+class SolverAlphaBeta : public Solver
+{
+	// 期限が無い場合の探索深さ (手番数)
+	constexpr static int MaxDepth = 12;
+
+	// 1マスあたりの評価値
+	constexpr static int32 ValueScale = 16;
+
+	constexpr static int32 Infinity = 1 << 28;
+
+	constexpr static size_t TableSize = size_t(1) << 18;
+
+	constexpr static int MaxPly = 64;
+
+	// 打ち切りを確認する間隔 (ノード数)
+	constexpr static uint64 StopCheckInterval = 4096;
+
+	// 手: 0 = 左, 1 = 直進, 2 = 右
+	using Move = int8;
+
+	constexpr static Move NoMove = -1;
+
+public:
+
+	SolverAlphaBeta();
+
+	SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id, const SolveContext& context) override;
+
+	/// @remark 先に決めた味方の移動先を確保済みとみなして順に探索し, 置換表, ヒストリーを共有します
+	/// 味方は相手として扱いません
+	Array<SuperSnake::SnakeAction> solveJoint(const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids, const SolveContext& context) override;
+
+	bool searchesJointly() const override { return true; }
+
+	Optional<SolverStats> stats() const override { return m_stats; }
+
+private:
+
+	enum class Bound : uint8
+	{
+		Exact,
+		Lower,
+		Upper
+	};
+
+	struct TableEntry
+	{
+		uint64 key = 0;
+
+		int32 value = 0;
+
+		int8 depth = -1;
+
+		Bound bound = Bound::Exact;
+
+		Move move = NoMove;
+	};
+
+	struct Side
+	{
+		SuperSnake::SnakeID id;
+
+		Point position;
+
+		SuperSnake::Direction direction;
+
+		bool alive;
+	};
+
+	// 置換表
+	Array<TableEntry> m_table;
+
+	// ZobristHash用ハッシュテーブル
+	// マス用
+	Array<uint64> m_cellKeys;
+	// 頭の位置と向き用 [手番][マス * 8 + 向き]
+	std::array<Array<uint64>, 2> m_headKeys;
+	// 手番用
+	uint64 m_sideKey = 0;
+
+	// キラームーブ [ply][2]
+	std::array<std::array<Move, 2>, MaxPly> m_killers;
+
+	// ヒストリー [手番][移動先のマス * 8 + 向き]
+	std::array<Array<int32>, 2> m_history;
+
+	// 探索中の局面
+	SuperSnake::Bitboard m_occupied;
+
+	// 0: 自分, 1: 相手
+	std::array<Side, 2> m_sides;
+
+	uint64 m_hash = 0;
+
+	NNEvaluator m_evaluator;
+
+	bool m_useEvaluator = false;
+
+	// 各手番から見た第1層
+	std::array<NNEvaluator::Accumulator, 2> m_accumulators;
+
+	// 評価用の作業領域
+	Array<int32> m_queue;
+
+	Array<int32> m_distance;
+
+	Array<int8> m_owner;
+
+	SuperSnake::Bitboard m_floodVisited;
+
+	SolverStats m_stats;
+
+	const SolveContext* m_context = nullptr;
+
+	// 打ち切られた
+	bool m_stopped = false;
+
+	// team: 味方 (相手として扱わない), reserved: 味方の移動先
+	void prepare(const StepSnapshot& snapshot, SuperSnake::SnakeID id, const Array<SuperSnake::SnakeID>& team, const Array<Point>& reserved);
+
+	SuperSnake::SnakeAction searchRoot(const SuperSnake::Game& game, SuperSnake::SnakeID id, const Array<SuperSnake::SnakeID>& team, const Array<Point>& reserved, const SolveContext& context);
+
+	int32 search(int depth, int32 alpha, int32 beta, int ply);
+
+	// 置換表をたどって読み筋を集める
+	void collectPV(Move rootMove, int depth);
+
+	// 着手
+	void makeMove(int side, Point position, SuperSnake::Direction direction);
+
+	// 戻し
+	void unmakeMove(int side, Point prevPosition, SuperSnake::Direction prevDirection);
+
+	std::array<Move, 3> orderMoves(int side, int ply, Move ttMove) const;
+
+	// sideから見た評価値
+	int32 evaluate(int side);
+
+	// positionから到達可能なマス数 (limitに達したら数えるのをやめます)
+	int32 reachableCount(Point position, int32 limit = std::numeric_limits<int32>::max());
+
+	uint64 headKey(int side, Point position, SuperSnake::Direction direction) const
+	{
+		return m_headKeys[side][m_occupied.index(position) * 8 + static_cast<int32>(direction)];
+	}
+
+	void updateAccumulators(int side, Point position, SuperSnake::Direction direction, bool add);
+};
+
+std::unique_ptr<Solver> CreateSolverAlphaBeta();
@@ -0,0 +1,62 @@
+﻿#include "SolverArena.hpp"
+
+void SolverArena::reset(Size fieldSize)
+{
+	// 前回足りなかった分も含めて1つのブロックにまとめる
+	const size_t required = std::max({
+		MinBlockSize,
+		static_cast<size_t>(fieldSize.x) * fieldSize.y * BytesPerCell,
+		used() });
+
+	if (m_blocks.size() != 1 || m_blocks.front().size < required)
+	{
+		m_blocks.clear();
+		addBlock(required);
+	}
+
+	m_current = 0;
+	m_offset = 0;
+	m_usedInFullBlocks = 0;
+}
+
+size_t SolverArena::capacity() const
+{
+	size_t total = 0;
+	for (const auto& block : m_blocks)
+	{
+		total += block.size;
+	}
+	return total;
+}
+
+void SolverArena::addBlock(size_t minSize)
+{
+	// 足りなくなるたびに合計容量を倍にする
+	const size_t size = Max(minSize, Max(capacity(), MinBlockSize));
+	m_blocks.push_back(Block{ .data = std::make_unique_for_overwrite<Byte[]>(size), .size = size });
+}
+
+void* SolverArena::do_allocate(size_t bytes, size_t alignment)
+{
+	while (m_current < m_blocks.size())
+	{
+		Block& block = m_blocks[m_current];
+		void* ptr = block.data.get() + m_offset;
+		size_t space = block.size - m_offset;
+		if (std::align(alignment, bytes, ptr, space))
+		{
+			m_offset = block.size - space + bytes;
+			return ptr;
+		}
+
+		// 次のブロックへ
+		m_usedInFullBlocks += m_offset;
+		m_current++;
+		m_offset = 0;
+	}
+
+	addBlock(bytes + alignment);
+	m_current = m_blocks.size() - 1;
+	m_offset = 0;
+	return do_allocate(bytes, alignment);
+}
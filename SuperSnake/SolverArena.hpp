@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <memory_resource>
+#include <Siv3D.hpp>
+
+/// @brief 1ターンの探索の作業領域を確保するアロケーター
+/// @remark 先頭から順に確保し, 個別には解放しません. reset でまとめて解放します
+/// 容量が足りない場合はブロックを追加し, 次の reset で1つのブロックにまとめるため, 同じ規模の探索が続けばヒープを使わなくなります
+/// スレッドセーフではありません
+class SolverArena : public std::pmr::memory_resource
+{
+public:
+
+	// 1マスあたりの初期容量
+	static constexpr size_t BytesPerCell = 1024;
+
+	static constexpr size_t MinBlockSize = 64 * 1024;
+
+	SolverArena() = default;
+
+	SolverArena(const SolverArena&) = delete;
+
+	SolverArena& operator=(const SolverArena&) = delete;
+
+	/// @brief 全ての確保を解放し, 次の探索に備えます
+	/// @remark 確保した領域を参照するオブジェクトは, 呼び出す前に破棄してください
+	/// @param fieldSize フィールドサイズ (初期容量の目安)
+	void reset(Size fieldSize);
+
+	/// @brief 前回の reset 以降に確保したバイト数
+	size_t used() const { return m_usedInFullBlocks + m_offset; }
+
+	/// @brief 確保済みのブロックの合計バイト数
+	size_t capacity() const;
+
+private:
+
+	struct Block
+	{
+		std::unique_ptr<Byte[]> data;
+
+		size_t size = 0;
+	};
+
+	Array<Block> m_blocks;
+
+	// 確保中のブロック
+	size_t m_current = 0;
+
+	// 確保中のブロックの使用済みバイト数
+	size_t m_offset = 0;
+
+	// 使い切ったブロックの使用済みバイト数
+	size_t m_usedInFullBlocks = 0;
+
+	void addBlock(size_t minSize);
+
+	void* do_allocate(size_t bytes, size_t alignment) override;
+
+	void do_deallocate(void*, size_t, size_t) override { }
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
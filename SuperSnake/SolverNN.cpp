@@ -0,0 +1,190 @@
+﻿#include "SolverNN.hpp"
+#include "OpeningBook.hpp"
+#include "Tablebase.hpp"
+#include "Config.hpp"
+
+using namespace SuperSnake;
+
+SolverNN::SolverNN()
+	: m_evaluator(EvalWeightsPath)
+{ }
+
+SnakeAction SolverNN::solve(const Game& game, SnakeID id, const SolveContext& context)
+{
+	const auto& snake = game.snakes()[id];
+	const Size fieldSize = game.field().size();
+
+	// 終盤データベース, 定跡に含まれる局面であれば探索しない
+	if (const auto tablebase = Tablebase::Find(fieldSize, static_cast<int32>(game.snakes().size())))
+	{
+		if (const auto result = tablebase->probe(game, id))
+		{
+			m_stats = SolverStats{};
+			m_stats.pv = { result->action };
+			return result->action;
+		}
+	}
+
+	if (const auto book = OpeningBook::Find(fieldSize, static_cast<int32>(game.snakes().size())))
+	{
+		if (const auto action = book->probe(game, id))
+		{
+			m_stats = SolverStats{};
+			m_stats.pv = { *action };
+			return *action;
+		}
+	}
+
+	m_stats = SolverStats{};
+	m_context = &context;
+	m_stopped = false;
+	if (const auto snapshot = context.snapshotOf(game))
+	{
+		m_occupied = snapshot->occupied();
+	}
+	else
+	{
+		m_occupied = Bitboard::FromField(game.field());
+	}
+	m_useEvaluator = m_evaluator.isAvailable(fieldSize);
+	if (m_useEvaluator)
+	{
+		m_evaluator.refresh(m_accumulator, NNEvaluator::ActiveFeatures(game, id));
+		// 頭の特徴量は探索中の位置で付け直す
+		m_evaluator.removeFeature(m_accumulator, NNEvaluator::OwnHeadFeature(m_occupied.index(snake.position), snake.direction, m_occupied.cellCount()));
+	}
+
+	double maxValue = -std::numeric_limits<double>::infinity();
+	SnakeAction bestAction = SnakeAction::MoveStraight;
+	for (int i : Range(-1, 1))
+	{
+		const SnakeAction action = static_cast<SnakeAction>(i);
+		const Direction nextDir = Util::DoAction(snake.direction, action);
+		const Point nextPos = snake.position + Util::ToPoint(nextDir);
+
+		double value = DeadValue;
+		if (m_occupied.inBounds(nextPos) && not m_occupied.test(nextPos))
+		{
+			value = search(nextPos, nextDir, MaxDepth - 1);
+		}
+
+		// 打ち切られた場合はそれまでの最善手
+		if (m_stopped)
+		{
+			break;
+		}
+
+		if (value > maxValue)
+		{
+			bestAction = action;
+			maxValue = value;
+		}
+	}
+
+	m_context = nullptr;
+	// 深さを固定して読むため, 打ち切られた場合は読み切った深さが無い
+	m_stats.depth = m_stopped ? 0 : MaxDepth;
+	m_stats.pv = { bestAction };
+	return bestAction;
+}
+
+double SolverNN::search(Point position, Direction direction, int depth)
+{
+	const int32 cellCount = m_occupied.cellCount();
+	const int32 posIdx = m_occupied.index(position);
+	m_stats.nodes++;
+	if (m_stopped ||
+		(m_stats.nodes % StopCheckInterval == 0 && m_context->shouldStop()))
+	{
+		m_stopped = true;
+		return DeadValue;
+	}
+
+	// 着手
+	m_occupied.set(posIdx);
+	if (m_useEvaluator)
+	{
+		m_evaluator.addFeature(m_accumulator, NNEvaluator::OccupiedFeature(posIdx));
+		m_evaluator.addFeature(m_accumulator, NNEvaluator::OwnHeadFeature(posIdx, direction, cellCount));
+	}
+
+	double maxValue = DeadValue + (MaxDepth - depth);
+	if (depth <= 0)
+	{
+		maxValue = evaluate(position);
+	}
+	else
+	{
+		for (int i : Range(-1, 1))
+		{
+			const Direction nextDir = Util::DoAction(direction, static_cast<SnakeAction>(i));
+			const Point nextPos = position + Util::ToPoint(nextDir);
+			if (not m_occupied.inBounds(nextPos) || m_occupied.test(nextPos))
+			{
+				continue;
+			}
+
+			if (m_useEvaluator)
+			{
+				m_evaluator.removeFeature(m_accumulator, NNEvaluator::OwnHeadFeature(posIdx, direction, cellCount));
+			}
+			maxValue = Max(maxValue, search(nextPos, nextDir, depth - 1));
+			if (m_useEvaluator)
+			{
+				m_evaluator.addFeature(m_accumulator, NNEvaluator::OwnHeadFeature(posIdx, direction, cellCount));
+			}
+		}
+	}
+
+	// 戻し
+	m_occupied.reset(posIdx);
+	if (m_useEvaluator)
+	{
+		m_evaluator.removeFeature(m_accumulator, NNEvaluator::OwnHeadFeature(posIdx, direction, cellCount));
+		m_evaluator.removeFeature(m_accumulator, NNEvaluator::OccupiedFeature(posIdx));
+	}
+
+	return maxValue;
+}
+
+double SolverNN::evaluate(Point position)
+{
+	if (m_useEvaluator)
+	{
+		return m_evaluator.evaluate(m_accumulator);
+	}
+	return reachableCount(position);
+}
+
+int32 SolverNN::reachableCount(Point position)
+{
+	m_floodVisited = m_occupied;
+	m_floodStack.clear();
+	m_floodStack.push_back(m_occupied.index(position));
+
+	int32 count = 0;
+	while (not m_floodStack.isEmpty())
+	{
+		const int32 idx = m_floodStack.back();
+		m_floodStack.pop_back();
+
+		const Point pos{ idx % m_occupied.size().x, idx / m_occupied.size().x };
+		for (int32 dir : Iota(8))
+		{
+			const Point nextPos = pos + Util::ToPoint(Direction(dir));
+			if (m_floodVisited.inBounds(nextPos) && not m_floodVisited.test(nextPos))
+			{
+				m_floodVisited.set(nextPos);
+				m_floodStack.push_back(m_floodVisited.index(nextPos));
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+std::unique_ptr<Solver> CreateSolverNN()
+{
+	return std::make_unique<SolverNN>();
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+#include "Solver.hpp"
+#include "Bitboard.hpp"
+#include "NNEvaluator.hpp"
+
+/// @brief 自分の手を浅く読み, 末端を学習済みの評価関数で評価するソルバー
+/// @remark 重みがフィールドサイズに対応していない場合は到達可能なマス数で評価します
+class SolverNN : public Solver
+{
+	constexpr static int MaxDepth = 6;
+
+	constexpr static double DeadValue = -10000;
+
+	// 打ち切りを確認する間隔 (ノード数)
+	constexpr static uint64 StopCheckInterval = 1024;
+
+public:
+
+	SolverNN();
+
+	SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id, const SolveContext& context) override;
+
+	Optional<SolverStats> stats() const override { return m_stats; }
+
+private:
+
+	NNEvaluator m_evaluator;
+
+	bool m_useEvaluator = false;
+
+	// 確保済みのマス
+	SuperSnake::Bitboard m_occupied;
+
+	NNEvaluator::Accumulator m_accumulator;
+
+	// 塗りつぶし用
+	Array<int32> m_floodStack;
+
+	SuperSnake::Bitboard m_floodVisited;
+
+	SolverStats m_stats;
+
+	const SolveContext* m_context = nullptr;
+
+	// 打ち切られた
+	bool m_stopped = false;
+
+	double search(Point position, SuperSnake::Direction direction, int depth);
+
+	double evaluate(Point position);
+
+	// positionから到達可能なマス数
+	int32 reachableCount(Point position);
+};
+
+std::unique_ptr<Solver> CreateSolverNN();
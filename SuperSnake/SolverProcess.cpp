@@ -0,0 +1,168 @@
+﻿#include <condition_variable>
+#include "SolverProcess.hpp"
+#include "EngineProtocol.hpp"
+#include "Config.hpp"
+
+using namespace SuperSnake;
+
+SolverProcess::SolverProcess(FilePathView path, StringView commandLine)
+	: m_path(path)
+	, m_commandLine(commandLine)
+{ }
+
+SolverProcess::~SolverProcess()
+{
+	if (m_process.isRunning())
+	{
+		m_process.terminate();
+	}
+}
+
+SnakeAction SolverProcess::solve(const Game& game, SnakeID id, const SolveContext& context)
+{
+	return solveJoint(game, { id }, context).front();
+}
+
+Array<SnakeAction> SolverProcess::solveJoint(const Game& game, const Array<SnakeID>& ids, const SolveContext& context)
+{
+	m_stats = SolverStats{};
+
+	// 起動できない場合は設定の誤りなので, 安全な手で代用せずに知らせる
+	if (not ensureProcess())
+	{
+		throw Error{ U"failed to start the engine: {}"_fmt(m_path) };
+	}
+
+	if (const auto actions = request(game, ids, context))
+	{
+		return *actions;
+	}
+
+	// プロセスを破棄し, 次の手番で起動し直す
+	if (m_process.isRunning())
+	{
+		m_process.terminate();
+	}
+	m_process = ChildProcess{};
+
+	return ids.map([&](SnakeID id) { return FallbackAction(game, id); });
+}
+
+bool SolverProcess::ensureProcess()
+{
+	if (m_process.isRunning())
+	{
+		return true;
+	}
+
+	m_process = ChildProcess{ m_path, m_commandLine, Pipe::StdInOut };
+	return m_process.isValid();
+}
+
+Optional<Array<SnakeAction>> SolverProcess::request(const Game& game, const Array<SnakeID>& ids, const SolveContext& context)
+{
+	const uint32 requestId = m_nextRequestId++;
+	uint32 timeLimitMs = 0;
+	if (context.deadline)
+	{
+		const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(*context.deadline - std::chrono::steady_clock::now());
+		timeLimitMs = static_cast<uint32>(Max<int64>(remaining.count(), 1));
+	}
+
+	// 停止要求が来た場合, 期限を過ぎても応答が無い場合はプロセスを終了させて読み込みを中断する
+	ChildProcess& process = m_process;
+	std::stop_callback onStop(context.stopToken, [&process] { process.terminate(); });
+	std::jthread watchdog;
+	if (context.deadline)
+	{
+		const auto limit = *context.deadline + std::chrono::duration_cast<std::chrono::steady_clock::duration>(ResponseGracePeriod);
+		watchdog = std::jthread([&process, limit](std::stop_token stopToken) {
+			std::mutex mutex;
+			std::condition_variable_any cv;
+			std::unique_lock lock(mutex);
+			cv.wait_until(lock, stopToken, limit, [] { return false; });
+			if (not stopToken.stop_requested())
+			{
+				process.terminate();
+			}
+		});
+	}
+
+	const auto message = EngineProtocol::EncodeMessage(
+		EngineProtocol::MessageType::Solve,
+		EngineProtocol::EncodeSolveRequest(requestId, timeLimitMs, game, ids));
+	std::ostream& os = process.ostream();
+	os.write(reinterpret_cast<const char*>(message.data()), message.size());
+	os.flush();
+	if (not os)
+	{
+		return none;
+	}
+
+	std::istream& is = process.istream();
+	while (true)
+	{
+		std::array<Byte, sizeof(EngineProtocol::MessageHeader)> headerBytes;
+		if (not is.read(reinterpret_cast<char*>(headerBytes.data()), headerBytes.size()))
+		{
+			return none;
+		}
+
+		const auto header = EngineProtocol::DecodeHeader(headerBytes.data());
+		if (not header)
+		{
+			return none;
+		}
+
+		Array<Byte> payload(header->size);
+		if (not is.read(reinterpret_cast<char*>(payload.data()), payload.size()))
+		{
+			return none;
+		}
+
+		if (header->type != EngineProtocol::MessageType::Result)
+		{
+			continue;
+		}
+
+		const auto response = EngineProtocol::DecodeSolveResponse(payload);
+		if (not response)
+		{
+			return none;
+		}
+
+		// 以前の要求への応答は読み飛ばす
+		if (response->requestId != requestId)
+		{
+			continue;
+		}
+
+		if (response->actions.size() != ids.size())
+		{
+			return none;
+		}
+
+		m_stats = response->stats;
+		return response->actions;
+	}
+}
+
+SnakeAction SolverProcess::FallbackAction(const Game& game, SnakeID id)
+{
+	const auto& snake = game.snakes()[id];
+	const auto& field = game.field();
+	for (const SnakeAction action : { SnakeAction::MoveStraight, SnakeAction::MoveLeft, SnakeAction::MoveRight })
+	{
+		const Point nextPos = snake.position + Util::ToPoint(Util::DoAction(snake.direction, action));
+		if (field.inBounds(nextPos) && field[nextPos] == CellState::Unallocated)
+		{
+			return action;
+		}
+	}
+	return SnakeAction::MoveStraight;
+}
+
+std::unique_ptr<Solver> CreateSolverProcess()
+{
+	return std::make_unique<SolverProcess>(EngineExecutablePath, U"engine");
+}
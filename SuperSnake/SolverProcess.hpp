@@ -0,0 +1,49 @@
+﻿#pragma once
+#include "Solver.hpp"
+
+/// @brief 子プロセスのエンジンに標準入出力経由で探索させるソルバー
+/// @remark エンジンが異常終了, 応答しない場合は再起動し, その手番は安全な手で代用します
+/// エンジンを起動できない場合は Error を投げます
+/// 通信形式は EngineProtocol.hpp を参照してください
+class SolverProcess : public Solver
+{
+	// 期限を過ぎてから応答を待つ時間
+	constexpr static Duration ResponseGracePeriod = 1s;
+
+public:
+
+	/// @param path エンジンの実行ファイル
+	/// @param commandLine エンジンに渡すコマンドライン引数
+	SolverProcess(FilePathView path, StringView commandLine);
+
+	~SolverProcess();
+
+	SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id, const SolveContext& context) override;
+
+	/// @remark 複数のスネークを1回の要求にまとめて送ります
+	Array<SuperSnake::SnakeAction> solveJoint(const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids, const SolveContext& context) override;
+
+	Optional<SolverStats> stats() const override { return m_stats; }
+
+private:
+
+	FilePath m_path;
+
+	String m_commandLine;
+
+	ChildProcess m_process;
+
+	uint32 m_nextRequestId = 0;
+
+	SolverStats m_stats;
+
+	bool ensureProcess();
+
+	// 要求を送り, 応答を受け取ります
+	Optional<Array<SuperSnake::SnakeAction>> request(const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids, const SolveContext& context);
+
+	// エンジンが使えない場合の手: 壁と確保済みのマスを避ける
+	static SuperSnake::SnakeAction FallbackAction(const SuperSnake::Game& game, SuperSnake::SnakeID id);
+};
+
+std::unique_ptr<Solver> CreateSolverProcess();
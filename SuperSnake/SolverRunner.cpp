@@ -1,60 +1,460 @@
 ﻿#include "SolverRunner.hpp"
+#include "PositionKey.hpp"
 
-void SolverRunner::solve(size_t solverId, const SuperSnake::Game& game, SuperSnake::SnakeID id)
+void SolverRunner::solve(size_t solverId, const SuperSnake::Game& game, SuperSnake::SnakeID id, Optional<Duration> timeLimit)
 {
+	cancelObsolete(game.gameId, game.step());
+
+	auto slot = getSlot(solverId, id);
+	slot->ponderStop.request_stop();
+	if (completeFromSpeculation(solverId, *slot, game, { id }))
+	{
+		return;
+	}
+
 	auto& instance = m_instance.emplace_back(SolverInstance{
 		.solverId = solverId,
 		.snakeId = id,
-		.gameCache = game,
-		.solver = std::move(Solvers[solverId].second())
+		.snapshot = snapshot(game),
+		.slot = slot,
+		.budget = addToBudget(game, timeLimit)
 	});
+	instance.context = SolveContext::WithTimeLimit(instance.stopSource.get_token(), timeLimit);
+	instance.context.arena = &slot->arena;
+	instance.context.snapshot = instance.snapshot.get();
+
+	// 期限の早い探索から実行する
+	const auto deadline = instance.context.deadline.value_or(std::chrono::steady_clock::time_point::max());
+	instance.future = pool().async([this, &instance] {
+		std::lock_guard lock(instance.slot->mutex);
+		instance.slot->arena.reset(instance.snapshot->game().field().size());
+		instance.context.deadline = Allot(*instance.budget);
+
+		SolverResult result = MakeResult(instance);
+		try
+		{
+			const Stopwatch stopwatch{ StartImmediately::Yes };
+			result.action = instance.slot->solver->solve(instance.snapshot->game(), instance.snakeId, instance.context);
+			result.stats = instance.slot->solver->stats().value_or(SolverStats{});
+			result.stats.elapsed = stopwatch.elapsed();
+		}
+		catch (...)
+		{
+			result.error = std::current_exception();
+		}
+		instance.budget->unfinished--;
+		complete(std::move(result));
+	}, deadline).share();
+}
+
+void SolverRunner::solveJoint(size_t solverId, const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids, Optional<Duration> timeLimit)
+{
+	if (ids.size() == 1)
+	{
+		solve(solverId, game, ids.front(), timeLimit);
+		return;
+	}
+
+	// 先頭のスネークのソルバーを代表として使う
+	auto slot = getSlot(solverId, ids.front());
+	if (not slot->solver->searchesJointly())
+	{
+		// 1匹ずつ順に探索するだけなので, スネーク毎のソルバーで並列に探索させる
+		for (const auto id : ids)
+		{
+			solve(solverId, game, id, SplitTimeLimit(timeLimit, ids.size()));
+		}
+		return;
+	}
+
+	cancelObsolete(game.gameId, game.step());
+
+	for (const auto id : ids)
+	{
+		getSlot(solverId, id)->ponderStop.request_stop();
+	}
+	if (completeFromSpeculation(solverId, *slot, game, ids))
+	{
+		return;
+	}
+
+	// スネーク毎にインスタンスを分け, 結果もスネーク毎に通知する
+	std::stop_source stopSource;
+	const auto budget = addToBudget(game, timeLimit);
+	Array<SolverInstance*> instances;
+	for (const auto id : ids)
+	{
+		auto& instance = m_instance.emplace_back(SolverInstance{
+			.solverId = solverId,
+			.snakeId = id,
+			.snapshot = snapshot(game),
+			.slot = slot,
+			.stopSource = stopSource,
+			.budget = budget
+		});
+		instance.context = SolveContext::WithTimeLimit(stopSource.get_token(), timeLimit);
+		instance.context.arena = &slot->arena;
+		instance.context.snapshot = instance.snapshot.get();
+		instances.push_back(&instance);
+	}
+
+	const auto deadline = instances.front()->context.deadline.value_or(std::chrono::steady_clock::time_point::max());
+	const auto future = pool().async([this, ids, instances] {
+		SolverInstance& leader = *instances.front();
+		std::lock_guard lock(leader.slot->mutex);
+		leader.slot->arena.reset(leader.snapshot->game().field().size());
+		leader.context.deadline = Allot(*leader.budget);
 
-	std::packaged_task<SuperSnake::SnakeAction()> task([&] { return instance.solver->solve(instance.gameCache, instance.snakeId); });
-	instance.future = task.get_future();
-	
-	std::thread thread(std::move(task));
-	thread.detach();
+		Array<SolverResult> results = instances.map([](const SolverInstance* instance) { return MakeResult(*instance); });
+		try
+		{
+			const Stopwatch stopwatch{ StartImmediately::Yes };
+			const auto actions = leader.slot->solver->solveJoint(leader.snapshot->game(), ids, leader.context);
+			SolverStats stats = leader.slot->solver->stats().value_or(SolverStats{});
+			stats.elapsed = stopwatch.elapsed();
+
+			for (const size_t idx : Iota(ids.size()))
+			{
+				results[idx].action = actions[idx];
+				results[idx].stats = stats;
+			}
+		}
+		catch (...)
+		{
+			for (auto& result : results)
+			{
+				result.error = std::current_exception();
+			}
+		}
+
+		leader.budget->unfinished--;
+		for (auto& result : results)
+		{
+			complete(std::move(result));
+		}
+	}, deadline).share();
+
+	for (auto* instance : instances)
+	{
+		instance->future = future;
+	}
 }
 
-Optional<SolverRunner::SolverResult> SolverRunner::getResult(SuperSnake::SnakeID id)
+void SolverRunner::ponder(size_t solverId, Array<SuperSnake::Game> candidates, const Array<SuperSnake::SnakeID>& ids, Optional<Duration> timeLimit)
 {
-	auto itr = std::find_if(m_instance.begin(), m_instance.end(), [=](const SolverInstance& s) {
-		return s.snakeId == id && s.future.wait_for(0s) == std::future_status::ready;
+	m_ponderFutures.remove_if([](const std::future<void>& f) {
+		return f.wait_for(0s) == std::future_status::ready;
 	});
 
-	if (itr == m_instance.end())
+	// 先頭のスネークのソルバーを代表として使う (solveJointと同じ)
+	auto slot = getSlot(solverId, ids.front());
+	if (ids.size() > 1 && not slot->solver->searchesJointly())
+	{
+		for (const auto id : ids)
+		{
+			ponder(solverId, candidates, { id }, SplitTimeLimit(timeLimit, ids.size()));
+		}
+		return;
+	}
+
+	if (slot->ponderStop.stop_requested())
+	{
+		slot->ponderStop = std::stop_source{};
+	}
+	const uint64 generation = ++slot->ponderGeneration;
+
+	m_ponderFutures.push_back(pool().async([slot, ids, timeLimit, generation, stopToken = slot->ponderStop.get_token(), candidates = std::move(candidates)] {
+		for (const auto& candidate : candidates)
+		{
+			std::lock_guard lock(slot->mutex);
+			if (stopToken.stop_requested() || slot->ponderGeneration != generation)
+			{
+				return;
+			}
+
+			const uint64 key = SuperSnake::PositionKey(candidate);
+			Array<SuperSnake::SnakeID> aliveIds;
+			for (const auto id : ids)
+			{
+				if (candidate.snakes()[id].state == SuperSnake::SnakeState::Alive)
+				{
+					aliveIds.push_back(id);
+				}
+			}
+			{
+				std::lock_guard speculationLock(slot->speculationMutex);
+				if (aliveIds.isEmpty() || slot->speculations.contains(key))
+				{
+					continue;
+				}
+			}
+
+			slot->arena.reset(candidate.field().size());
+			const auto snapshot = StepSnapshot::Create(candidate);
+			SolveContext context = SolveContext::WithTimeLimit(stopToken, timeLimit);
+			context.arena = &slot->arena;
+			context.snapshot = snapshot.get();
+
+			try
+			{
+				const Stopwatch stopwatch{ StartImmediately::Yes };
+				Speculation speculation{
+					.ids = aliveIds,
+					.actions = slot->solver->solveJoint(snapshot->game(), aliveIds, context)
+				};
+				speculation.stats = slot->solver->stats().value_or(SolverStats{});
+				speculation.stats.elapsed = stopwatch.elapsed();
+
+				// 打ち切られた結果は使わない
+				if (stopToken.stop_requested())
+				{
+					return;
+				}
+
+				std::lock_guard speculationLock(slot->speculationMutex);
+				slot->speculations.emplace(key, std::move(speculation));
+			}
+			catch (...)
+			{
+				return;
+			}
+		}
+	}));
+}
+
+Optional<Duration> SolverRunner::SplitTimeLimit(Optional<Duration> timeLimit, size_t count)
+{
+	if (not timeLimit)
 	{
 		return none;
 	}
+	return *timeLimit / static_cast<double>(count);
+}
+
+bool SolverRunner::completeFromSpeculation(size_t solverId, SolverSlot& slot, const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids)
+{
+	Optional<Speculation> speculation;
+	{
+		std::lock_guard lock(slot.speculationMutex);
+		if (const auto itr = slot.speculations.find(SuperSnake::PositionKey(game));
+			itr != slot.speculations.end() && itr->second.ids == ids)
+		{
+			speculation = std::move(itr->second);
+		}
+		slot.speculations.clear();
+	}
+
+	if (not speculation)
+	{
+		return false;
+	}
+
+	for (const auto [idx, id] : Indexed(ids))
+	{
+		complete(SolverResult{
+			.solverId = solverId,
+			.snakeId = id,
+			.gameId = game.gameId,
+			.step = game.step(),
+			.action = speculation->actions[idx],
+			.stats = speculation->stats
+		});
+	}
+	return true;
+}
+
+Array<SolverRunner::SolverResult> SolverRunner::takeResults()
+{
+	Array<SolverResult> results = m_completions.popAll();
+	if (results.isEmpty())
+	{
+		return results;
+	}
+
+	// 結果を通知し終えたインスタンスを破棄する
+	std::erase_if(m_instance, [](const SolverInstance& instance) {
+		return instance.future.wait_for(0s) == std::future_status::ready;
+	});
+
+	for (const auto& result : results)
+	{
+		writeStatsLog(result);
+	}
 
-	SolverResult result{
-		.solverId = itr->solverId,
-		.snakeId = itr->snakeId,
-		.gameId = itr->gameCache.gameId,
-		.step = itr->gameCache.step(),
-		.future = std::move(itr->future)
+	return results;
+}
+
+std::shared_ptr<const StepSnapshot> SolverRunner::snapshot(const SuperSnake::Game& game)
+{
+	if (not m_snapshot || m_snapshot->game().gameId != game.gameId || m_snapshot->game().step() != game.step())
+	{
+		m_snapshot = StepSnapshot::Create(game);
+	}
+	return m_snapshot;
+}
+
+std::shared_ptr<SolverRunner::StepBudget> SolverRunner::addToBudget(const SuperSnake::Game& game, Optional<Duration> timeLimit)
+{
+	if (not m_budget || m_budget->gameId != game.gameId || m_budget->step != game.step())
+	{
+		m_budget = std::make_shared<StepBudget>(game.gameId, game.step(), static_cast<int32>(pool().workerCount()));
+	}
+
+	// 最も遅い探索の期限までに全ての探索を終える
+	const auto deadline = timeLimit
+		? std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(*timeLimit)
+		: std::chrono::steady_clock::time_point::max();
+	m_budget->deadline = Max(m_budget->deadline.load(), deadline);
+	m_budget->unfinished++;
+
+	return m_budget;
+}
+
+Optional<std::chrono::steady_clock::time_point> SolverRunner::Allot(const StepBudget& budget)
+{
+	const auto deadline = budget.deadline.load();
+	if (deadline == std::chrono::steady_clock::time_point::max())
+	{
+		return none;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	if (deadline <= now)
+	{
+		return now;
+	}
+
+	// ワーカーより多くの探索が残っている場合は残り時間を分け合う
+	// 先に終わった探索が使わなかった時間は, 後から始まる探索に回る
+	const int32 unfinished = Max(budget.unfinished.load(), 1);
+	const double share = Min(1.0, static_cast<double>(budget.workerCount) / unfinished);
+	return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>((deadline - now) * share);
+}
+
+void SolverRunner::setCompletionCallback(std::function<void()> callback)
+{
+	m_completionCallback = std::move(callback);
+}
+
+void SolverRunner::complete(SolverResult result)
+{
+	m_completions.push(std::move(result));
+	if (m_completionCallback)
+	{
+		m_completionCallback();
+	}
+}
+
+SolverRunner::SolverResult SolverRunner::MakeResult(const SolverInstance& instance)
+{
+	return SolverResult{
+		.solverId = instance.solverId,
+		.snakeId = instance.snakeId,
+		.gameId = instance.snapshot->game().gameId,
+		.step = instance.snapshot->game().step()
 	};
-	m_instance.erase(itr);
+}
+
+void SolverRunner::cancelObsolete(int gameId, int step)
+{
+	for (auto& instance : m_instance)
+	{
+		if (instance.snapshot->game().gameId != gameId || instance.snapshot->game().step() != step)
+		{
+			instance.stopSource.request_stop();
+		}
+	}
+
+	// 打ち切り済みで完了したものは結果を使わないため破棄する
+	std::erase_if(m_instance, [](const SolverInstance& instance) {
+		return instance.stopSource.stop_requested() &&
+			instance.future.wait_for(0s) == std::future_status::ready;
+	});
+}
+
+void SolverRunner::configure(const ThreadPool::Options& options)
+{
+	stopAll();
+	m_instance.clear();
+	m_ponderFutures.clear();
+	m_completions.popAll();
+	m_budget.reset();
 
-	return result;
+	m_pool = std::make_unique<ThreadPool>(options);
 }
 
 SolverRunner::~SolverRunner()
+{
+	stopAll();
+}
+
+void SolverRunner::stopAll()
 {
+	for (auto& instance : m_instance)
+	{
+		instance.stopSource.request_stop();
+	}
+	for (auto& [key, slot] : m_slots)
+	{
+		slot->ponderStop.request_stop();
+	}
 	for (auto& instance : m_instance)
 	{
 		instance.future.wait();
 	}
+	for (auto& future : m_ponderFutures)
+	{
+		future.wait();
+	}
 }
 
-void SolverRunner::solveImpl(Solver* solver, const SuperSnake::Game& game, SuperSnake::SnakeID id, std::promise<SuperSnake::SnakeAction> promise)
+void SolverRunner::writeStatsLog(const SolverResult& result)
 {
-	try
+	if (not m_statsLog)
 	{
-		promise.set_value_at_thread_exit(solver->solve(game, id));
+		const bool exists = FileSystem::Exists(SolverStatsLogPath);
+		FileSystem::CreateDirectories(FileSystem::ParentPath(SolverStatsLogPath));
+		if (not m_statsLog.open(SolverStatsLogPath, OpenMode::Append))
+		{
+			return;
+		}
+		if (not exists)
+		{
+			m_statsLog.writeln(U"gameId,step,solver,snakeId,nodes,ttProbes,ttHits,depth,elapsedMs,nps,pv");
+		}
 	}
-	catch (std::exception)
+
+	const SolverStats& stats = result.stats;
+	m_statsLog.writeln(U"{},{},{},{},{},{},{},{},{:.3f},{:.0f},{}"_fmt(
+		result.gameId,
+		result.step,
+		Solvers[result.solverId].first,
+		result.snakeId,
+		stats.nodes,
+		stats.ttProbes,
+		stats.ttHits,
+		stats.depth,
+		stats.elapsed.count() * 1000,
+		stats.nodesPerSecond(),
+		stats.pvText()));
+}
+
+ThreadPool& SolverRunner::pool()
+{
+	if (not m_pool)
+	{
+		m_pool = std::make_unique<ThreadPool>(ThreadPool::Options{});
+	}
+	return *m_pool;
+}
+
+std::shared_ptr<SolverRunner::SolverSlot> SolverRunner::getSlot(size_t solverId, SuperSnake::SnakeID id)
+{
+	auto& slot = m_slots[{ solverId, id }];
+	if (not slot)
 	{
-		promise.set_exception_at_thread_exit(std::current_exception());
+		slot = std::make_shared<SolverSlot>();
+		slot->solver = Solvers[solverId].second();
 	}
+	return slot;
 }
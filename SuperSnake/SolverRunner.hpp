@@ -1,6 +1,9 @@
 ﻿#pragma once
 #include "Config.hpp"
 #include "Solver.hpp"
+#include "SolverArena.hpp"
+#include "CompletionQueue.hpp"
+#include "ThreadPool.hpp"
 
 class SolverRunner
 {
@@ -16,31 +19,188 @@ public:
 
 		int step;
 
-		std::future<SuperSnake::SnakeAction> future;
-	};
+		/// @brief 決定した行動 (errorがある場合は無効)
+		SuperSnake::SnakeAction action = SuperSnake::SnakeAction::Stay;
+
+		/// @brief 探索中に送出された例外
+		std::exception_ptr error;
 
-	void solve(size_t solverId, const SuperSnake::Game& game, SuperSnake::SnakeID id);
+		/// @brief 探索の統計情報
+		SolverStats stats;
+	};
 
-	Optional<SolverResult> getResult(SuperSnake::SnakeID id);
+	/// @brief ソルバーに行動を決定させます
+	/// @remark 異なる局面(gameId, step)に対する実行中の探索は打ち切られます
+	/// 先読みで探索済みの局面であれば, 探索せずにすぐに結果を通知します
+	/// 同じ局面に対する探索は持ち時間と局面のスナップショットを共有し, ワーカーが足りない場合は残り時間を分け合います
+	/// @param solverId ソルバー
+	/// @param game 現在の局面
+	/// @param id 操作するスネーク
+	/// @param timeLimit 探索の制限時間
+	void solve(size_t solverId, const SuperSnake::Game& game, SuperSnake::SnakeID id, Optional<Duration> timeLimit = none);
+
+	/// @brief 同じソルバーが操作する複数のスネークの行動をまとめて決定させます
+	/// @remark 結果はスネーク毎に通知されます
+	/// ソルバーが searchesJointly でない場合は, 制限時間を等分してスネーク毎に solve します
+	/// @param solverId ソルバー
+	/// @param game 現在の局面
+	/// @param ids 操作するスネーク
+	/// @param timeLimit 探索の制限時間 (全員分)
+	void solveJoint(size_t solverId, const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids, Optional<Duration> timeLimit = none);
+
+	/// @brief 指定した局面以外に対する探索を打ち切ります
+	void cancelObsolete(int gameId, int step);
+
+	/// @brief 他のプレイヤーの操作待ちの間, 次の局面の候補に対する探索を先に行います
+	/// @remark 結果は保存しておき, 次の solve, solveJoint の局面が候補と一致した場合に使います
+	/// 同じソルバーに新しい候補が来たら, まだ探索していない古い候補は破棄します (探索中の候補は最後まで探索します)
+	/// ソルバーが searchesJointly でない場合は, 制限時間を等分してスネーク毎に先読みします
+	/// @param solverId ソルバー
+	/// @param candidates 次の局面の候補 (可能性の高い順)
+	/// @param ids 操作するスネーク (候補の局面で死亡しているものは除いて探索します)
+	/// @param timeLimit 1局面あたりの探索の制限時間 (全員分)
+	void ponder(size_t solverId, Array<SuperSnake::Game> candidates, const Array<SuperSnake::SnakeID>& ids, Optional<Duration> timeLimit = none);
+
+	/// @brief 局面のスナップショットを返します
+	/// @remark 同じ局面(gameId, step)の探索と共有するため, 解析結果の表示にも使えます
+	std::shared_ptr<const StepSnapshot> snapshot(const SuperSnake::Game& game);
+
+	/// @brief 探索, 先読みを実行するワーカーを設定し直します
+	/// @remark 実行中の探索, 先読みは打ち切られ, まだ取り出していない結果は破棄されます
+	void configure(const ThreadPool::Options& options);
+
+	/// @brief 完了した探索の結果を完了順に全て取り出します
+	/// @remark 打ち切られた探索の結果も含まれるため, gameId, stepを確認してください
+	Array<SolverResult> takeResults();
+
+	/// @brief 探索が完了するたびにワーカースレッドから呼び出される関数を設定します
+	/// @remark 結果を待つスレッドを起こす用途を想定しています. 探索を始める前に設定してください
+	void setCompletionCallback(std::function<void()> callback);
 
 	~SolverRunner();
 
 private:
 
+	// 先読みで探索済みの結果
+	struct Speculation
+	{
+		Array<SuperSnake::SnakeID> ids;
+
+		// idsと同じ順の行動
+		Array<SuperSnake::SnakeAction> actions;
+
+		SolverStats stats;
+	};
+
+	// スネーク毎に使い回すソルバー
+	struct SolverSlot
+	{
+		std::unique_ptr<Solver> solver;
+
+		// solverを使用するスレッド間の排他
+		std::mutex mutex;
+
+		// 実行中の先読みの停止要求 (探索を始めるときに打ち切る)
+		std::stop_source ponderStop;
+
+		// 最新の先読み要求の番号 (古い要求の残りの候補は探索しない)
+		std::atomic<uint64> ponderGeneration = 0;
+
+		// 先読みの結果 (局面のハッシュ値 -> 結果), speculationMutexで保護
+		// 探索中もmutexを取らずに参照できるように分けている
+		std::mutex speculationMutex;
+
+		std::map<uint64, Speculation> speculations;
+
+		// 探索毎に解放する作業領域 (mutexで保護)
+		SolverArena arena;
+	};
+
+	// 同じ局面に対する探索で共有する持ち時間
+	struct StepBudget
+	{
+		int gameId;
+
+		int step;
+
+		// 探索を同時に実行できる数
+		int32 workerCount;
+
+		// 全ての探索を終えるべき時刻 (time_point::max() は無制限)
+		std::atomic<std::chrono::steady_clock::time_point> deadline = std::chrono::steady_clock::time_point::min();
+
+		// 終わっていない探索の数
+		std::atomic<int32> unfinished = 0;
+	};
+
 	struct SolverInstance
 	{
 		size_t solverId;
 
 		SuperSnake::SnakeID snakeId;
 
-		SuperSnake::Game gameCache;
+		// 同じ局面の探索で共有する
+		std::shared_ptr<const StepSnapshot> snapshot;
 
-		std::unique_ptr<Solver> solver;
+		std::shared_ptr<SolverSlot> slot;
+
+		std::stop_source stopSource;
+
+		SolveContext context;
 
-		std::future<SuperSnake::SnakeAction> future;
+		std::shared_ptr<StepBudget> budget;
+
+		// 結果を通知し終えたら完了する (まとめて探索した場合は共有)
+		std::shared_future<void> future;
 	};
 
+	// 探索, 先読みを実行するワーカー (configureされるまでは既定の設定)
+	std::unique_ptr<ThreadPool> m_pool;
+
+	std::map<std::pair<size_t, SuperSnake::SnakeID>, std::shared_ptr<SolverSlot>> m_slots;
+
 	std::list<SolverInstance> m_instance;
 
-	static void solveImpl(Solver* solver, const SuperSnake::Game& game, SuperSnake::SnakeID id, std::promise<SuperSnake::SnakeAction> promise);
+	std::list<std::future<void>> m_ponderFutures;
+
+	// 現在の局面の持ち時間
+	std::shared_ptr<StepBudget> m_budget;
+
+	// 現在の局面のスナップショット
+	std::shared_ptr<const StepSnapshot> m_snapshot;
+
+	// 完了した探索の結果
+	CompletionQueue<SolverResult> m_completions;
+
+	std::function<void()> m_completionCallback;
+
+	// 統計情報のログ
+	TextWriter m_statsLog;
+
+	ThreadPool& pool();
+
+	std::shared_ptr<SolverSlot> getSlot(size_t solverId, SuperSnake::SnakeID id);
+
+	// まとめて探索しないソルバーの制限時間をスネーク毎に等分する
+	static Optional<Duration> SplitTimeLimit(Optional<Duration> timeLimit, size_t count);
+
+	// 実行中の探索, 先読みを全て打ち切り, 終了を待つ
+	void stopAll();
+
+	// 先読みの結果があれば通知する
+	// 使わなかった結果は破棄する
+	bool completeFromSpeculation(size_t solverId, SolverSlot& slot, const SuperSnake::Game& game, const Array<SuperSnake::SnakeID>& ids);
+
+	// 局面の持ち時間に探索1回分を加える
+	std::shared_ptr<StepBudget> addToBudget(const SuperSnake::Game& game, Optional<Duration> timeLimit);
+
+	// 探索を始める時点で, 持ち時間の残りから探索1回分の期限を決める
+	static Optional<std::chrono::steady_clock::time_point> Allot(const StepBudget& budget);
+
+	// 結果を通知する (ワーカースレッドから呼び出す)
+	void complete(SolverResult result);
+
+	static SolverResult MakeResult(const SolverInstance& instance);
+
+	void writeStatsLog(const SolverResult& result);
 };
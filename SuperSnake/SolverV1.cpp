@@ -1,18 +1,80 @@
 ﻿#include "SolverV1.hpp"
+#include "OpeningBook.hpp"
+#include "Tablebase.hpp"
 
 using namespace SuperSnake;
 
-SnakeAction SolverV1::solve(const Game& game, SnakeID id)
+// 深さn以下のノード数の上限 (1 + 3 + 9 + ... + 3^(n-1))
+static int64 PathCountBound(int n)
 {
+	constexpr int64 Saturated = std::numeric_limits<int64>::max() / 4;
+
+	int64 bound = 0;
+	int64 width = 1;
+	for (int i = 0; i < n && bound < Saturated; i++)
+	{
+		bound += width;
+		width = Min(width * 3, Saturated);
+	}
+	return Min(bound, Saturated);
+}
+
+SnakeAction SolverV1::solve(const Game& game, SnakeID id, const SolveContext& context)
+{
+	m_stats = SolverStats{};
+	return search(game, id, context);
+}
+
+SnakeAction SolverV1::search(const Game& game, SnakeID id, const SolveContext& context)
+{
+	m_stopped = false;
+
+	// 終盤データベース, 定跡に含まれる局面であれば探索しない
+	if (m_useOpeningBook)
+	{
+		if (const auto tablebase = Tablebase::Find(game.field().size(), static_cast<int32>(game.snakes().size())))
+		{
+			if (const auto result = tablebase->probe(game, id))
+			{
+				m_stats.pv = { result->action };
+				return result->action;
+			}
+		}
+
+		if (const auto book = OpeningBook::Find(game.field().size(), static_cast<int32>(game.snakes().size())))
+		{
+			if (const auto action = book->probe(game, id))
+			{
+				m_stats.pv = { *action };
+				return *action;
+			}
+		}
+	}
+
 	m_game = &game;
+	m_context = &context;
+	m_snapshot = context.snapshotOf(game);
 
 	const auto& field = game.field();
 	const auto fieldSize = field.size();
 	const auto& snake = game.snakes()[id];
-	m_bitField.resize(fieldSize.x * fieldSize.y);
-	for (const Point pos : Iota2D(fieldSize))
+
+	// 作業領域はターン毎に解放されるアリーナから確保する
+	m_work.emplace(context.memoryResource(), fieldSize.x * fieldSize.y, m_maxStep);
+	if (m_snapshot)
 	{
-		m_bitField[pos.y * fieldSize.x + pos.x] = field[pos] != CellState::Unallocated;
+		const auto& occupied = m_snapshot->occupied();
+		for (const int32 idx : Iota(occupied.cellCount()))
+		{
+			m_work->bitField[idx] = occupied.test(idx);
+		}
+	}
+	else
+	{
+		for (const Point pos : Iota2D(fieldSize))
+		{
+			m_work->bitField[pos.y * fieldSize.x + pos.x] = field[pos] != CellState::Unallocated;
+		}
 	}
 
 	// ハッシュテーブルを再生成
@@ -25,14 +87,25 @@ SnakeAction SolverV1::solve(const Game& game, SnakeID id)
 		}
 	}
 
-	m_pointHistory.clear();
-
 	PointType maxPoint = 0;
 	SnakeAction bestAction = SnakeAction::MoveStraight;
 	for (int i : Range(-1, 1))
 	{
+		// 打ち切られた場合はそれまでの最善手
+		if (m_stopped)
+		{
+			break;
+		}
+
 		SnakeAction action = static_cast<SnakeAction>(i);
-		PointType point = step(snake.position, snake.direction, 0, action, MaxStep);
+
+		// 移動先の領域が狭く, 最善手を超えられない行動は読まない
+		if (maxPoint > 0 && upperBound(snake.position, snake.direction, action, maxPoint) <= maxPoint)
+		{
+			continue;
+		}
+
+		PointType point = step(snake.position, snake.direction, 0, action, m_maxStep);
 		if (point > maxPoint)
 		{
 			bestAction = action;
@@ -40,13 +113,73 @@ SnakeAction SolverV1::solve(const Game& game, SnakeID id)
 		}
 	}
 
+	m_work.reset();
 	m_game = nullptr;
+	m_context = nullptr;
+	m_snapshot = nullptr;
+
+	// 深さを固定して読むため, 打ち切られた場合は読み切った深さが無い
+	m_stats.depth = m_stopped ? 0 : m_maxStep;
+	m_stats.pv = { bestAction };
 
 	return bestAction;
 }
 
 SolverV1::PointType SolverV1::step(Point currentPosition, Direction currentDirection, HashType currentFieldHash, SnakeAction action, int remainingStep)
 {
+	// 再帰の代わりに確保済みのフレーム配列を使う
+	if (m_work->frames.size() < static_cast<size_t>(remainingStep))
+	{
+		m_work->frames.resize(remainingStep);
+	}
+
+	PointType point = 0;
+	if (not enter(m_work->frames[0], currentPosition, currentDirection, currentFieldHash, action, remainingStep, point))
+	{
+		return point;
+	}
+
+	size_t depth = 0;
+	while (true)
+	{
+		Frame& frame = m_work->frames[depth];
+		if (frame.remainingStep > 0 && frame.nextAction <= 1)
+		{
+			const auto childAction = static_cast<SnakeAction>(frame.nextAction++);
+			if (enter(m_work->frames[depth + 1], frame.position, frame.direction, frame.fieldHash, childAction, frame.remainingStep, point))
+			{
+				depth++;
+			}
+			else
+			{
+				frame.totalPoint += point;
+			}
+			continue;
+		}
+
+		// 全ての行動を展開し終えた
+		frame.totalPoint++;
+
+		m_work->bitField[frame.cellIndex] = false;
+
+		m_work->pointHistory.emplace(
+			frame.fieldHash ^ m_directionHashTable[static_cast<int>(frame.direction)],
+			frame.totalPoint
+		);
+
+		if (depth == 0)
+		{
+			return frame.totalPoint;
+		}
+		depth--;
+		m_work->frames[depth].totalPoint += frame.totalPoint;
+	}
+}
+
+bool SolverV1::enter(Frame& frame, Point currentPosition, Direction currentDirection, HashType currentFieldHash, SnakeAction action, int remainingStep, PointType& point)
+{
+	point = 0;
+
 	const auto nextDir = Direction((8 + int32(currentDirection) + int32(action)) % 8);
 	const auto nextPos = currentPosition + Util::ToPoint(nextDir);
 	const auto& field = m_game->field();
@@ -56,49 +189,116 @@ SolverV1::PointType SolverV1::step(Point currentPosition, Direction currentDirec
 		nextPos.x >= field.size().x ||
 		nextPos.y >= field.size().y)
 	{
-		return 0;
+		return false;
 	}
 
 	const int nextIdx = nextPos.y * field.size().x + nextPos.x;
 
-	if (m_bitField[nextIdx])
+	if (m_work->bitField[nextIdx])
 	{
-		return 0;
+		return false;
 	}
 
 	const HashType nextFieldHash = currentFieldHash ^ m_fieldHashTable[nextIdx];
 
-	const auto history = m_pointHistory.find(nextFieldHash ^ m_directionHashTable[static_cast<int>(nextDir)]);
-	if (history != m_pointHistory.cend())
+	m_stats.nodes++;
+	if (m_stopped ||
+		(m_stats.nodes % StopCheckInterval == 0 && m_context->shouldStop()))
+	{
+		m_stopped = true;
+		return false;
+	}
+
+	m_stats.ttProbes++;
+	const auto history = m_work->pointHistory.find(nextFieldHash ^ m_directionHashTable[static_cast<int>(nextDir)]);
+	if (history != m_work->pointHistory.cend())
+	{
+		m_stats.ttHits++;
+		point = history->second;
+		return false;
+	}
+
+	m_work->bitField[nextIdx] = true;
+
+	frame = Frame{
+		.position = nextPos,
+		.direction = nextDir,
+		.fieldHash = nextFieldHash,
+		.cellIndex = nextIdx,
+		.remainingStep = remainingStep - 1,
+		.nextAction = -1,
+		.totalPoint = 0
+	};
+	return true;
+}
+
+SolverV1::PointType SolverV1::upperBound(Point currentPosition, Direction currentDirection, SnakeAction action, PointType threshold)
+{
+	const auto nextDir = Direction((8 + int32(currentDirection) + int32(action)) % 8);
+	const auto nextPos = currentPosition + Util::ToPoint(nextDir);
+	const Size fieldSize = m_game->field().size();
+
+	if (nextPos.x < 0 ||
+		nextPos.y < 0 ||
+		nextPos.x >= fieldSize.x ||
+		nextPos.y >= fieldSize.y ||
+		m_work->bitField[nextPos.y * fieldSize.x + nextPos.x])
 	{
-		return history->second;
+		return 0;
 	}
 
-	m_bitField[nextIdx] = true;
+	// 同じマスは2度通らないため, 深さは到達可能なマス数を超えない
+	// thresholdを超えるのに必要な深さに達したら数えるのをやめる
+	int limit = 1;
+	while (limit < m_maxStep && PathCountBound(limit) <= threshold)
+	{
+		limit++;
+	}
 
-	PointType totalPoint = 0;
-	remainingStep--;
-	if (remainingStep > 0)
+	// 根の局面の領域の大きさは解析済み
+	const int area = m_snapshot ? m_snapshot->regionSize(nextPos) : reachableCount(nextPos, limit);
+	return PathCountBound(Min(area, m_maxStep));
+}
+
+int SolverV1::reachableCount(Point position, int limit)
+{
+	const Size fieldSize = m_game->field().size();
+	const int startIdx = position.y * fieldSize.x + position.x;
+
+	m_work->floodVisited = m_work->bitField;
+	m_work->floodVisited[startIdx] = true;
+	m_work->floodStack.clear();
+	m_work->floodStack.push_back(startIdx);
+
+	int count = 1;
+	while (not m_work->floodStack.empty() && count < limit)
 	{
-		for (int i : Range(-1, 1))
+		const int idx = m_work->floodStack.back();
+		m_work->floodStack.pop_back();
+
+		const Point pos{ idx % fieldSize.x, idx / fieldSize.x };
+		for (int32 dir : Iota(8))
 		{
-			SnakeAction action = static_cast<SnakeAction>(i);
-			PointType point = step(nextPos, nextDir, nextFieldHash, action, remainingStep);
+			const Point nextPos = pos + Util::ToPoint(Direction(dir));
+			if (nextPos.x < 0 ||
+				nextPos.y < 0 ||
+				nextPos.x >= fieldSize.x ||
+				nextPos.y >= fieldSize.y)
 			{
-				totalPoint += point;
+				continue;
+			}
+
+			const int nextIdx = nextPos.y * fieldSize.x + nextPos.x;
+			if (not m_work->floodVisited[nextIdx])
+			{
+				m_work->floodVisited[nextIdx] = true;
+				m_work->floodStack.push_back(nextIdx);
+				count++;
 			}
 		}
 	}
-	totalPoint++;
-
-	m_bitField[nextIdx] = false;
-
-	m_pointHistory.emplace(
-		nextFieldHash ^ m_directionHashTable[static_cast<int>(nextDir)],
-		totalPoint
-	);
 
-	return totalPoint;
+	return count;
 }
 
 std::unique_ptr<Solver> CreateSolverV1()
@@ -9,12 +9,28 @@ class SolverV1 : public Solver
 
 	constexpr static int MaxStep = 15;
 
+	// 打ち切りを確認する間隔 (ノード数)
+	constexpr static uint64 StopCheckInterval = 4096;
+
 public:
 
-	SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id) override;
+	/// @param maxStep 探索深さ
+	/// @param useOpeningBook 定跡, 終盤データベースを参照するか
+	explicit SolverV1(int maxStep = MaxStep, bool useOpeningBook = true)
+		: m_maxStep(maxStep)
+		, m_useOpeningBook(useOpeningBook)
+	{ }
+
+	SuperSnake::SnakeAction solve(const SuperSnake::Game& game, SuperSnake::SnakeID id, const SolveContext& context) override;
+
+	Optional<SolverStats> stats() const override { return m_stats; }
 
 private:
 
+	int m_maxStep;
+
+	bool m_useOpeningBook;
+
 	// ZobristHash用ハッシュテーブル
 
 	// フィールド用
@@ -31,15 +47,82 @@ private:
 		RandomInt32()
 	};
 
-	// ポイント履歴
-	std::map<HashType, PointType> m_pointHistory;
+	const SuperSnake::Game* m_game = nullptr;
+
+	// 共有のスナップショット (m_gameと一致する場合のみ)
+	const StepSnapshot* m_snapshot = nullptr;
 
-	// フィールドをビットに置き換えた情報
-	std::vector<bool> m_bitField;
+	const SolveContext* m_context = nullptr;
 
-	const SuperSnake::Game* m_game = nullptr;
+	// 探索スタックのフレーム
+	struct Frame
+	{
+		Point position;
+
+		SuperSnake::Direction direction;
+
+		HashType fieldHash;
+
+		int cellIndex;
+
+		int remainingStep;
+
+		// 次に展開する行動 (-1 ~ 1)
+		int nextAction;
+
+		PointType totalPoint;
+	};
+
+	// 1回の探索の作業領域 (SolveContext::arena から確保し, 探索を終えたら破棄する)
+	struct Workspace
+	{
+		// ポイント履歴
+		std::pmr::map<HashType, PointType> pointHistory;
+
+		// フィールドをビットに置き換えた情報
+		std::pmr::vector<bool> bitField;
+
+		// 塗りつぶし用
+		std::pmr::vector<bool> floodVisited;
+
+		std::pmr::vector<int> floodStack;
+
+		// 探索スタック (探索深さ分を確保して使い回す)
+		std::pmr::vector<Frame> frames;
+
+		Workspace(std::pmr::memory_resource* resource, size_t cellCount, size_t maxStep)
+			: pointHistory(resource)
+			, bitField(cellCount, resource)
+			, floodVisited(resource)
+			, floodStack(resource)
+			, frames(maxStep, resource)
+		{
+			floodVisited.reserve(cellCount);
+			floodStack.reserve(cellCount);
+		}
+	};
+
+	Optional<Workspace> m_work;
+
+	// 打ち切られた
+	bool m_stopped = false;
+
+	SolverStats m_stats;
+
+	SuperSnake::SnakeAction search(const SuperSnake::Game& game, SuperSnake::SnakeID id, const SolveContext& context);
 
 	PointType step(Point currentPosition, SuperSnake::Direction currentDirection, HashType currentFieldHash, SuperSnake::SnakeAction action, int remainingStep);
+
+	// actionで移動した先の部分木の値の上限を, 到達可能なマス数から見積もります
+	// thresholdを超えることが分かった時点で見積もりをやめます
+	PointType upperBound(Point currentPosition, SuperSnake::Direction currentDirection, SuperSnake::SnakeAction action, PointType threshold);
+
+	// positionを含む, positionから到達可能なマス数 (limitに達したら数えるのをやめます)
+	int reachableCount(Point position, int limit);
+
+	// actionで移動した先のフレームを作成します
+	// 値がすぐに決まる(移動できない, 探索済み)場合はpointに設定してfalseを返します
+	bool enter(Frame& frame, Point currentPosition, SuperSnake::Direction currentDirection, HashType currentFieldHash, SuperSnake::SnakeAction action, int remainingStep, PointType& point);
 };
 
 std::unique_ptr<Solver> CreateSolverV1();
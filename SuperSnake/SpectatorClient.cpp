@@ -0,0 +1,76 @@
+﻿#include "SpectatorClient.hpp"
+
+using namespace SuperSnake;
+
+SpectatorClient::SpectatorClient(const IPv4Address& address, uint16 port)
+{
+	m_client.connect(address, port);
+}
+
+bool SpectatorClient::update(std::unique_ptr<Game>& game)
+{
+	if (not m_client.isConnected())
+	{
+		return false;
+	}
+
+	if (not m_requested)
+	{
+		requestKeyframe();
+		m_requested = true;
+	}
+
+	bool changed = false;
+	NetworkProtocol::Frame frame;
+	while (true)
+	{
+		const auto status = NetworkProtocol::ReadFrame(m_client, frame);
+		if (status == NetworkProtocol::ReadStatus::Invalid)
+		{
+			// 形式が不正なデータは読み捨てられたため, 局面全体から受け取り直す
+			requestKeyframe();
+			return changed;
+		}
+		if (status == NetworkProtocol::ReadStatus::Incomplete)
+		{
+			return changed;
+		}
+
+		const auto& payload = frame.payload;
+		m_receivedBytes += sizeof(NetworkProtocol::FrameHeader) + payload.size();
+
+		if (frame.type == NetworkProtocol::MessageType::Keyframe)
+		{
+			if (auto keyframe = NetworkProtocol::DecodeKeyframe(payload))
+			{
+				game = std::move(keyframe);
+				m_awaitingKeyframe = false;
+				changed = true;
+			}
+			else
+			{
+				requestKeyframe();
+			}
+		}
+		else if (frame.type == NetworkProtocol::MessageType::Step && not m_awaitingKeyframe)
+		{
+			const auto step = NetworkProtocol::DecodeStep(payload);
+			if (step && game && NetworkProtocol::ApplyStep(*step, *game))
+			{
+				changed = true;
+			}
+			else
+			{
+				// 差分を取りこぼした, または局面がずれた
+				requestKeyframe();
+			}
+		}
+	}
+}
+
+void SpectatorClient::requestKeyframe()
+{
+	const Array<Byte> frame = NetworkProtocol::EncodeFrame(NetworkProtocol::MessageType::Watch, NetworkProtocol::EncodeHello());
+	m_client.send(frame.data(), frame.size());
+	m_awaitingKeyframe = true;
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include "NetworkProtocol.hpp"
+
+/// @brief SpectatorHost に接続して対戦を観戦するクライアント
+/// @remark 差分を適用した結果がホストと一致しない場合は, 局面全体を要求し直します
+class SpectatorClient
+{
+public:
+
+	SpectatorClient(const IPv4Address& address, uint16 port);
+
+	/// @brief 受信したメッセージを局面に適用します (毎フレーム呼び出してください)
+	/// @param game 観戦中の局面 (局面全体を受け取ると置き換えます)
+	/// @return 局面が変わった
+	bool update(std::unique_ptr<SuperSnake::Game>& game);
+
+	bool isConnected() const { return m_client.isConnected(); }
+
+	/// @brief 接続できなかった, 切断された
+	bool hasError() const { return m_client.hasError(); }
+
+	/// @brief これまでに受け取ったバイト数
+	uint64 receivedBytes() const { return m_receivedBytes; }
+
+private:
+
+	TCPClient m_client;
+
+	// Watch を送った
+	bool m_requested = false;
+
+	// 局面全体を待っている (それまでの差分は捨てる)
+	bool m_awaitingKeyframe = true;
+
+	uint64 m_receivedBytes = 0;
+
+	void requestKeyframe();
+};
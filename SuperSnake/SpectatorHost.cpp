@@ -0,0 +1,84 @@
+﻿#include "SpectatorHost.hpp"
+
+using namespace SuperSnake;
+
+SpectatorHost::SpectatorHost(uint16 port)
+{
+	m_listening = m_server.startAcceptMulti(port);
+}
+
+void SpectatorHost::update(const Game* game)
+{
+	NetworkProtocol::SyncSessions(m_server, m_sessions);
+
+	// 同時に観戦を開始した観戦者には同じ局面全体を送る
+	Optional<Array<Byte>> keyframe;
+	for (auto& [id, session] : m_sessions)
+	{
+		receive(id, session);
+
+		if (session.needsKeyframe && game)
+		{
+			if (not keyframe)
+			{
+				keyframe = NetworkProtocol::EncodeFrame(NetworkProtocol::MessageType::Keyframe, NetworkProtocol::EncodeKeyframe(*game));
+			}
+			send(id, *keyframe);
+			session.needsKeyframe = false;
+		}
+	}
+}
+
+void SpectatorHost::sendKeyframe(const Game& game)
+{
+	const Array<Byte> frame = NetworkProtocol::EncodeFrame(NetworkProtocol::MessageType::Keyframe, NetworkProtocol::EncodeKeyframe(game));
+	for (auto& [id, session] : m_sessions)
+	{
+		if (session.watching)
+		{
+			send(id, frame);
+			session.needsKeyframe = false;
+		}
+	}
+}
+
+void SpectatorHost::sendStep(const Game& game, const Array<SnakeAction>& actions, const Array<GameEvent>& events)
+{
+	const Array<Byte> frame = NetworkProtocol::EncodeFrame(NetworkProtocol::MessageType::Step, NetworkProtocol::EncodeStep(game, actions, events));
+	for (const auto& [id, session] : m_sessions)
+	{
+		// 局面全体を送る前の観戦者には差分を送っても適用できない
+		if (session.watching && not session.needsKeyframe)
+		{
+			send(id, frame);
+		}
+	}
+}
+
+size_t SpectatorHost::viewerCount() const
+{
+	return std::count_if(m_sessions.begin(), m_sessions.end(), [](const auto& pair) {
+		return pair.second.watching;
+	});
+}
+
+void SpectatorHost::send(TCPSessionID id, const Array<Byte>& frame)
+{
+	// ヘッダーとペイロードを1回で送る
+	m_server.send(frame.data(), frame.size(), id);
+	m_sentBytes += frame.size();
+}
+
+void SpectatorHost::receive(TCPSessionID id, Session& session)
+{
+	NetworkProtocol::Frame frame;
+	while (NetworkProtocol::ReadFrame(m_server, id, frame) == NetworkProtocol::ReadStatus::Complete)
+	{
+		// 観戦開始と, 差分を適用できなくなった観戦者からの再送要求
+		if (frame.type == NetworkProtocol::MessageType::Watch && NetworkProtocol::DecodeHello(frame.payload))
+		{
+			session.watching = true;
+			session.needsKeyframe = true;
+		}
+	}
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+#include "NetworkProtocol.hpp"
+
+/// @brief 進行中の対戦を観戦者に配信するホスト
+/// @remark 観戦を開始した観戦者には局面全体を, 以降はステップ毎の差分 (1ステップ数バイト) のみを送ります
+class SpectatorHost
+{
+public:
+
+	/// @param port 待ち受けるポート
+	explicit SpectatorHost(uint16 port);
+
+	/// @brief 待ち受けを開始できたか (ポートが使用中の場合など失敗します)
+	bool isListening() const { return m_listening; }
+
+	/// @brief 接続の受け付けと受信を行い, 観戦を開始した観戦者に局面全体を送ります (毎フレーム呼び出してください)
+	/// @param game 現在の局面 (無い場合は局面全体を送らず, 次の sendKeyframe を待たせます)
+	void update(const SuperSnake::Game* game);
+
+	/// @brief 全ての観戦者に局面全体を送ります (新しい対戦の開始時)
+	void sendKeyframe(const SuperSnake::Game& game);
+
+	/// @brief 全ての観戦者に1ステップ分の差分を送ります
+	/// @param game 行動した後の局面
+	/// @param actions 行動
+	/// @param events 行動したときのイベント
+	void sendStep(const SuperSnake::Game& game, const Array<SuperSnake::SnakeAction>& actions, const Array<SuperSnake::GameEvent>& events);
+
+	/// @brief 観戦中の観戦者数
+	size_t viewerCount() const;
+
+	/// @brief これまでに送ったバイト数
+	uint64 sentBytes() const { return m_sentBytes; }
+
+private:
+
+	struct Session
+	{
+		// Watch を受け取った
+		bool watching = false;
+
+		// 局面全体を送る必要がある
+		bool needsKeyframe = false;
+	};
+
+	TCPServer m_server;
+
+	bool m_listening = false;
+
+	std::map<TCPSessionID, Session> m_sessions;
+
+	uint64 m_sentBytes = 0;
+
+	void send(TCPSessionID id, const Array<Byte>& frame);
+
+	// 届いたメッセージを全て処理する
+	void receive(TCPSessionID id, Session& session);
+};
@@ -0,0 +1,218 @@
+﻿#include "StepSnapshot.hpp"
+
+using namespace SuperSnake;
+
+StepSnapshot::StepSnapshot(const Game& game)
+	: m_game(game)
+	, m_occupied(Bitboard::FromField(game.field()))
+	, m_free(game.field().size())
+	, m_notLeftColumn(game.field().size())
+	, m_notRightColumn(game.field().size())
+{
+	const Size size = m_occupied.size();
+	for (const int32 idx : Iota(m_occupied.cellCount()))
+	{
+		if (not m_occupied.test(idx))
+		{
+			m_free.set(idx);
+		}
+		m_notLeftColumn.set(idx);
+		m_notRightColumn.set(idx);
+	}
+	m_notLeftColumn.andNot(Bitboard::Column(size, 0));
+	m_notRightColumn.andNot(Bitboard::Column(size, size.x - 1));
+}
+
+std::shared_ptr<const StepSnapshot> StepSnapshot::Create(const Game& game)
+{
+	return std::make_shared<const StepSnapshot>(game);
+}
+
+const Array<int32>& StepSnapshot::distanceMap(SnakeID id) const
+{
+	std::call_once(m_distanceOnce, [this] { computeDistances(); });
+	return m_distanceMaps[id];
+}
+
+int32 StepSnapshot::reachableCount(SnakeID id) const
+{
+	std::call_once(m_distanceOnce, [this] { computeDistances(); });
+	return m_reachableCounts[id];
+}
+
+Optional<int32> StepSnapshot::contactDistance(SnakeID a, SnakeID b) const
+{
+	const auto& distanceA = distanceMap(a);
+	const auto& distanceB = distanceMap(b);
+
+	Optional<int32> result;
+	for (const int32 idx : Iota(m_occupied.cellCount()))
+	{
+		if (distanceA[idx] > 0 && distanceB[idx] > 0)
+		{
+			const int32 distance = Max(distanceA[idx], distanceB[idx]);
+			if (not result || distance < *result)
+			{
+				result = distance;
+			}
+		}
+	}
+	return result;
+}
+
+const Array<int32>& StepSnapshot::regionLabels() const
+{
+	std::call_once(m_regionOnce, [this] { computeRegions(); });
+	return m_regionLabels;
+}
+
+int32 StepSnapshot::regionCount() const
+{
+	std::call_once(m_regionOnce, [this] { computeRegions(); });
+	return static_cast<int32>(m_regionSizes.size());
+}
+
+int32 StepSnapshot::regionSize(Point pos) const
+{
+	if (not m_occupied.inBounds(pos))
+	{
+		return 0;
+	}
+
+	const int32 label = regionLabels()[m_occupied.index(pos)];
+	return label == NoRegion ? 0 : m_regionSizes[label];
+}
+
+const Array<int32>& StepSnapshot::owners() const
+{
+	std::call_once(m_ownerOnce, [this] { computeOwners(); });
+	return m_owners;
+}
+
+int32 StepSnapshot::territory(SnakeID id) const
+{
+	std::call_once(m_ownerOnce, [this] { computeOwners(); });
+	return m_territories[id];
+}
+
+Bitboard StepSnapshot::expand(const Bitboard& board) const
+{
+	const int32 width = board.size().x;
+
+	// 左右に広げてから上下に広げる
+	Bitboard horizontal = board;
+	horizontal |= (board & m_notRightColumn).shifted(1);
+	horizontal |= (board & m_notLeftColumn).shifted(-1);
+
+	Bitboard result = horizontal;
+	result |= horizontal.shifted(width);
+	result |= horizontal.shifted(-width);
+	return result &= m_free;
+}
+
+void StepSnapshot::computeDistances() const
+{
+	for (const auto& snake : m_game.snakes())
+	{
+		auto& distance = m_distanceMaps.emplace_back(m_occupied.cellCount(), Unreachable);
+		int32& reachable = m_reachableCounts.emplace_back(0);
+		if (snake.state == SnakeState::Dead || not m_occupied.inBounds(snake.position))
+		{
+			continue;
+		}
+
+		// 1手ずつ到達範囲を広げる
+		Bitboard visited(m_occupied.size());
+		visited.set(snake.position);
+		distance[m_occupied.index(snake.position)] = 0;
+
+		Bitboard frontier = visited;
+		for (int32 depth = 1;; depth++)
+		{
+			Bitboard next = expand(frontier).andNot(visited);
+			if (next.isEmpty())
+			{
+				break;
+			}
+
+			next.forEach([&](int32 idx) { distance[idx] = depth; });
+			reachable += next.count();
+			visited |= next;
+			frontier = std::move(next);
+		}
+	}
+}
+
+void StepSnapshot::computeRegions() const
+{
+	m_regionLabels.assign(m_occupied.cellCount(), NoRegion);
+
+	Bitboard remaining = m_free;
+	while (const auto seed = remaining.lowest())
+	{
+		const int32 label = static_cast<int32>(m_regionSizes.size());
+
+		Bitboard region(m_occupied.size());
+		region.set(*seed);
+		Bitboard frontier = region;
+		while (true)
+		{
+			Bitboard next = expand(frontier).andNot(region);
+			if (next.isEmpty())
+			{
+				break;
+			}
+			region |= next;
+			frontier = std::move(next);
+		}
+
+		region.forEach([&](int32 idx) { m_regionLabels[idx] = label; });
+		m_regionSizes.push_back(region.count());
+		remaining.andNot(region);
+	}
+}
+
+void StepSnapshot::computeOwners() const
+{
+	const auto& snakes = m_game.snakes();
+	m_owners.assign(m_occupied.cellCount(), NoOwner);
+	m_territories.assign(snakes.size(), 0);
+
+	// 全員の頭から同時に1手ずつ広げる
+	// 同時に到達したマスは両者の到達範囲として広げ続ける
+	Array<Bitboard> frontiers(snakes.size(), Bitboard(m_occupied.size()));
+	for (const auto [id, snake] : Indexed(snakes))
+	{
+		if (snake.state == SnakeState::Alive && m_occupied.inBounds(snake.position))
+		{
+			frontiers[id].set(snake.position);
+		}
+	}
+
+	Bitboard claimed(m_occupied.size());
+	while (true)
+	{
+		Bitboard reached(m_occupied.size());
+		Bitboard contested(m_occupied.size());
+		for (auto& frontier : frontiers)
+		{
+			frontier = expand(frontier).andNot(claimed);
+			contested |= reached & frontier;
+			reached |= frontier;
+		}
+
+		if (reached.isEmpty())
+		{
+			break;
+		}
+
+		for (const auto [id, frontier] : Indexed(frontiers))
+		{
+			Bitboard own = frontier;
+			own.andNot(contested).forEach([&](int32 idx) { m_owners[idx] = static_cast<int32>(id); });
+			m_territories[id] += own.count();
+		}
+		contested.forEach([&](int32 idx) { m_owners[idx] = Contested; });
+		claimed |= reached;
+	}
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <mutex>
+#include "SuperSnake.hpp"
+#include "Bitboard.hpp"
+
+/// @brief 1ステップ分の局面と, 各ソルバー, 表示が共通で使う解析結果
+/// @remark 局面は作成後に変更しないため, 同じステップの全ての探索から同時に参照できます
+/// 解析結果は最初に参照されたときに1度だけ計算します (スレッドセーフ)
+class StepSnapshot
+{
+public:
+
+	/// @brief 到達できないマスの距離
+	static constexpr int32 Unreachable = -1;
+
+	/// @brief 確保済みのマスの領域番号
+	static constexpr int32 NoRegion = -1;
+
+	/// @brief どのスネークも到達できないマス, 確保済みのマスの所有者
+	static constexpr int32 NoOwner = -1;
+
+	/// @brief 複数のスネークが同時に到達するマスの所有者
+	static constexpr int32 Contested = -2;
+
+	explicit StepSnapshot(const SuperSnake::Game& game);
+
+	StepSnapshot(const StepSnapshot&) = delete;
+
+	StepSnapshot& operator=(const StepSnapshot&) = delete;
+
+	/// @brief 局面のスナップショットを作成します
+	static std::shared_ptr<const StepSnapshot> Create(const SuperSnake::Game& game);
+
+	const SuperSnake::Game& game() const { return m_game; }
+
+	/// @brief 確保済みのマス
+	const SuperSnake::Bitboard& occupied() const { return m_occupied; }
+
+	/// @brief スネークの頭から各マスまでの最短手数 (Bitboardと同じ添字)
+	/// @remark 未確保のマスのみを通り, 向きによる制約は考えません. 頭のマスは0, 到達できないマスと死亡したスネークは Unreachable です
+	const Array<int32>& distanceMap(SuperSnake::SnakeID id) const;
+
+	/// @brief スネークの頭から到達できる未確保のマス数
+	int32 reachableCount(SuperSnake::SnakeID id) const;
+
+	/// @brief 2匹が同じマスに到達できる最小の手数
+	/// @return 共通して到達できるマスが無い場合はnone
+	Optional<int32> contactDistance(SuperSnake::SnakeID a, SuperSnake::SnakeID b) const;
+
+	/// @brief 未確保のマスを8近傍でつないだ領域の番号 (Bitboardと同じ添字, 確保済みのマスは NoRegion)
+	const Array<int32>& regionLabels() const;
+
+	int32 regionCount() const;
+
+	/// @brief posを含む領域のマス数 (確保済みのマス, フィールド外は0)
+	int32 regionSize(Point pos) const;
+
+	/// @brief 各マスに最初に到達するスネーク (Bitboardと同じ添字, NoOwner, Contested を含む)
+	/// @remark 全員の頭から同時に幅優先探索し, 同じ手数で複数のスネークが到達するマスは Contested です
+	const Array<int32>& owners() const;
+
+	/// @brief スネークが最初に到達するマス数
+	int32 territory(SuperSnake::SnakeID id) const;
+
+private:
+
+	SuperSnake::Game m_game;
+
+	SuperSnake::Bitboard m_occupied;
+
+	// 未確保のマス
+	SuperSnake::Bitboard m_free;
+
+	// 左端, 右端の列以外のマス (8近傍に広げるときに行をまたがないようにする)
+	SuperSnake::Bitboard m_notLeftColumn;
+
+	SuperSnake::Bitboard m_notRightColumn;
+
+	mutable std::once_flag m_distanceOnce;
+
+	mutable Array<Array<int32>> m_distanceMaps;
+
+	mutable Array<int32> m_reachableCounts;
+
+	mutable std::once_flag m_regionOnce;
+
+	mutable Array<int32> m_regionLabels;
+
+	mutable Array<int32> m_regionSizes;
+
+	mutable std::once_flag m_ownerOnce;
+
+	mutable Array<int32> m_owners;
+
+	mutable Array<int32> m_territories;
+
+	// 8近傍に1マス広げ, 未確保のマスに限る
+	SuperSnake::Bitboard expand(const SuperSnake::Bitboard& board) const;
+
+	void computeDistances() const;
+
+	void computeRegions() const;
+
+	void computeOwners() const;
+};
@@ -52,6 +52,17 @@ namespace SuperSnake
 		}
 	}
 
+	Game::Game(int32 gameId, int32 step, Grid<CellState> field, Array<Snake> snakes, bool gameOver)
+		: gameId(gameId)
+		, m_step(step)
+		, m_gameOver(gameOver)
+		, m_field(std::move(field))
+		, m_snakes(std::move(snakes))
+	{
+		assert(m_field.width() >= 2 && m_field.height() >= 2);
+		assert(1 <= m_snakes.size() && m_snakes.size() <= 4);
+	}
+
 	Array<GameEvent> Game::doActions(Array<SnakeAction> actions)
 	{
 		assert(actions.size() == m_snakes.size());
@@ -135,6 +135,14 @@ namespace SuperSnake
 
 		Game(Size fieldSize, int snakeCount, Array<Optional<String>> snakeNames = {});
 
+		/// @brief 保存された状態から局面を復元します
+		/// @param gameId ゲームID
+		/// @param step 経過ステップ数
+		/// @param field フィールド
+		/// @param snakes スネーク
+		/// @param gameOver ゲームが終了しているか
+		Game(int32 gameId, int32 step, Grid<CellState> field, Array<Snake> snakes, bool gameOver = false);
+
 		const int32 gameId;
 
 		bool isGameOver() const { return m_gameOver; }
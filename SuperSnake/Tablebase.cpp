@@ -0,0 +1,526 @@
+﻿#include "Tablebase.hpp"
+#include "PositionKey.hpp"
+#include "Config.hpp"
+
+using namespace SuperSnake;
+
+static_assert(sizeof(Tablebase::Header) == 40);
+
+namespace
+{
+	// SplitMix64
+	constexpr uint64 Mix(uint64 x)
+	{
+		x += 0x9E3779B97F4A7C15;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+		return x ^ (x >> 31);
+	}
+
+	constexpr uint64 FingerprintMask = ~uint64(0xFFF);
+
+	constexpr uint64 EntryFlag = 8;
+
+	// 解析用の局面 (side 0 が視点のスネーク)
+	struct State
+	{
+		// 確保済みのマス
+		uint64 occupied = 0;
+
+		std::array<int32, 2> head{};
+
+		std::array<int32, 2> direction{};
+
+		std::array<bool, 2> alive{};
+	};
+
+	// 局面を一意に表すキー
+	struct StateKey
+	{
+		uint64 occupied;
+
+		// スネーク毎に10bit: 頭のマス(6bit), 向き(3bit), 生存(1bit)
+		uint32 heads;
+
+		bool operator==(const StateKey&) const = default;
+
+		uint64 hash() const { return Mix(occupied ^ Mix(heads)); }
+	};
+
+	struct StateKeyHash
+	{
+		size_t operator()(const StateKey& key) const { return static_cast<size_t>(key.hash()); }
+	};
+}
+
+/// @brief 対称変換の変換表
+struct Tablebase::Geometry
+{
+	Size fieldSize;
+
+	Array<Symmetry> symmetries;
+
+	// [対称変換][マス] -> マス
+	Array<std::array<int8, MaxCellCount>> cellMaps;
+
+	// [対称変換][方向] -> 方向
+	Array<std::array<int8, 8>> directionMaps;
+
+	// [対称変換][バイト位置][バイトの値] -> 変換後の確保済みマス
+	Array<std::array<std::array<uint64, 256>, 8>> occupiedMaps;
+
+	// [マス][方向] -> 移動先のマス (範囲外は-1)
+	Array<std::array<int8, 8>> neighbors;
+
+	explicit Geometry(Size fieldSize)
+		: fieldSize(fieldSize)
+		, symmetries(Symmetry::Enumerate(fieldSize))
+	{
+		const int32 cellCount = fieldSize.x * fieldSize.y;
+		const auto toIndex = [&](Point pos) { return static_cast<int8>(pos.y * fieldSize.x + pos.x); };
+
+		for (const Symmetry symmetry : symmetries)
+		{
+			auto& cellMap = cellMaps.emplace_back();
+			for (const Point pos : Iota2D(fieldSize))
+			{
+				cellMap[toIndex(pos)] = toIndex(symmetry.apply(pos, fieldSize));
+			}
+
+			auto& directionMap = directionMaps.emplace_back();
+			for (int32 dir : Iota(8))
+			{
+				directionMap[dir] = static_cast<int8>(symmetry.apply(Direction(dir)));
+			}
+
+			auto& occupiedMap = occupiedMaps.emplace_back();
+			for (int32 byteIdx : Iota(8))
+			{
+				for (int32 value : Iota(256))
+				{
+					uint64 mapped = 0;
+					for (int32 bit : Iota(8))
+					{
+						const int32 cell = byteIdx * 8 + bit;
+						if ((value >> bit & 1) && cell < cellCount)
+						{
+							mapped |= uint64(1) << cellMap[cell];
+						}
+					}
+					occupiedMap[byteIdx][value] = mapped;
+				}
+			}
+		}
+
+		neighbors.resize(cellCount);
+		for (const Point pos : Iota2D(fieldSize))
+		{
+			for (int32 dir : Iota(8))
+			{
+				const Point next = pos + Util::ToPoint(Direction(dir));
+				neighbors[toIndex(pos)][dir] = Rect{ 0, 0, fieldSize }.contains(next) ? toIndex(next) : int8(-1);
+			}
+		}
+	}
+
+	// 対称変換のうち最小のキーと, それを与える対称変換の番号
+	std::pair<StateKey, size_t> canonical(const State& state) const
+	{
+		std::pair<StateKey, size_t> result{ StateKey{ std::numeric_limits<uint64>::max(), 0 }, 0 };
+		for (size_t symIdx : Iota(symmetries.size()))
+		{
+			const auto& occupiedMap = occupiedMaps[symIdx];
+			uint64 occupied = 0;
+			for (int32 byteIdx : Iota(8))
+			{
+				occupied |= occupiedMap[byteIdx][(state.occupied >> (byteIdx * 8)) & 0xFF];
+			}
+
+			uint32 heads = 0;
+			for (int32 side : Iota(2))
+			{
+				if (state.alive[side])
+				{
+					const uint32 head = static_cast<uint32>(cellMaps[symIdx][state.head[side]]);
+					const uint32 direction = static_cast<uint32>(directionMaps[symIdx][state.direction[side]]);
+					heads |= (head | direction << 6 | 1 << 9) << (side * 10);
+				}
+			}
+
+			const StateKey key{ occupied, heads };
+			if (std::tie(key.occupied, key.heads) < std::tie(result.first.occupied, result.first.heads))
+			{
+				result = { key, symIdx };
+			}
+		}
+		return result;
+	}
+
+	// idから見た局面 (相手は残りの1匹)
+	State fromGame(const Game& game, SnakeID id) const
+	{
+		State state;
+		const auto& field = game.field();
+		for (const Point pos : Iota2D(fieldSize))
+		{
+			if (field[pos] != CellState::Unallocated)
+			{
+				state.occupied |= uint64(1) << (pos.y * fieldSize.x + pos.x);
+			}
+		}
+
+		int32 side = 0;
+		const auto setSide = [&](const Snake& snake) {
+			if (snake.state == SnakeState::Alive)
+			{
+				state.head[side] = snake.position.y * fieldSize.x + snake.position.x;
+				state.direction[side] = static_cast<int32>(snake.direction);
+				state.alive[side] = true;
+			}
+			side++;
+		};
+		setSide(game.snakes()[id]);
+		for (const auto [snakeId, snake] : Indexed(game.snakes()))
+		{
+			if (SnakeID(snakeId) != id)
+			{
+				setSide(snake);
+			}
+		}
+		return state;
+	}
+
+	// 同時に行動した後の局面 (Game::doActions と同じ規則)
+	State advance(const State& state, std::array<int32, 2> actions, std::array<int32, 2>& gained) const
+	{
+		State next = state;
+		std::array<int32, 2> target{ -1, -1 };
+		gained = { 0, 0 };
+		for (int32 side : Iota(2))
+		{
+			if (not state.alive[side])
+			{
+				continue;
+			}
+			next.direction[side] = (state.direction[side] + actions[side] + 8) % 8;
+			target[side] = neighbors[state.head[side]][next.direction[side]];
+			if (target[side] < 0)
+			{
+				next.alive[side] = false;
+			}
+		}
+
+		// 頭部衝突: 両方が死亡し, そのマスは確保済みになる
+		if (target[0] >= 0 && target[0] == target[1])
+		{
+			next.alive = { false, false };
+			next.occupied |= uint64(1) << target[0];
+		}
+		else
+		{
+			for (int32 side : Iota(2))
+			{
+				if (target[side] < 0)
+				{
+					continue;
+				}
+				if (state.occupied >> target[side] & 1)
+				{
+					next.alive[side] = false;
+					continue;
+				}
+				next.occupied |= uint64(1) << target[side];
+				next.head[side] = target[side];
+				gained[side] = 1;
+			}
+		}
+		return next;
+	}
+};
+
+namespace
+{
+	// 解析結果
+	struct Solution
+	{
+		// 以降に獲得するマス数の相手との差
+		int8 score;
+
+		// 正規化した盤面での最善手の進行方向 (視点のスネークが死亡している場合-1)
+		int8 direction;
+	};
+
+	// 自分の行動に相手が最善に応じる (マックスミニ) として, 到達可能な全局面の値を求める
+	class Analyzer
+	{
+	public:
+
+		Analyzer(const Tablebase::Geometry& geometry, std::function<void(size_t)> progress)
+			: m_geometry(geometry)
+			, m_progress(std::move(progress))
+		{ }
+
+		int32 solve(const State& state)
+		{
+			if (not state.alive[0] && not state.alive[1])
+			{
+				return 0;
+			}
+
+			const auto [key, symIdx] = m_geometry.canonical(state);
+			if (const auto it = m_solutions.find(key); it != m_solutions.end())
+			{
+				return it->second.score;
+			}
+
+			// 死亡しているスネークは動かない
+			const auto actionRange = [&](int32 side) {
+				return state.alive[side] ? std::pair{ -1, 1 } : std::pair{ 0, 0 };
+			};
+
+			int32 best = std::numeric_limits<int32>::min();
+			int32 bestDirection = -1;
+			for (int32 ownAction = actionRange(0).first; ownAction <= actionRange(0).second; ownAction++)
+			{
+				int32 worst = std::numeric_limits<int32>::max();
+				for (int32 otherAction = actionRange(1).first; otherAction <= actionRange(1).second; otherAction++)
+				{
+					std::array<int32, 2> gained;
+					const State next = m_geometry.advance(state, { ownAction, otherAction }, gained);
+					worst = Min(worst, gained[0] - gained[1] + solve(next));
+				}
+
+				if (worst > best)
+				{
+					best = worst;
+					bestDirection = state.alive[0] ? (state.direction[0] + ownAction + 8) % 8 : -1;
+				}
+			}
+
+			m_solutions.emplace(key, Solution{
+				.score = static_cast<int8>(best),
+				.direction = static_cast<int8>(bestDirection < 0 ? -1 : m_geometry.directionMaps[symIdx][bestDirection])
+				});
+
+			if (m_progress && m_solutions.size() % 65536 == 0)
+			{
+				m_progress(m_solutions.size());
+			}
+
+			return best;
+		}
+
+		const HashTable<StateKey, Solution, StateKeyHash>& solutions() const { return m_solutions; }
+
+	private:
+
+		const Tablebase::Geometry& m_geometry;
+
+		std::function<void(size_t)> m_progress;
+
+		HashTable<StateKey, Solution, StateKeyHash> m_solutions;
+	};
+}
+
+Tablebase::Tablebase(FilePathView path)
+	: m_file{ path }
+{
+	if (not m_file)
+	{
+		return;
+	}
+
+	const auto memory = m_file.mapAll();
+	if (memory.size < sizeof(Header))
+	{
+		return;
+	}
+
+	const auto* header = reinterpret_cast<const Header*>(memory.data);
+	if (header->magic != Magic ||
+		header->version != Version ||
+		not Supports(Size{ header->width, header->height }, header->snakeCount) ||
+		header->capacity == 0 ||
+		(header->capacity & (header->capacity - 1)) != 0 ||
+		header->entryCount >= header->capacity ||
+		header->capacity > (memory.size - sizeof(Header)) / sizeof(uint64))
+	{
+		return;
+	}
+
+	m_header = header;
+	m_entries = reinterpret_cast<const uint64*>(memory.data + sizeof(Header));
+	m_geometry = std::make_unique<Geometry>(Size{ header->width, header->height });
+}
+
+Tablebase::~Tablebase() = default;
+
+Optional<Tablebase::ProbeResult> Tablebase::probe(const Game& game, SnakeID id) const
+{
+	const auto& snakes = game.snakes();
+	if (not isOpen() ||
+		game.field().width() != m_header->width ||
+		game.field().height() != m_header->height ||
+		static_cast<int32>(snakes.size()) != m_header->snakeCount ||
+		snakes[id].state == SnakeState::Dead)
+	{
+		return none;
+	}
+
+	const auto [key, symIdx] = m_geometry->canonical(m_geometry->fromGame(game, id));
+	const uint64 hash = key.hash();
+	const uint64 fingerprint = hash & FingerprintMask;
+	const uint64 mask = m_header->capacity - 1;
+
+	// 線形探索 (負荷率は1/2以下)
+	for (uint64 index = hash & mask; m_entries[index] != 0; index = (index + 1) & mask)
+	{
+		const uint64 entry = m_entries[index];
+		if ((entry & FingerprintMask) != fingerprint)
+		{
+			continue;
+		}
+
+		const auto& snake = snakes[id];
+		const Direction direction = m_geometry->symmetries[symIdx].inverse(Direction(entry & 7));
+		const int32 score = static_cast<int32>((entry >> 4) & 0xFF) - 128;
+
+		int32 otherPoint = 0;
+		for (const auto [snakeId, other] : Indexed(snakes))
+		{
+			if (SnakeID(snakeId) != id)
+			{
+				otherPoint = other.point;
+			}
+		}
+
+		for (int32 i : Range(-1, 1))
+		{
+			const SnakeAction action = static_cast<SnakeAction>(i);
+			if (Util::DoAction(snake.direction, action) == direction)
+			{
+				const int32 finalDiff = snake.point + score - otherPoint;
+				return ProbeResult{
+					.action = action,
+					.score = score,
+					.outcome = (finalDiff > 0) - (finalDiff < 0)
+				};
+			}
+		}
+		return none;
+	}
+
+	return none;
+}
+
+bool Tablebase::Supports(Size fieldSize, int32 snakeCount)
+{
+	return fieldSize.x >= 2 && fieldSize.y >= 2 &&
+		fieldSize.x * fieldSize.y <= MaxCellCount &&
+		1 <= snakeCount && snakeCount <= MaxSnakeCount;
+}
+
+const Tablebase* Tablebase::Find(Size fieldSize, int32 snakeCount)
+{
+	static std::mutex mutex;
+	static std::map<std::tuple<int32, int32, int32>, std::unique_ptr<Tablebase>> tablebases;
+
+	if (not Supports(fieldSize, snakeCount))
+	{
+		return nullptr;
+	}
+
+	std::lock_guard lock(mutex);
+	auto& tablebase = tablebases[{ fieldSize.x, fieldSize.y, snakeCount }];
+	if (not tablebase)
+	{
+		tablebase = std::make_unique<Tablebase>(GetPath(fieldSize, snakeCount));
+	}
+	return tablebase->isOpen() ? tablebase.get() : nullptr;
+}
+
+FilePath Tablebase::GetPath(Size fieldSize, int32 snakeCount)
+{
+	return U"{}{}x{}_{}.tb"_fmt(TablebaseDirectory, fieldSize.x, fieldSize.y, snakeCount);
+}
+
+bool Tablebase::Build(Size fieldSize, int32 snakeCount, FilePathView path, std::function<void(size_t)> progress)
+{
+	if (not Supports(fieldSize, snakeCount))
+	{
+		return false;
+	}
+
+	const Geometry geometry(fieldSize);
+	Analyzer analyzer(geometry, progress);
+
+	// どのスネークから見た局面も含める
+	const Game initial(fieldSize, snakeCount);
+	for (SnakeID id : Iota(snakeCount))
+	{
+		analyzer.solve(geometry.fromGame(initial, id));
+	}
+
+	// 視点のスネークが生存している局面のみ記録する
+	size_t entryCount = 0;
+	for (const auto& [key, solution] : analyzer.solutions())
+	{
+		if (solution.direction >= 0)
+		{
+			entryCount++;
+		}
+	}
+
+	uint64 capacity = 1;
+	while (capacity < entryCount * 2 + 1)
+	{
+		capacity *= 2;
+	}
+
+	Array<uint64> entries(capacity, 0);
+	for (const auto& [key, solution] : analyzer.solutions())
+	{
+		if (solution.direction < 0)
+		{
+			continue;
+		}
+
+		const uint64 hash = key.hash();
+		uint64 index = hash & (capacity - 1);
+		while (entries[index] != 0)
+		{
+			index = (index + 1) & (capacity - 1);
+		}
+		entries[index] = (hash & FingerprintMask)
+			| (static_cast<uint64>(solution.score + 128) << 4)
+			| EntryFlag
+			| static_cast<uint64>(solution.direction);
+	}
+
+	if (progress)
+	{
+		progress(analyzer.solutions().size());
+	}
+
+	const Header header{
+		.magic = Magic,
+		.version = Version,
+		.width = fieldSize.x,
+		.height = fieldSize.y,
+		.snakeCount = snakeCount,
+		.reserved = 0,
+		.capacity = capacity,
+		.entryCount = entryCount
+	};
+
+	FileSystem::CreateDirectories(FileSystem::ParentPath(path));
+	BinaryWriter writer{ path };
+	if (not writer)
+	{
+		return false;
+	}
+	writer.write(header);
+	writer.write(entries.data(), entries.size() * sizeof(uint64));
+
+	return true;
+}
@@ -0,0 +1,96 @@
+﻿#pragma once
+#include "SuperSnake.hpp"
+
+/// @brief 小さいフィールドの到達可能な全局面を解析した終盤データベース
+/// @remark 2匹以下, 64マス以下のフィールドに対応し, 対称な局面は1つにまとめて記録します
+/// ファイルはメモリマップで開き, オープンアドレス法のハッシュ表を直接参照します
+class Tablebase
+{
+public:
+
+	struct Header
+	{
+		uint32 magic;
+
+		uint32 version;
+
+		int32 width;
+
+		int32 height;
+
+		int32 snakeCount;
+
+		int32 reserved;
+
+		/// @brief ハッシュ表のサイズ (2の累乗)
+		uint64 capacity;
+
+		uint64 entryCount;
+	};
+
+	struct ProbeResult
+	{
+		/// @brief 最善手
+		SuperSnake::SnakeAction action;
+
+		/// @brief 以降に獲得するマス数の相手との差 (相手が最善に応じた場合の保証値)
+		int32 score;
+
+		/// @brief 現在のポイントを含めた勝敗 (1: 勝ち, 0: 引き分け, -1: 負け)
+		int32 outcome;
+	};
+
+	// "SSTB"
+	static constexpr uint32 Magic = 0x42545353;
+
+	static constexpr uint32 Version = 1;
+
+	static constexpr int32 MaxCellCount = 64;
+
+	static constexpr int32 MaxSnakeCount = 2;
+
+	explicit Tablebase(FilePathView path);
+
+	~Tablebase();
+
+	bool isOpen() const { return m_entries != nullptr; }
+
+	size_t size() const { return isOpen() ? static_cast<size_t>(m_header->entryCount) : 0; }
+
+	/// @brief データベースを検索します
+	/// @param game 局面
+	/// @param id 操作するスネーク
+	/// @return データベースに含まれる局面であれば最善手と評価値, それ以外の場合none
+	Optional<ProbeResult> probe(const SuperSnake::Game& game, SuperSnake::SnakeID id) const;
+
+	/// @brief フィールドサイズ, スネーク数がデータベースに対応しているか
+	static bool Supports(Size fieldSize, int32 snakeCount);
+
+	/// @brief フィールドサイズ, スネーク数に対応するデータベースを取得します
+	/// @return ファイルが存在しない場合nullptr
+	static const Tablebase* Find(Size fieldSize, int32 snakeCount);
+
+	/// @brief データベースファイルのパスを取得します
+	static FilePath GetPath(Size fieldSize, int32 snakeCount);
+
+	/// @brief 初期局面から到達可能な全局面を解析し, データベースファイルを生成します
+	/// @param fieldSize フィールドサイズ
+	/// @param snakeCount スネーク数
+	/// @param path 出力先
+	/// @param progress 進捗の通知 (解析した局面数)
+	/// @return 書き出しに成功した場合true
+	static bool Build(Size fieldSize, int32 snakeCount, FilePathView path, std::function<void(size_t)> progress = nullptr);
+
+	struct Geometry;
+
+private:
+
+	MemoryMappedFileView m_file;
+
+	const Header* m_header = nullptr;
+
+	// 上位52bit: 局面のハッシュ値, bit4~11: 評価値+128, bit3: 1 (空きと区別), bit0~2: 正規化した盤面での進行方向
+	const uint64* m_entries = nullptr;
+
+	std::unique_ptr<Geometry> m_geometry;
+};
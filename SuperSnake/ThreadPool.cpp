@@ -0,0 +1,171 @@
+﻿#include "ThreadPool.hpp"
+#if SIV3D_PLATFORM(WINDOWS)
+# define NOMINMAX
+# define WIN32_LEAN_AND_MEAN
+# include <Windows.h>
+#endif
+
+namespace
+{
+	// 実行中のワーカー
+	thread_local const ThreadPool* t_pool = nullptr;
+
+	thread_local size_t t_workerIndex = 0;
+}
+
+ThreadPool::ThreadPool(const Options& options)
+	: m_options(options)
+{
+	const size_t workerCount = options.workerCount ? options.workerCount : DefaultWorkerCount();
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		m_workers.push_back(std::make_unique<Worker>());
+	}
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		m_workers[i]->thread = std::thread([this, i] { run(i); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(m_sleepMutex);
+		m_stopping = true;
+	}
+	m_sleepCondition.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		worker->thread.join();
+	}
+}
+
+void ThreadPool::submit(Task task, Optional<TimePoint> deadline)
+{
+	if (deadline)
+	{
+		std::lock_guard lock(m_scheduledMutex);
+		m_scheduled.push_back(ScheduledTask{ *deadline, m_nextSequence++, std::move(task) });
+		std::push_heap(m_scheduled.begin(), m_scheduled.end());
+	}
+	else
+	{
+		const size_t index = t_pool == this
+			? t_workerIndex
+			: m_nextWorker++ % m_workers.size();
+
+		Worker& worker = *m_workers[index];
+		std::lock_guard lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard lock(m_sleepMutex);
+		m_pendingCount++;
+	}
+	m_sleepCondition.notify_one();
+}
+
+size_t ThreadPool::DefaultWorkerCount()
+{
+	return Max<size_t>(Threading::GetConcurrency(), 2) - 1;
+}
+
+void ThreadPool::run(size_t index)
+{
+	t_pool = this;
+	t_workerIndex = index;
+	pinCurrentThread();
+
+	while (true)
+	{
+		Task task;
+		if (tryPop(index, task))
+		{
+			m_pendingCount--;
+			try
+			{
+				task();
+			}
+			catch (...) { }
+			continue;
+		}
+
+		std::unique_lock lock(m_sleepMutex);
+		m_sleepCondition.wait(lock, [&] { return m_pendingCount > 0 || m_stopping; });
+		if (m_stopping && m_pendingCount == 0)
+		{
+			return;
+		}
+	}
+}
+
+bool ThreadPool::tryPop(size_t index, Task& task)
+{
+	{
+		std::lock_guard lock(m_scheduledMutex);
+		if (not m_scheduled.isEmpty())
+		{
+			std::pop_heap(m_scheduled.begin(), m_scheduled.end());
+			task = std::move(m_scheduled.back().task);
+			m_scheduled.pop_back();
+			return true;
+		}
+	}
+
+	{
+		Worker& worker = *m_workers[index];
+		std::lock_guard lock(worker.mutex);
+		if (not worker.tasks.empty())
+		{
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t offset = 1; offset < m_workers.size(); offset++)
+	{
+		Worker& victim = *m_workers[(index + offset) % m_workers.size()];
+		std::lock_guard lock(victim.mutex);
+		if (not victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::pinCurrentThread() const
+{
+#if SIV3D_PLATFORM(WINDOWS)
+	const HANDLE thread = ::GetCurrentThread();
+
+	if (m_options.numaNode)
+	{
+		GROUP_AFFINITY affinity{};
+		if (::GetNumaNodeProcessorMaskEx(static_cast<USHORT>(*m_options.numaNode), &affinity))
+		{
+			// 論理プロセッサのマスクも指定されている場合は両方に含まれるものに限る
+			if (m_options.affinityMask && (affinity.Mask & m_options.affinityMask))
+			{
+				affinity.Mask &= m_options.affinityMask;
+			}
+			::SetThreadGroupAffinity(thread, &affinity, nullptr);
+		}
+	}
+	else if (m_options.affinityMask)
+	{
+		::SetThreadAffinityMask(thread, static_cast<DWORD_PTR>(m_options.affinityMask));
+	}
+
+	if (m_options.lowPriority)
+	{
+		::SetThreadPriority(thread, THREAD_PRIORITY_BELOW_NORMAL);
+	}
+#endif
+}
@@ -0,0 +1,121 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+#include <condition_variable>
+
+/// @brief 固定数のワーカーでタスクを実行するスレッドプール
+/// @remark 期限付きのタスクは共有のキューに入り, 期限の早い順に他のタスクより優先して実行します
+/// 期限の無いタスクはワーカー毎のキューに入り, 自分のキューが空になったら他のワーカーのキューから盗んで実行します
+/// ワーカーが投入したタスクは自分のキューに, それ以外のスレッドが投入したタスクは順番に各ワーカーのキューに入ります
+class ThreadPool
+{
+public:
+
+	using Task = std::move_only_function<void()>;
+
+	using TimePoint = std::chrono::steady_clock::time_point;
+
+	struct Options
+	{
+		/// @brief ワーカー数 (0の場合は DefaultWorkerCount)
+		size_t workerCount = 0;
+
+		/// @brief ワーカーを固定する論理プロセッサのマスク (0の場合は固定しない)
+		uint64 affinityMask = 0;
+
+		/// @brief ワーカーを固定するNUMAノード (noneの場合は固定しない)
+		Optional<uint32> numaNode;
+
+		/// @brief ワーカーの優先度を通常より下げる (描画スレッドを優先する)
+		bool lowPriority = true;
+	};
+
+	/// @remark 論理プロセッサ, NUMAノードへの固定と優先度の変更はWindowsのみ対応しています
+	explicit ThreadPool(const Options& options);
+
+	ThreadPool(const ThreadPool&) = delete;
+
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// @brief 残っているタスクを全て実行してから終了します
+	~ThreadPool();
+
+	size_t workerCount() const { return m_workers.size(); }
+
+	/// @brief タスクを投入します
+	/// @remark タスク内で送出された例外は無視されます. 結果や例外が必要な場合は async を使用してください
+	/// @param deadline 期限 (noneの場合は期限付きのタスクが無いときに実行します)
+	void submit(Task task, Optional<TimePoint> deadline = none);
+
+	/// @brief タスクを投入し, 結果を受け取るfutureを返します
+	template<class Func>
+	std::future<std::invoke_result_t<Func>> async(Func&& func, Optional<TimePoint> deadline = none)
+	{
+		std::packaged_task<std::invoke_result_t<Func>()> task(std::forward<Func>(func));
+		auto future = task.get_future();
+		submit(std::move(task), deadline);
+		return future;
+	}
+
+	/// @brief 既定のワーカー数
+	/// @remark 論理コア数 - 1 (描画スレッドの分を空ける) です
+	static size_t DefaultWorkerCount();
+
+private:
+
+	struct Worker
+	{
+		std::mutex mutex;
+
+		// 自分は後ろから, 他のワーカーは前から取り出す
+		std::deque<Task> tasks;
+
+		std::thread thread;
+	};
+
+	struct ScheduledTask
+	{
+		TimePoint deadline;
+
+		// 期限が同じ場合は投入順
+		uint64 sequence;
+
+		Task task;
+
+		// ヒープの先頭が期限の最も早いタスクになるよう逆順にする
+		bool operator<(const ScheduledTask& other) const
+		{
+			return std::tie(deadline, sequence) > std::tie(other.deadline, other.sequence);
+		}
+	};
+
+	Array<std::unique_ptr<Worker>> m_workers;
+
+	// 期限付きのタスク (ヒープ)
+	std::mutex m_scheduledMutex;
+
+	Array<ScheduledTask> m_scheduled;
+
+	uint64 m_nextSequence = 0;
+
+	// 待機中のワーカーを起こす
+	std::mutex m_sleepMutex;
+
+	std::condition_variable m_sleepCondition;
+
+	// キューに入っているタスク数 (増やすときはm_sleepMutexを取る)
+	std::atomic<size_t> m_pendingCount = 0;
+
+	std::atomic<size_t> m_nextWorker = 0;
+
+	bool m_stopping = false;
+
+	Options m_options;
+
+	void run(size_t index);
+
+	// 実行中のスレッドを m_options に従って固定する
+	void pinCurrentThread() const;
+
+	// 期限付きのタスク, 自分のキュー, 他のワーカーのキューの順に取り出す
+	bool tryPop(size_t index, Task& task);
+};
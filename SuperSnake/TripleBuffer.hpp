@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <Siv3D.hpp>
+
+/// @brief 1つのスレッドが書き込んだ最新の値を, 別の1つのスレッドがロックせずに読み取るトリプルバッファ
+/// @remark 書き込み側と読み取り側がそれぞれ1つずつスロットを持ち, 残りの1つを受け渡し用にします
+/// 受け渡し用のスロットの番号と更新の有無を1つのatomicで交換するため, どちらも相手を待つことはありません
+/// 書き込み側は publish の後に受け取るスロットに古い値が残っているため, 毎回全ての項目を書き直してください
+template<class Type>
+class TripleBuffer
+{
+public:
+
+	TripleBuffer() = default;
+
+	TripleBuffer(const TripleBuffer&) = delete;
+
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	/// @brief 書き込み中のスロット (書き込み側)
+	Type& back() { return m_slots[m_back]; }
+
+	/// @brief 書き込んだ値を読み取り側に渡します (書き込み側)
+	void publish()
+	{
+		m_back = m_middle.exchange(m_back | Dirty, std::memory_order_acq_rel) & IndexMask;
+	}
+
+	/// @brief 新しい値があれば読み取り中のスロットと交換します (読み取り側)
+	/// @return 新しい値に更新した
+	bool update()
+	{
+		if (not (m_middle.load(std::memory_order_relaxed) & Dirty))
+		{
+			return false;
+		}
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+
+	/// @brief 読み取り中のスロット (読み取り側, 次の update まで有効)
+	const Type& front() const { return m_slots[m_front]; }
+
+private:
+
+	static constexpr uint8 IndexMask = 0b011;
+
+	static constexpr uint8 Dirty = 0b100;
+
+	std::array<Type, 3> m_slots{};
+
+	// 書き込み側のみが参照する
+	uint8 m_back = 0;
+
+	// 読み取り側のみが参照する
+	uint8 m_front = 1;
+
+	// 受け渡し用のスロットの番号と, 読み取り側がまだ受け取っていないか
+	std::atomic<uint8> m_middle = 2;
+};
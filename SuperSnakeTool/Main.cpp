@@ -0,0 +1,603 @@
+﻿#include <Siv3D.hpp> // OpenSiv3D v0.6.15
+#include "OpeningBook.hpp"
+#include "Tablebase.hpp"
+#include "NNEvaluator.hpp"
+#include "SolverV1.hpp"
+#include "SolverArena.hpp"
+#include "EngineProtocol.hpp"
+#include "NetworkProtocol.hpp"
+#include "SpectatorHost.hpp"
+#include "SpectatorClient.hpp"
+#include "MatchServer.hpp"
+#if SIV3D_PLATFORM(WINDOWS)
+# include <io.h>
+# include <fcntl.h>
+#endif
+
+SIV3D_SET(EngineOption::Renderer::Headless)
+
+// SuperSnakeTool book <width> <height> <snakeCount> [plies=4] [depth=20] [path]
+static void RunBook(const Array<String>& args)
+{
+	if (args.size() < 3)
+	{
+		Console << U"usage: SuperSnakeTool book <width> <height> <snakeCount> [plies=4] [depth=20] [path]";
+		return;
+	}
+
+	const Size fieldSize{ ParseOr<int32>(args[0], 0), ParseOr<int32>(args[1], 0) };
+	const int32 snakeCount = ParseOr<int32>(args[2], 0);
+	const int32 plies = args.size() > 3 ? ParseOr<int32>(args[3], 4) : 4;
+	const int32 depth = args.size() > 4 ? ParseOr<int32>(args[4], 20) : 20;
+	const FilePath path = args.size() > 5 ? args[5] : OpeningBook::GetPath(fieldSize, snakeCount);
+
+	if (fieldSize.x < 2 || fieldSize.y < 2 || snakeCount < 1 || snakeCount > 4)
+	{
+		Console << U"[Error] invalid field size or snake count";
+		return;
+	}
+
+	Console << U"Building {}x{}, {} snakes, {} plies, depth {} -> {}"_fmt(fieldSize.x, fieldSize.y, snakeCount, plies, depth, path);
+
+	const bool succeeded = OpeningBook::Build(fieldSize, snakeCount, plies, depth, path, [](size_t completed, size_t total) {
+		Console << U"{}/{}"_fmt(completed, total);
+	});
+
+	if (not succeeded)
+	{
+		Console << U"[Error] failed to write {}"_fmt(path);
+		return;
+	}
+
+	Console << U"Done: {} positions"_fmt(OpeningBook(path).size());
+}
+
+// SuperSnakeTool tablebase <width> <height> <snakeCount> [path]
+static void RunTablebase(const Array<String>& args)
+{
+	if (args.size() < 3)
+	{
+		Console << U"usage: SuperSnakeTool tablebase <width> <height> <snakeCount> [path]";
+		return;
+	}
+
+	const Size fieldSize{ ParseOr<int32>(args[0], 0), ParseOr<int32>(args[1], 0) };
+	const int32 snakeCount = ParseOr<int32>(args[2], 0);
+	const FilePath path = args.size() > 3 ? args[3] : Tablebase::GetPath(fieldSize, snakeCount);
+
+	if (not Tablebase::Supports(fieldSize, snakeCount))
+	{
+		Console << U"[Error] unsupported field size or snake count (up to {} cells, {} snakes)"_fmt(Tablebase::MaxCellCount, Tablebase::MaxSnakeCount);
+		return;
+	}
+
+	Console << U"Building {}x{}, {} snakes -> {}"_fmt(fieldSize.x, fieldSize.y, snakeCount, path);
+
+	const bool succeeded = Tablebase::Build(fieldSize, snakeCount, path, [](size_t solved) {
+		Console << U"{} positions"_fmt(solved);
+	});
+
+	if (not succeeded)
+	{
+		Console << U"[Error] failed to write {}"_fmt(path);
+		return;
+	}
+
+	const Tablebase tablebase(path);
+	Console << U"Done: {} positions"_fmt(tablebase.size());
+
+	// 初期局面の評価値
+	const SuperSnake::Game initial(fieldSize, snakeCount);
+	if (const auto result = tablebase.probe(initial, 0))
+	{
+		Console << U"Initial position: score {:+}, best {}"_fmt(result->score, static_cast<int32>(result->action));
+	}
+}
+
+// 自己対戦の棋譜ファイル "SSSP"
+constexpr uint32 SelfPlayMagic = 0x50535353;
+
+constexpr uint32 SelfPlayVersion = 1;
+
+// SuperSnakeTool selfplay <width> <height> <snakeCount> <games> [path=eval/selfplay.bin] [epsilon=0.1]
+static void RunSelfPlay(const Array<String>& args)
+{
+	if (args.size() < 4)
+	{
+		Console << U"usage: SuperSnakeTool selfplay <width> <height> <snakeCount> <games> [path=eval/selfplay.bin] [epsilon=0.1]";
+		return;
+	}
+
+	const Size fieldSize{ ParseOr<int32>(args[0], 0), ParseOr<int32>(args[1], 0) };
+	const int32 snakeCount = ParseOr<int32>(args[2], 0);
+	const int32 gameCount = ParseOr<int32>(args[3], 0);
+	const FilePath path = args.size() > 4 ? args[4] : FilePath{ U"eval/selfplay.bin" };
+	const double epsilon = args.size() > 5 ? ParseOr<double>(args[5], 0.1) : 0.1;
+
+	if (fieldSize.x < 2 || fieldSize.y < 2 || snakeCount < 1 || snakeCount > 4)
+	{
+		Console << U"[Error] invalid field size or snake count";
+		return;
+	}
+
+	FileSystem::CreateDirectories(FileSystem::ParentPath(path));
+	BinaryWriter writer{ path, OpenMode::Append };
+	if (not writer)
+	{
+		Console << U"[Error] failed to open {}"_fmt(path);
+		return;
+	}
+	if (writer.size() == 0)
+	{
+		writer.write(SelfPlayMagic);
+		writer.write(SelfPlayVersion);
+		writer.write(fieldSize.x);
+		writer.write(fieldSize.y);
+	}
+
+	struct Sample
+	{
+		Array<uint32> features;
+
+		SuperSnake::SnakeID id;
+
+		// 記録時点の各スネークのポイント
+		Array<int32> points;
+	};
+
+	std::mutex mutex;
+	std::atomic<int32> nextGame = 0;
+	std::atomic<int32> finishedGames = 0;
+	size_t sampleCount = 0;
+
+	Array<std::thread> workers(Max<size_t>(Threading::GetConcurrency(), 1));
+	for (auto& worker : workers)
+	{
+		worker = std::thread([&] {
+			Array<std::unique_ptr<Solver>> solvers;
+			for (int32 i = 0; i < snakeCount; i++)
+			{
+				solvers.push_back(std::make_unique<SolverV1>());
+			}
+
+			while (nextGame++ < gameCount)
+			{
+				SuperSnake::Game game(fieldSize, snakeCount);
+				Array<Sample> samples;
+
+				while (not game.isGameOver())
+				{
+					const Array<int32> points = game.snakes().map([](const SuperSnake::Snake& s) { return s.point; });
+					Array<SuperSnake::SnakeAction> actions(snakeCount, SuperSnake::SnakeAction::Stay);
+					for (SuperSnake::SnakeID id = 0; id < snakeCount; id++)
+					{
+						if (game.snakes()[id].state == SuperSnake::SnakeState::Dead)
+						{
+							continue;
+						}
+
+						samples.push_back(Sample{ NNEvaluator::ActiveFeatures(game, id), id, points });
+
+						// 局面を散らすため一定の確率でランダムに動かす
+						actions[id] = RandomBool(epsilon)
+							? static_cast<SuperSnake::SnakeAction>(Random(-1, 1))
+							: solvers[id]->solve(game, id, SolveContext{});
+					}
+					game.doActions(actions);
+				}
+
+				std::lock_guard lock(mutex);
+				for (const auto& sample : samples)
+				{
+					// 目的値: 以降に獲得したマス数の, 他のスネークの平均との差
+					const auto gained = [&](SuperSnake::SnakeID id) {
+						return game.snakes()[id].point - sample.points[id];
+					};
+					double othersGained = 0;
+					for (SuperSnake::SnakeID id = 0; id < snakeCount; id++)
+					{
+						if (id != sample.id)
+						{
+							othersGained += gained(id);
+						}
+					}
+					const float target = static_cast<float>(gained(sample.id) - (snakeCount > 1 ? othersGained / (snakeCount - 1) : 0.0));
+
+					writer.write(static_cast<uint32>(sample.features.size()));
+					writer.write(sample.features.data(), sample.features.size() * sizeof(uint32));
+					writer.write(target);
+				}
+				sampleCount += samples.size();
+
+				Console << U"{}/{} games, {} samples"_fmt(++finishedGames, gameCount, sampleCount);
+			}
+		});
+	}
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+// SuperSnakeTool engine
+// 標準入出力で EngineProtocol の要求を受け取り, SolverV1 で探索して返す (SolverProcess 用)
+static void RunEngine(const Array<String>&)
+{
+#if SIV3D_PLATFORM(WINDOWS)
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	SolverV1 solver;
+	SolverArena arena;
+	while (true)
+	{
+		std::array<Byte, sizeof(EngineProtocol::MessageHeader)> headerBytes;
+		if (std::fread(headerBytes.data(), 1, headerBytes.size(), stdin) != headerBytes.size())
+		{
+			return;
+		}
+
+		const auto header = EngineProtocol::DecodeHeader(headerBytes.data());
+		if (not header)
+		{
+			return;
+		}
+
+		Array<Byte> payload(header->size);
+		if (std::fread(payload.data(), 1, payload.size(), stdin) != payload.size())
+		{
+			return;
+		}
+
+		if (header->type != EngineProtocol::MessageType::Solve)
+		{
+			continue;
+		}
+
+		const auto request = EngineProtocol::DecodeSolveRequest(payload);
+		if (not request)
+		{
+			return;
+		}
+
+		Optional<Duration> timeLimit;
+		if (request->timeLimitMs > 0)
+		{
+			timeLimit = Duration{ request->timeLimitMs / 1000.0 };
+		}
+
+		SolveContext context = SolveContext::WithTimeLimit({}, timeLimit);
+		arena.reset(request->game.fieldSize());
+		context.arena = &arena;
+
+		// ソルバーは Game を受け取るため, 探索の直前に1回だけ変換する
+		const SuperSnake::Game game = request->game.toGame();
+		EngineProtocol::SolveResponse response{
+			.requestId = request->requestId,
+			.actions = solver.solveJoint(game, request->ids, context)
+		};
+		response.stats = solver.stats().value_or(SolverStats{});
+
+		const auto message = EngineProtocol::EncodeMessage(
+			EngineProtocol::MessageType::Result,
+			EngineProtocol::EncodeSolveResponse(response));
+		std::fwrite(message.data(), 1, message.size(), stdout);
+		std::fflush(stdout);
+	}
+}
+
+// SuperSnakeTool netclient [host=127.0.0.1] [port=50730]
+// Network のコントローラーとしてホストに接続し, 割り当てられたスネークを SolverV1 で操作する
+static void RunNetClient(const Array<String>& args)
+{
+	const IPv4Address address{ args.size() > 0 ? args[0] : String{ U"127.0.0.1" } };
+	const uint16 port = args.size() > 1 ? ParseOr<uint16>(args[1], NetworkProtocol::DefaultPort) : NetworkProtocol::DefaultPort;
+
+	// 制限時間のうち通信に充てる時間
+	constexpr Duration NetworkMargin = 0.05s;
+
+	TCPClient client;
+	if (not client.connect(address, port))
+	{
+		Console << U"[Error] failed to connect {}:{}"_fmt(address.str(), port);
+		return;
+	}
+	while (not client.isConnected())
+	{
+		if (client.hasError())
+		{
+			Console << U"[Error] failed to connect {}:{}"_fmt(address.str(), port);
+			return;
+		}
+		System::Sleep(10ms);
+	}
+	Console << U"Connected to {}:{}"_fmt(address.str(), port);
+
+	const auto send = [&](NetworkProtocol::MessageType type, const Array<Byte>& payload) {
+		// ヘッダーとペイロードを1回で送る
+		const Array<Byte> frame = NetworkProtocol::EncodeFrame(type, payload);
+		client.send(frame.data(), frame.size());
+	};
+	send(NetworkProtocol::MessageType::Hello, NetworkProtocol::EncodeHello());
+
+	SolverV1 solver;
+	SolverArena arena;
+	NetworkProtocol::RemotePosition position;
+	int8 snakeId = NetworkProtocol::Unassigned;
+	while (true)
+	{
+		if (client.hasError() || not client.isConnected())
+		{
+			Console << U"Disconnected";
+			return;
+		}
+
+		NetworkProtocol::Frame frame;
+		const auto status = NetworkProtocol::ReadFrame(client, frame);
+		if (status == NetworkProtocol::ReadStatus::Invalid)
+		{
+			Console << U"[Error] invalid message";
+			return;
+		}
+		if (status == NetworkProtocol::ReadStatus::Incomplete)
+		{
+			System::Sleep(1ms);
+			continue;
+		}
+
+		// 受信した時点から制限時間を数える
+		const Stopwatch stopwatch{ StartImmediately::Yes };
+		const auto& payload = frame.payload;
+
+		if (frame.type == NetworkProtocol::MessageType::Assign)
+		{
+			if (const auto id = NetworkProtocol::DecodeAssign(payload))
+			{
+				snakeId = *id;
+				Console << (snakeId == NetworkProtocol::Unassigned
+					? String{ U"Waiting for a snake" }
+					: U"Assigned snake {}"_fmt(snakeId));
+			}
+			continue;
+		}
+
+		if (frame.type != NetworkProtocol::MessageType::Position)
+		{
+			continue;
+		}
+
+		if (not NetworkProtocol::ApplyPosition(payload, position))
+		{
+			Console << U"[Error] invalid position";
+			return;
+		}
+
+		if (snakeId == NetworkProtocol::Unassigned ||
+			static_cast<size_t>(snakeId) >= position.snakes.size() ||
+			position.snakes[snakeId].state != SuperSnake::SnakeState::Alive)
+		{
+			continue;
+		}
+
+		Optional<Duration> timeLimit;
+		if (position.timeLimitMs > 0)
+		{
+			timeLimit = Max(Duration{ position.timeLimitMs / 1000.0 } - NetworkMargin - stopwatch.elapsed(), Duration{ 0.01 });
+		}
+
+		const SuperSnake::Game game = position.toGame();
+		SolveContext context = SolveContext::WithTimeLimit({}, timeLimit);
+		arena.reset(game.field().size());
+		context.arena = &arena;
+
+		const NetworkProtocol::ActionMessage message{
+			.gameId = position.gameId,
+			.step = position.step,
+			.action = solver.solveJoint(game, { SuperSnake::SnakeID(snakeId) }, context).front()
+		};
+		send(NetworkProtocol::MessageType::Action, NetworkProtocol::EncodeAction(message));
+	}
+}
+
+// SuperSnakeTool spectate <width> <height> <snakeCount> [port=50731]
+// ループバックで観戦の配信と受信を行い, 観戦者の局面が毎ステップ一致することと通信量を確認する
+static void RunSpectate(const Array<String>& args)
+{
+	if (args.size() < 3)
+	{
+		Console << U"usage: SuperSnakeTool spectate <width> <height> <snakeCount> [port=50731]";
+		return;
+	}
+
+	const Size fieldSize{ ParseOr<int32>(args[0], 0), ParseOr<int32>(args[1], 0) };
+	const int32 snakeCount = ParseOr<int32>(args[2], 0);
+	const uint16 port = args.size() > 3 ? ParseOr<uint16>(args[3], NetworkProtocol::DefaultSpectatorPort) : NetworkProtocol::DefaultSpectatorPort;
+
+	if (fieldSize.x < 2 || fieldSize.y < 2 || snakeCount < 1 || snakeCount > 4)
+	{
+		Console << U"[Error] invalid field size or snake count";
+		return;
+	}
+
+	SuperSnake::Game game(fieldSize, snakeCount);
+	SpectatorHost host{ port };
+	SpectatorClient client{ IPv4Address::Localhost(), port };
+	std::unique_ptr<SuperSnake::Game> viewed;
+
+	// 観戦者の局面が step に追いつくまで送受信する
+	const auto sync = [&](int32 step) {
+		const Stopwatch stopwatch{ StartImmediately::Yes };
+		while (stopwatch.elapsed() < 5s)
+		{
+			host.update(&game);
+			client.update(viewed);
+			if (viewed && viewed->gameId == game.gameId && viewed->step() == step)
+			{
+				return true;
+			}
+			System::Sleep(1ms);
+		}
+		return false;
+	};
+
+	const auto matches = [&] {
+		if (viewed->isGameOver() != game.isGameOver() ||
+			viewed->field() != game.field() ||
+			viewed->snakes().size() != game.snakes().size())
+		{
+			return false;
+		}
+		for (const SuperSnake::SnakeID id : Iota(game.snakes().size()))
+		{
+			const auto& a = viewed->snakes()[id];
+			const auto& b = game.snakes()[id];
+			if (a.point != b.point || a.name != b.name || a.position != b.position ||
+				a.direction != b.direction || a.state != b.state || a.bodyPath != b.bodyPath)
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	if (not sync(0))
+	{
+		Console << U"[Error] no keyframe received";
+		return;
+	}
+	const uint64 keyframeBytes = client.receivedBytes();
+	Console << U"Keyframe: {} bytes ({} cells)"_fmt(keyframeBytes, fieldSize.x * fieldSize.y);
+
+	Array<std::unique_ptr<Solver>> solvers;
+	for (int32 i = 0; i < snakeCount; i++)
+	{
+		solvers.push_back(std::make_unique<SolverV1>());
+	}
+
+	while (not game.isGameOver())
+	{
+		Array<SuperSnake::SnakeAction> actions(snakeCount, SuperSnake::SnakeAction::Stay);
+		for (SuperSnake::SnakeID id = 0; id < snakeCount; id++)
+		{
+			if (game.snakes()[id].state == SuperSnake::SnakeState::Alive)
+			{
+				actions[id] = solvers[id]->solve(game, id, SolveContext::WithTimeLimit({}, 0.01s));
+			}
+		}
+		const auto events = game.doActions(actions);
+		host.sendStep(game, actions, events);
+
+		if (not sync(game.step()) || not matches())
+		{
+			Console << U"[Error] mismatch at step {}"_fmt(game.step());
+			return;
+		}
+	}
+
+	const uint64 stepBytes = client.receivedBytes() - keyframeBytes;
+	Console << U"Done: {} steps, {} bytes ({:.1f} bytes/step)"_fmt(game.step(), stepBytes, static_cast<double>(stepBytes) / Max(game.step(), 1));
+}
+
+// SuperSnakeTool server <width> <height> <snakeCount> <concurrent> [networkSeats=0] [games=0] [timeLimitMs=100] [port=50730]
+// 多数の対戦を同時に進行させ, 対戦毎と全体の遅延の統計を表示する
+static void RunServer(const Array<String>& args)
+{
+	if (args.size() < 4)
+	{
+		Console << U"usage: SuperSnakeTool server <width> <height> <snakeCount> <concurrent> [networkSeats=0] [games=0] [timeLimitMs=100] [port=50730]";
+		return;
+	}
+
+	MatchServer::Options options{
+		.fieldSize = { ParseOr<int32>(args[0], 0), ParseOr<int32>(args[1], 0) },
+		.snakeCount = ParseOr<int32>(args[2], 0),
+		.networkSeats = args.size() > 4 ? ParseOr<int32>(args[4], 0) : 0,
+		.concurrentMatches = ParseOr<int32>(args[3], 0),
+		.totalMatches = args.size() > 5 ? ParseOr<int32>(args[5], 0) : 0,
+		.timeLimit = Duration{ (args.size() > 6 ? ParseOr<int32>(args[6], 100) : 100) / 1000.0 },
+		.port = args.size() > 7 ? ParseOr<uint16>(args[7], NetworkProtocol::DefaultPort) : NetworkProtocol::DefaultPort
+	};
+
+	if (options.fieldSize.x < 2 || options.fieldSize.y < 2 || options.snakeCount < 1 || options.snakeCount > 4 ||
+		options.concurrentMatches < 1 || options.networkSeats < 0 || options.networkSeats > options.snakeCount ||
+		options.timeLimit <= Duration{ 0 })
+	{
+		Console << U"[Error] invalid arguments";
+		return;
+	}
+
+	const auto formatLatency = [](const MatchServer::LatencyStats& latency) {
+		return U"mean {:.1f} ms, p50 {:.1f} ms, p99 {:.1f} ms, max {:.1f} ms"_fmt(
+			latency.mean().count() * 1000,
+			latency.percentile(0.5).count() * 1000,
+			latency.percentile(0.99).count() * 1000,
+			latency.max.count() * 1000);
+	};
+
+	MatchServer server{ options };
+	Console << U"Listening on port {}, {} matches at a time"_fmt(options.port, options.concurrentMatches);
+
+	const Stopwatch total{ StartImmediately::Yes };
+	Stopwatch report{ StartImmediately::Yes };
+	uint64 reportedSteps = 0;
+	while (not server.isFinished())
+	{
+		if (not server.update())
+		{
+			// 探索の完了ですぐに起き, ネットワークはこの間隔で確認する
+			server.wait(1ms);
+		}
+
+		for (const auto& result : server.takeResults())
+		{
+			Console << U"Match {}: {} steps, points {}, latency {}"_fmt(
+				result.gameId, result.steps, result.points, formatLatency(result.latency));
+		}
+
+		if (report.elapsed() >= 5s)
+		{
+			Console << U"[{:.0f}s] {} running, {} finished, {} waiting clients, {:.0f} steps/s, latency {}"_fmt(
+				total.elapsed().count(),
+				server.runningMatches(),
+				server.finishedMatches(),
+				server.waitingClients(),
+				(server.totalSteps() - reportedSteps) / report.elapsed().count(),
+				formatLatency(server.latency()));
+			reportedSteps = server.totalSteps();
+			report.restart();
+		}
+	}
+
+	Console << U"Done: {} matches, {} steps in {:.1f}s, latency {}"_fmt(
+		server.finishedMatches(), server.totalSteps(), total.elapsed().count(), formatLatency(server.latency()));
+}
+
+void Main()
+{
+	const std::map<String, void(*)(const Array<String>&)> commands{
+		{ U"book", RunBook },
+		{ U"tablebase", RunTablebase },
+		{ U"selfplay", RunSelfPlay },
+		{ U"engine", RunEngine },
+		{ U"netclient", RunNetClient },
+		{ U"spectate", RunSpectate },
+		{ U"server", RunServer },
+	};
+
+	// 0: 実行ファイルのパス, 1: コマンド, 2~: 引数
+	const Array<String> args = System::GetCommandLineArgs();
+	const auto command = args.size() > 1 ? commands.find(args[1]) : commands.end();
+	if (command == commands.end())
+	{
+		Console << U"usage: SuperSnakeTool <command> [args...]";
+		for (const auto& [name, func] : commands)
+		{
+			Console << U"  " << name;
+		}
+		return;
+	}
+
+	command->second(Array<String>(std::next(args.begin(), 2), args.end()));
+}
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""SuperSnakeTool selfplay の棋譜から評価関数を学習し, NNEvaluator 用の重みファイルを書き出す
+
+usage: python train_eval.py <selfplay.bin>... [-o eval/weights.nnue] [--epochs 20]
+
+ネットワークの構成と量子化は NNEvaluator.hpp / NNEvaluator.cpp と一致させること
+  特徴量 -> 64 (ClippedReLU) -> 32 (ClippedReLU) -> 1
+  w1, b1: int16 (127倍), w2: int8 (64倍), b2: int32 (127 * 64倍), w3: int8 (64倍), b3: int32 (127 * 64倍)
+"""
+import argparse
+import struct
+
+import numpy as np
+
+SELFPLAY_MAGIC = 0x50535353  # "SSSP"
+SELFPLAY_VERSION = 1
+NN_MAGIC = 0x4E4E5353  # "SSNN"
+NN_VERSION = 1
+HIDDEN1 = 64
+HIDDEN2 = 32
+# int8の重みの上限 (127 / 64)
+WEIGHT_LIMIT = 127 / 64
+
+
+def load_selfplay(paths):
+    size = None
+    features, offsets, targets = [], [0], []
+    for path in paths:
+        data = open(path, "rb").read()
+        magic, version, width, height = struct.unpack_from("<IIii", data, 0)
+        if magic != SELFPLAY_MAGIC or version != SELFPLAY_VERSION:
+            raise ValueError(f"{path}: not a selfplay file")
+        if size is not None and size != (width, height):
+            raise ValueError(f"{path}: field size mismatch")
+        size = (width, height)
+
+        pos = 16
+        while pos < len(data):
+            (count,) = struct.unpack_from("<I", data, pos)
+            pos += 4
+            features.append(np.frombuffer(data, dtype="<u4", count=count, offset=pos))
+            pos += count * 4
+            (target,) = struct.unpack_from("<f", data, pos)
+            pos += 4
+            offsets.append(offsets[-1] + count)
+            targets.append(target)
+
+    return size, np.concatenate(features).astype(np.int64), np.array(offsets), np.array(targets, dtype=np.float32)
+
+
+class Model:
+    def __init__(self, feature_count, rng):
+        self.params = {
+            "w1": rng.normal(0, 0.05, (feature_count, HIDDEN1)).astype(np.float32),
+            "b1": np.full(HIDDEN1, 0.5, dtype=np.float32),
+            "w2": rng.normal(0, 1 / np.sqrt(HIDDEN1), (HIDDEN1, HIDDEN2)).astype(np.float32),
+            "b2": np.zeros(HIDDEN2, dtype=np.float32),
+            "w3": rng.normal(0, 1 / np.sqrt(HIDDEN2), HIDDEN2).astype(np.float32),
+            "b3": np.zeros(1, dtype=np.float32),
+        }
+        self.m = {k: np.zeros_like(v) for k, v in self.params.items()}
+        self.v = {k: np.zeros_like(v) for k, v in self.params.items()}
+        self.t = 0
+
+    def forward(self, index, segment, batch_size):
+        p = self.params
+        a1 = np.zeros((batch_size, HIDDEN1), dtype=np.float32)
+        np.add.at(a1, segment, p["w1"][index])
+        a1 += p["b1"]
+        h1 = np.clip(a1, 0, 1)
+        a2 = h1 @ p["w2"] + p["b2"]
+        h2 = np.clip(a2, 0, 1)
+        out = h2 @ p["w3"] + p["b3"]
+        return out, (a1, h1, a2, h2)
+
+    def step(self, index, segment, target, lr):
+        p = self.params
+        batch_size = len(target)
+        out, (a1, h1, a2, h2) = self.forward(index, segment, batch_size)
+
+        d_out = 2 * (out - target) / batch_size
+        grads = {"w3": h2.T @ d_out, "b3": np.array([d_out.sum()], dtype=np.float32)}
+        d_a2 = np.outer(d_out, p["w3"]) * ((a2 > 0) & (a2 < 1))
+        grads["w2"] = h1.T @ d_a2
+        grads["b2"] = d_a2.sum(axis=0)
+        d_a1 = (d_a2 @ p["w2"].T) * ((a1 > 0) & (a1 < 1))
+        grads["b1"] = d_a1.sum(axis=0)
+        grads["w1"] = np.zeros_like(p["w1"])
+        np.add.at(grads["w1"], index, d_a1[segment])
+
+        # Adam
+        self.t += 1
+        for k, g in grads.items():
+            self.m[k] = 0.9 * self.m[k] + 0.1 * g
+            self.v[k] = 0.999 * self.v[k] + 0.001 * g * g
+            m_hat = self.m[k] / (1 - 0.9 ** self.t)
+            v_hat = self.v[k] / (1 - 0.999 ** self.t)
+            p[k] -= lr * m_hat / (np.sqrt(v_hat) + 1e-8)
+
+        p["w2"] = np.clip(p["w2"], -WEIGHT_LIMIT, WEIGHT_LIMIT)
+        p["w3"] = np.clip(p["w3"], -WEIGHT_LIMIT, WEIGHT_LIMIT)
+        return float(np.mean((out - target) ** 2))
+
+
+def export(model, size, output_scale, path):
+    p = model.params
+    w1 = np.clip(np.round(p["w1"] * 127), -32768, 32767).astype("<i2")
+    b1 = np.clip(np.round(p["b1"] * 127), -32768, 32767).astype("<i2")
+    w2 = np.round(p["w2"].T * 64).astype("<i1")  # [Hidden2][Hidden1]
+    b2 = np.round(p["b2"] * 127 * 64).astype("<i4")
+    w3 = np.round(p["w3"] * 64).astype("<i1")
+    b3 = np.round(p["b3"] * 127 * 64).astype("<i4")
+
+    with open(path, "wb") as f:
+        f.write(struct.pack("<IIiiIIfI", NN_MAGIC, NN_VERSION, size[0], size[1], HIDDEN1, HIDDEN2, output_scale, 0))
+        for array in (w1, b1, w2, b2, w3, b3):
+            f.write(array.tobytes())
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("inputs", nargs="+")
+    parser.add_argument("-o", "--output", default="eval/weights.nnue")
+    parser.add_argument("--epochs", type=int, default=20)
+    parser.add_argument("--batch-size", type=int, default=1024)
+    parser.add_argument("--lr", type=float, default=1e-3)
+    parser.add_argument("--output-scale", type=float, default=16.0, help="出力1.0あたりのマス数")
+    args = parser.parse_args()
+
+    size, features, offsets, targets = load_selfplay(args.inputs)
+    feature_count = size[0] * size[1] * 10
+    print(f"{size[0]}x{size[1]}: {len(targets)} samples")
+
+    rng = np.random.default_rng(0)
+    model = Model(feature_count, rng)
+    scaled_targets = targets / args.output_scale
+
+    for epoch in range(args.epochs):
+        order = rng.permutation(len(targets))
+        losses = []
+        for begin in range(0, len(order), args.batch_size):
+            batch = order[begin:begin + args.batch_size]
+            counts = offsets[batch + 1] - offsets[batch]
+            index = np.concatenate([features[offsets[i]:offsets[i + 1]] for i in batch])
+            segment = np.repeat(np.arange(len(batch)), counts)
+            losses.append(model.step(index, segment, scaled_targets[batch], args.lr))
+        print(f"epoch {epoch + 1}: loss {np.mean(losses):.5f}")
+
+    export(model, size, args.output_scale, args.output)
+    print(f"wrote {args.output}")
+
+
+if __name__ == "__main__":
+    main()